@@ -50,14 +50,17 @@
 
 #include "client.h"
 #include "cluster_client.h"
+#include "ketama_client.h"
 
 using PerfUtils::Cycles;
 
 pthread_mutex_t client::m_skew_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t client_group::m_conn_mutex = PTHREAD_MUTEX_INITIALIZER;
 int client::skew_count = 0;
 int client::total_conns = 0;
 int client::real_conns = 0;
+int client::filler_conns = 0;
+int client::skew_batch = 0;
+bool client::migration_placing = false;
 
 float get_2_meaningful_digits(float val)
 {
@@ -87,12 +90,16 @@ inline unsigned long int ts_diff_now(struct timeval a)
     return bval - aval;
 }
 
+// averaged as a whole, averaging seconds and microseconds apart drops the
+// fraction of the seconds and can put the start after the end
 inline timeval timeval_factorial_average(timeval a, timeval b, unsigned int weight)
 {
     timeval tv;
     double factor = ((double)weight - 1) / weight;
-    tv.tv_sec   = factor * a.tv_sec  + (double)b.tv_sec  / weight ;
-    tv.tv_usec  = factor * a.tv_usec + (double)b.tv_usec / weight ;
+    double usec = factor * ((double) a.tv_sec * 1000000 + a.tv_usec) +
+        ((double) b.tv_sec * 1000000 + b.tv_usec) / weight;
+    tv.tv_sec   = (time_t) (usec / 1000000);
+    tv.tv_usec  = (suseconds_t) (usec - (double) tv.tv_sec * 1000000);
     return (tv);
 }
 
@@ -101,19 +108,21 @@ bool client::setup_client(benchmark_config *config, abstract_protocol *protocol,
     m_config = config;
     assert(m_config != NULL);
 
-    // create main connection
-    shard_connection* conn = new shard_connection(m_connections.size(), this, m_config, m_event_base, protocol);
-    m_connections.push_back(conn);
+    // create main connection, and the others of a pooled client
+    for (unsigned int i = 0; i < m_config->conns_per_client; i++) {
+        shard_connection* conn = new shard_connection(m_connections.size(), this, m_config, m_event_base, protocol);
+        m_connections.push_back(conn);
+    }
 
     m_obj_gen = objgen->clone();
     assert(m_obj_gen != NULL);
 
-    if (config->distinct_client_seed && config->randomize)
-        m_obj_gen->set_random_seed(config->randomize + config->next_client_idx);
-    else if (config->randomize)
-        m_obj_gen->set_random_seed(config->randomize);
-    else if (config->distinct_client_seed)
-        m_obj_gen->set_random_seed(config->next_client_idx);
+    // all clients draw the same keys unless each gets a seed of its own
+    m_seed = prng_seed_child(config->seed, config->next_client_idx);
+    if (config->distinct_client_seed)
+        m_obj_gen->set_random_seed(prng_seed_child(m_seed, SEED_BRANCH_KEYS));
+    else
+        m_obj_gen->set_random_seed(prng_seed_child(config->seed, SEED_BRANCH_KEYS));
 
     if (config->key_pattern[0]=='P') {
         int range = (config->key_maximum - config->key_minimum)/(config->clients*config->threads) + 1;
@@ -125,8 +134,17 @@ bool client::setup_client(benchmark_config *config, abstract_protocol *protocol,
     }
     config->next_client_idx++;
 
-    m_keylist = new keylist(m_config->multi_key_get + 1);
-    assert(m_keylist != NULL);
+    // only multi-key GETs need the key list
+    if (m_config->multi_key_get > 0) {
+        m_keylist = new keylist(m_config->multi_key_get + 1);
+        assert(m_keylist != NULL);
+    }
+
+    if (m_config->command_mix.has_data_structures()) {
+        m_ds_value = (char *) malloc(m_config->ds_member_size);
+        assert(m_ds_value != NULL);
+        memset(m_ds_value, 'x', m_config->ds_member_size);
+    }
 
 
     return true;
@@ -134,9 +152,11 @@ bool client::setup_client(benchmark_config *config, abstract_protocol *protocol,
 
 client::client(client_group* group) :
         m_event_base(NULL), m_initialized(false), m_end_set(false), m_config(NULL),
-        m_obj_gen(NULL), m_reqs_processed(0), m_set_ratio_count(0), m_get_ratio_count(0),
-        m_tot_set_ops(0), m_tot_wait_ops(0)
+        m_obj_gen(NULL), m_reqs_processed(0), m_reqs_generated(0), m_set_ratio_count(0), m_get_ratio_count(0),
+        m_tot_set_ops(0), m_tot_wait_ops(0), m_cas_key_len(0), m_cas_unique(0), m_ds_value(NULL), m_untrimmed_pushes(0), m_keylist(NULL),
+        m_next_conn(0), m_seed(0)
 {
+    memset(m_mix_counts, 0, sizeof(m_mix_counts));
     m_event_base = group->get_event_base();
 
     if (!setup_client(group->get_config(), group->get_protocol(), group->get_obj_gen())) {
@@ -150,9 +170,11 @@ client::client(client_group* group) :
 client::client(struct event_base *event_base, benchmark_config *config,
                abstract_protocol *protocol, object_generator *obj_gen) :
         m_event_base(NULL), m_initialized(false), m_end_set(false), m_config(NULL),
-        m_obj_gen(NULL), m_reqs_processed(0), m_set_ratio_count(0), m_get_ratio_count(0),
-        m_tot_set_ops(0), m_tot_wait_ops(0)
+        m_obj_gen(NULL), m_reqs_processed(0), m_reqs_generated(0), m_set_ratio_count(0), m_get_ratio_count(0),
+        m_tot_set_ops(0), m_tot_wait_ops(0), m_cas_key_len(0), m_cas_unique(0), m_ds_value(NULL), m_untrimmed_pushes(0), m_keylist(NULL),
+        m_next_conn(0), m_seed(0)
 {
+    memset(m_mix_counts, 0, sizeof(m_mix_counts));
     m_event_base = event_base;
 
     if (!setup_client(config, protocol, obj_gen)) {
@@ -180,6 +202,11 @@ client::~client()
         delete m_keylist;
         m_keylist = NULL;
     }
+
+    if (m_ds_value != NULL) {
+        free(m_ds_value);
+        m_ds_value = NULL;
+    }
 }
 
 bool client::initialized(void)
@@ -189,19 +216,24 @@ bool client::initialized(void)
 
 void client::disconnect(void)
 {
-    shard_connection* sc = MAIN_CONNECTION;
-    assert(sc != NULL);
-
-    sc->disconnect();
+    for (unsigned int i = 0; i < m_connections.size(); i++)
+        m_connections[i]->disconnect();
 }
 
 int client::connect(void)
 {
-    struct connect_info addr;
+    for (unsigned int i = 0; i < m_connections.size(); i++) {
+        int ret = connect_conn(m_connections[i]);
+        if (ret)
+            return ret;
+    }
 
-    // get primary connection
-    shard_connection* sc = MAIN_CONNECTION;
-    assert(sc != NULL);
+    return 0;
+}
+
+int client::connect_conn(shard_connection* sc)
+{
+    struct connect_info addr;
 
     // get address information
     if (m_config->server_addr->get_connect_info(&addr) != 0) {
@@ -260,6 +292,12 @@ void client::set_end_time() {
         benchmark_debug_log("nothing else to do, test is finished.\n");
 
         m_stats.set_end_time(NULL);
+
+        unsigned long int allocs = 0;
+        for (unsigned int i = 0; i < m_connections.size(); i++)
+            allocs += m_connections[i]->get_request_allocs();
+        m_stats.set_request_allocs(allocs);
+
         m_end_set = true;
     }
 }
@@ -283,6 +321,8 @@ bool client::hold_pipeline(unsigned int conn_id) {
 // This function could use some urgent TLC -- but we need to do it without altering the behavior
 void client::create_request(struct timeval timestamp, unsigned int conn_id)
 {
+    conn_id = dispatch_conn(conn_id);
+
     // If the Set:Wait ratio is not 0, start off with WAITs
     if (m_config->wait_ratio.b &&
         (m_tot_wait_ops == 0 ||
@@ -298,6 +338,9 @@ void client::create_request(struct timeval timestamp, unsigned int conn_id)
         m_connections[conn_id]->send_wait_command(&timestamp, num_slaves, timeout);
         m_reqs_generated++;
     }
+    else if (m_config->command_mix.is_defined()) {
+        create_mix_request(timestamp, conn_id);
+    }
     // are we set or get? this depends on the ratio
     else if (m_set_ratio_count < m_config->ratio.a) {
         // set command
@@ -357,74 +400,583 @@ void client::create_request(struct timeval timestamp, unsigned int conn_id)
     }
 }
 
+// Hashes, lists and sorted sets live next to the data keys, under a suffix
+// naming their type, so they never collide with the string values.
+const char *client::ds_key(int cmd, int iter, unsigned int *len)
+{
+    static const char *suffix[] = { "hash", "list", "zset" };
+    unsigned int keylen;
+    const char *key = m_obj_gen->get_key(iter, &keylen);
+    int n = snprintf(m_mix_key, sizeof(m_mix_key), "%.*s:%s", keylen, key, suffix[(cmd - mc_hset) / 2]);
+    if (n >= (int) sizeof(m_mix_key))
+        n = sizeof(m_mix_key) - 1;
+
+    *len = n;
+    return m_mix_key;
+}
+
+// Interleaves the --command-mix commands by weight, in the same round-robin
+// fashion --ratio interleaves SETs and GETs.
+void client::create_mix_request(struct timeval timestamp, unsigned int conn_id)
+{
+    const config_command_mix& mix = m_config->command_mix;
+    int cmd;
+
+    for (cmd = 0; cmd < mc_count; cmd++) {
+        if (m_mix_counts[cmd] < mix.weights[cmd])
+            break;
+    }
+    if (cmd == mc_count) {
+        memset(m_mix_counts, 0, sizeof(m_mix_counts));
+        for (cmd = 0; !mix.weights[cmd]; cmd++);
+    }
+
+    m_mix_counts[cmd]++;
+
+    // a CAS needs the cas unique of an earlier GETS hit
+    if (cmd == mc_cas && !m_cas_key_len)
+        cmd = mc_gets;
+
+    switch (cmd) {
+        case mc_set:
+        case mc_append:
+        case mc_cas: {
+            data_object *obj = m_obj_gen->get_object(obj_iter_type(m_config, 0));
+            unsigned int key_len;
+            const char *key = obj->get_key(&key_len);
+            unsigned int value_len;
+            const char *value = obj->get_value(&value_len);
+
+            if (cmd == mc_set) {
+                m_connections[conn_id]->send_set_command(&timestamp, key, key_len,
+                                                         value, value_len, obj->get_expiry(),
+                                                         m_config->data_offset);
+            } else if (cmd == mc_append) {
+                m_connections[conn_id]->send_append_command(&timestamp, key, key_len,
+                                                            value, value_len);
+            } else {
+                m_connections[conn_id]->send_cas_command(&timestamp, m_cas_key, m_cas_key_len,
+                                                         value, value_len, obj->get_expiry(),
+                                                         m_cas_unique);
+                m_cas_key_len = 0;
+            }
+            break;
+        }
+        case mc_get:
+            if (m_config->multi_key_get > 0) {
+                unsigned int keys_count = mix.weights[mc_get] - m_mix_counts[mc_get] + 1;
+                if ((int)keys_count > m_config->multi_key_get)
+                    keys_count = m_config->multi_key_get;
+
+                m_keylist->clear();
+                while (m_keylist->get_keys_count() < keys_count) {
+                    unsigned int keylen;
+                    const char *key = m_obj_gen->get_key(obj_iter_type(m_config, 2), &keylen);
+                    assert(key != NULL);
+                    assert(keylen > 0);
+
+                    m_keylist->add_key(key, keylen);
+                }
+
+                m_connections[conn_id]->send_mget_command(&timestamp, m_keylist);
+                m_mix_counts[mc_get] += keys_count - 1;
+                break;
+            }
+            // fall through
+        case mc_gets: {
+            unsigned int keylen;
+            const char *key = m_obj_gen->get_key(obj_iter_type(m_config, 2), &keylen);
+            assert(key != NULL);
+            assert(keylen > 0);
+
+            if (cmd == mc_get)
+                m_connections[conn_id]->send_get_command(&timestamp, key, keylen, m_config->data_offset);
+            else
+                m_connections[conn_id]->send_gets_command(&timestamp, key, keylen);
+            break;
+        }
+        case mc_delete:
+        case mc_touch: {
+            data_object *obj = m_obj_gen->get_object(obj_iter_type(m_config, 0));
+            unsigned int keylen;
+            const char *key = obj->get_key(&keylen);
+
+            if (cmd == mc_delete)
+                m_connections[conn_id]->send_delete_command(&timestamp, key, keylen);
+            else
+                m_connections[conn_id]->send_touch_command(&timestamp, key, keylen, obj->get_expiry());
+            break;
+        }
+        case mc_incr:
+        case mc_decr: {
+            // counters live next to the data keys, whose values are not numeric
+            unsigned int keylen;
+            const char *key = m_obj_gen->get_key(obj_iter_type(m_config, 0), &keylen);
+            int len = snprintf(m_mix_key, sizeof(m_mix_key), "%.*s:counter", keylen, key);
+            if (len >= (int) sizeof(m_mix_key))
+                len = sizeof(m_mix_key) - 1;
+
+            m_connections[conn_id]->send_incr_command(&timestamp, m_mix_key, len, 1, cmd == mc_decr);
+            break;
+        }
+        case mc_hset:
+        case mc_lpush:
+        case mc_zadd: {
+            // every hash and sorted set holds up to ds_fields elements named
+            // after their index, zset members scored by that index.  Lists
+            // are trimmed back to ds_fields elements every LIST_TRIM_PUSHES
+            // pushes, at the list just pushed to
+            unsigned int keylen;
+            const char *key = ds_key(cmd, obj_iter_type(m_config, 0), &keylen);
+            unsigned int index = m_obj_gen->random_range(0, m_config->ds_fields - 1);
+            char field[32];
+            int field_len = snprintf(field, sizeof(field), "field-%u", index);
+
+            if (cmd == mc_hset)
+                m_connections[conn_id]->send_hset_command(&timestamp, key, keylen, field, field_len,
+                                                          m_ds_value, m_config->ds_member_size);
+            else if (cmd == mc_lpush) {
+                m_connections[conn_id]->send_lpush_command(&timestamp, key, keylen,
+                                                           m_ds_value, m_config->ds_member_size);
+                if (++m_untrimmed_pushes >= LIST_TRIM_PUSHES &&
+                    m_connections[conn_id]->send_ltrim_command(&timestamp, key, keylen,
+                                                               0, m_config->ds_fields - 1))
+                    m_untrimmed_pushes = 0;
+            }
+            else
+                m_connections[conn_id]->send_zadd_command(&timestamp, key, keylen, index,
+                                                          field, field_len);
+            break;
+        }
+        case mc_hget:
+        case mc_lrange:
+        case mc_zrangebyscore: {
+            unsigned int keylen;
+            const char *key = ds_key(cmd, obj_iter_type(m_config, 2), &keylen);
+            unsigned int index = m_obj_gen->random_range(0, m_config->ds_fields - 1);
+
+            if (cmd == mc_hget) {
+                char field[32];
+                int field_len = snprintf(field, sizeof(field), "field-%u", index);
+                m_connections[conn_id]->send_hget_command(&timestamp, key, keylen, field, field_len);
+            } else if (cmd == mc_lrange) {
+                m_connections[conn_id]->send_lrange_command(&timestamp, key, keylen, 0, m_config->ds_range - 1);
+            } else {
+                m_connections[conn_id]->send_zrangebyscore_command(&timestamp, key, keylen,
+                                                                   index, index + m_config->ds_range - 1);
+            }
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+
+    m_reqs_generated++;
+}
+
+// Starts count nonblocking connects at once.  On failure none of the
+// sockets is left open.
+static int start_connects(benchmark_config *config, struct connect_info *addr, int count,
+                          std::vector<int>& sockfds)
+{
+    struct sockaddr_un unix_addr;
+    int ret = 0;
+
+    if (config->unix_socket) {
+        memset(&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        strncpy(unix_addr.sun_path, config->unix_socket, sizeof(unix_addr.sun_path)-1);
+    }
+
+    for (int i = 0; i < count && ret == 0; i++) {
+        int fd = config->unix_socket ?
+            socket(AF_UNIX, SOCK_STREAM, 0) :
+            socket(addr->ci_family, addr->ci_socktype, addr->ci_protocol);
+        if (fd < 0) {
+            ret = -1;
+            break;
+        }
+        sockfds.push_back(fd);
+
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+            (::connect(fd,
+                       config->unix_socket ? (struct sockaddr *) &unix_addr : addr->ci_addr,
+                       config->unix_socket ? sizeof(unix_addr) : addr->ci_addrlen) == -1 &&
+             errno != EINPROGRESS)) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret < 0) {
+        int saved_errno = errno;
+        for (unsigned int i = 0; i < sockfds.size(); i++)
+            close(sockfds[i]);
+        sockfds.clear();
+        errno = saved_errno;
+    }
+
+    return ret;
+}
+
+// Opens count nonblocking connections at once and waits until the server
+// has queued all of them for accept.  Their order doesn't matter to the
+// server's round-robin dispatch, only that all of them come before the
+// next connection.  On failure none of them is left open.
+static int connect_sockets(benchmark_config *config, struct connect_info *addr, int count,
+                           std::vector<int>& sockfds)
+{
+    if (start_connects(config, addr, count, sockfds) < 0)
+        return -1;
+
+    std::vector<struct pollfd> pfds(count);
+    int ret = 0;
+
+    for (int i = 0; i < count; i++) {
+        pfds[i].fd = sockfds[i];
+        pfds[i].events = POLLOUT;
+        pfds[i].revents = 0;
+    }
+
+    // wait for every handshake, the socket leaves the poll set once done
+    int pending = count;
+    while (pending > 0) {
+        int n = ::poll(&pfds[0], count, CONNECT_TIMEOUT_SEC * 1000);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            ret = -1;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (pfds[i].fd < 0 || !pfds[i].revents)
+                continue;
+
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                ret = -1;
+                pending = 0;
+                break;
+            }
+            pfds[i].fd = -1;
+            pending--;
+        }
+    }
+
+    if (ret < 0) {
+        int saved_errno = errno;
+        for (unsigned int i = 0; i < sockfds.size(); i++)
+            close(sockfds[i]);
+        sockfds.clear();
+        errno = saved_errno;
+    }
+
+    return ret;
+}
+
+// Connections opened and closed again, only to advance the server's
+// dispatch to the thread the next real connection should land on.
+static int open_placement_fillers(benchmark_config *config, struct connect_info *addr, int count)
+{
+    std::vector<int> sockfds;
+
+    if (connect_sockets(config, addr, count, sockfds) < 0) {
+        benchmark_error_log("prepare: failed to open placement connections: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < sockfds.size(); i++)
+        close(sockfds[i]);
+
+    return 0;
+}
+
+// The server hands connections to its threads round-robin, in accept order,
+// so the thread of every connection follows from how many were accepted
+// before it.  skew_level clients of every batch of server_threads go to
+// thread 0: the connections needed to rotate the dispatch back to thread 0
+// are computed up front and opened together, and only the handshakes are
+// waited for, without requests.  The further connections of a pooled client
+// follow its first one to the same thread, unless they are spread, in which
+// case each of them is placed like a client of its own.
 int client::prepare(void)
 {
     if (MAIN_CONNECTION == NULL)
         return -1;
 
-    int ret;
-    shard_connection* sc = MAIN_CONNECTION;
-
     // Serialize thread creation
     pthread_mutex_lock(&client::m_skew_mutex);
-    // If we have not achieved the skew level
-    // Then try to pile up thread "0"
-    if (client::skew_count < m_config->skew_level) {
-        while (client::total_conns % m_config->server_threads != 0) {
-            ret = this->connect();
-            if (ret < 0) {
-                continue; // don't count failed creation
-            }
+    for (unsigned int i = 0; i < m_connections.size(); i++) {
+        shard_connection* sc = m_connections[i];
+        bool placed_alone = i == 0 || m_config->spread_conns;
+        int fillers = 0;
+
+        if (!placed_alone) {
+            fillers = (serverTid - client::total_conns % m_config->server_threads + m_config->server_threads) %
+                m_config->server_threads;
+        } else if (client::skew_count < m_config->skew_level) {
+            // If we have not achieved the skew level
+            // Then try to pile up thread "0"
+            fillers = (m_config->server_threads - client::total_conns % m_config->server_threads) %
+                m_config->server_threads;
+            client::skew_count++;
+        }
 
-            // Make sure that we have been dispatched to a thread
-            sc->gurantee_sockfd_dispatch();
+        if (open_fillers(fillers) < 0) {
+            pthread_mutex_unlock(&client::m_skew_mutex);
+            return -1;
+        }
 
-            // disconnect because we don't want this connection
-            this->disconnect();
-            client::total_conns++;
+        // The real connection; its handshake is only waited for when the next
+        // connection's server thread depends on it, otherwise it completes in
+        // the event loop like any other nonblocking connect
+        int ret = connect_conn(sc);
+        if (ret < 0 || (m_config->server_threads > 1 && sc->wait_established() < 0)) {
+            benchmark_error_log("prepare: failed to connect, test aborted.\n");
+            pthread_mutex_unlock(&client::m_skew_mutex);
+            return -1;
         }
 
-        client::skew_count++;
+        sc->serverTid = client::total_conns % m_config->server_threads;
+        if (i == 0)
+            this->serverTid = sc->serverTid;
+//        fprintf(stderr, "Total connections: %d, server thread: %d, real conns %d\n",
+//                client::total_conns, sc->serverTid, client::real_conns);
+
+        client::real_conns++;
+        client::total_conns++;
+        if (placed_alone && ++client::skew_batch == m_config->server_threads) {
+            // Reset the skewed counter for the next batch
+            client::skew_batch = 0;
+            client::skew_count = 0;
+        }
     }
+    pthread_mutex_unlock(&client::m_skew_mutex);
 
-    ret = this->connect(); // The real connection
-    if (ret < 0) {
-        benchmark_error_log("prepare: failed to connect, test aborted.\n");
+    for (unsigned int i = 0; i < m_connections.size(); i++)
+        init_schedule(m_connections[i]);
+    return 0;
+}
+
+// Rotates the server's dispatch by count connections; m_skew_mutex is held
+int client::open_fillers(int count)
+{
+    if (count == 0)
+        return 0;
+
+    struct connect_info addr;
+    if (m_config->server_addr->get_connect_info(&addr) != 0) {
+        benchmark_error_log("prepare: resolve error: %s\n", m_config->server_addr->get_last_error());
+        return -1;
+    }
+    if (open_placement_fillers(m_config, &addr, count) < 0)
+        return -1;
+
+    client::total_conns += count;
+    client::filler_conns += count;
+    return 0;
+}
+
+// The fillers of a migration still waiting for their handshakes.
+struct migration_placement {
+    client* m_client;
+    unsigned int m_conn_id;
+    int m_pending;
+    bool m_failed;
+};
+
+// A migration filler is closed from the event loop once its handshake is
+// done, when the server has queued it for accept, or once it timed out.
+// The last one to finish starts the reconnect.
+static void migration_filler_done(evutil_socket_t fd, short evtype, void *arg)
+{
+    migration_placement* mp = (migration_placement*) arg;
+    int error = 0;
+    socklen_t len = sizeof(error);
+
+    if (evtype == EV_TIMEOUT ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+        mp->m_failed = true;
+    close(fd);
+
+    if (--mp->m_pending > 0)
+        return;
+
+    mp->m_client->reconnect_migrated(mp->m_conn_id, !mp->m_failed);
+    delete mp;
+}
+
+// Moves a connection to server thread tid during the run: the connection is
+// closed and reconnected behind the fillers that rotate the dispatch to tid,
+// the way prepare() places it.  Nothing is waited for here; the fillers
+// finish in the event loop, and the reconnect is only started once all of
+// them were queued by the server, so that it takes the slot after them.
+// A move owns the dispatch until its reconnect is established, and the
+// next one waits for it: returns 1 while another move owns it, 0 once the
+// move started.  Its outcome goes to the connection, which calls
+// end_migration() when done.
+int client::migrate_conn(unsigned int conn_id, int tid)
+{
+    shard_connection* sc = m_connections[conn_id];
+    struct connect_info addr;
+    std::vector<int> fillers;
+
+    pthread_mutex_lock(&client::m_skew_mutex);
+    if (client::migration_placing) {
         pthread_mutex_unlock(&client::m_skew_mutex);
-        return ret;
+        return 1;
+    }
+    client::migration_placing = true;
+    int count = (tid - client::total_conns % m_config->server_threads + m_config->server_threads) %
+        m_config->server_threads;
+    client::total_conns += count + 1;
+    client::filler_conns += count;
+    pthread_mutex_unlock(&client::m_skew_mutex);
+
+    sc->disconnect();
+    if (m_config->server_addr->get_connect_info(&addr) != 0) {
+        benchmark_error_log("migrate: resolve error: %s\n", m_config->server_addr->get_last_error());
+        sc->migration_placed(false);
+        return 0;
+    }
+    if (start_connects(m_config, &addr, count, fillers) < 0) {
+        benchmark_error_log("migrate: failed to open placement connections: %s\n", strerror(errno));
+        sc->migration_placed(false);
+        return 0;
+    }
+    if (count == 0) {
+        reconnect_migrated(conn_id, true);
+        return 0;
+    }
+
+    migration_placement* mp = new migration_placement;
+    mp->m_client = this;
+    mp->m_conn_id = conn_id;
+    mp->m_pending = count;
+    mp->m_failed = false;
+
+    struct timeval timeout = { CONNECT_TIMEOUT_SEC, 0 };
+    for (int i = 0; i < count; i++) {
+        if (event_base_once(m_event_base, fillers[i], EV_WRITE, migration_filler_done, mp, &timeout) < 0) {
+            close(fillers[i]);
+            mp->m_failed = true;
+            mp->m_pending--;
+        }
     }
-    // XXX: Must make sure that we have been dispatched to a thread
-    sc->gurantee_sockfd_dispatch();
 
-    sc->serverTid = client::total_conns % m_config->server_threads;
-    this->serverTid = sc->serverTid;
+    // none of them got to the event loop
+    if (mp->m_pending == 0) {
+        delete mp;
+        sc->migration_placed(false);
+    }
+
+    return 0;
+}
+
+// Starts the reconnect of a migrating connection once its fillers went
+// through; if any of them failed, the thread it would land on is unknown.
+void client::reconnect_migrated(unsigned int conn_id, bool placed)
+{
+    shard_connection* sc = m_connections[conn_id];
+
+    if (!placed)
+        benchmark_error_log("migrate: placement connection failed.\n");
+    else if (connect_conn(sc) < 0)
+        placed = false;
+
+    sc->migration_placed(placed);
+}
+
+// Records where a moved connection landed and hands the dispatch on to the
+// next move.
+void client::end_migration(unsigned int conn_id, int tid, bool moved)
+{
+    if (moved) {
+        m_connections[conn_id]->serverTid = tid;
+        if (conn_id == 0)
+            this->serverTid = tid;
+    }
+
+    pthread_mutex_lock(&client::m_skew_mutex);
+    client::migration_placing = false;
+    pthread_mutex_unlock(&client::m_skew_mutex);
+}
+
+// Set distribution param (connection QPS) based on the server thread id
+void client::init_schedule(shard_connection* sc)
+{
+    uint64_t seed = prng_seed_child(prng_seed_child(m_seed, SEED_BRANCH_ARRIVALS), sc->get_id());
 
-    // Set distribution param (client QPS) based on the server thread id
     switch (m_config->distType) {
         case NONE:
             sc->intervalGenerator = new Generator();
             break;
         case POISSON:
-            sc->intervalGenerator = new Poisson(qpsPerClient[serverTid]);
+            sc->intervalGenerator = new Poisson(qpsPerClient[sc->serverTid], seed);
             break;
         case UNIFORM:
-            sc->intervalGenerator = new Uniform(qpsPerClient[serverTid]);
-    }
-//    fprintf(stderr, "Total connections: %d, server thread: %d, real conns %d\n",
-//            client::total_conns, sc->serverTid, client::real_conns);
-
-    client::real_conns++;
-    client::total_conns++;
-    if (client::real_conns % m_config->server_threads == 0) {
-        // Reset the skewed counter for the next batch
-        client::skew_count = 0;
+            sc->intervalGenerator = new Uniform(qpsPerClient[sc->serverTid], seed);
     }
-    pthread_mutex_unlock(&client::m_skew_mutex);
 
     sc->nextCycleTime =
         Cycles::rdtsc() +
         Cycles::fromSeconds(sc->intervalGenerator->generate());
-    return 0;
+}
+
+// The request due on conn_id goes out on the connection of the client with
+// the fewest requests outstanding, or on the next one in turn.  Only
+// connections with room qualify; conn_id always has room when it asks.
+unsigned int client::dispatch_conn(unsigned int conn_id)
+{
+    unsigned int count = m_connections.size();
+    if (count == 1)
+        return conn_id;
+
+    if (m_config->conn_dispatch == dispatch_round_robin) {
+        for (unsigned int i = 0; i < count; i++) {
+            unsigned int id = (m_next_conn + i) % count;
+            if (id == conn_id || m_connections[id]->request_slot_available()) {
+                m_next_conn = (id + 1) % count;
+                return id;
+            }
+        }
+        return conn_id;
+    }
+
+    unsigned int best = conn_id;
+    for (unsigned int id = 0; id < count; id++) {
+        if (id != conn_id &&
+            m_connections[id]->get_outstanding() < m_connections[best]->get_outstanding() &&
+            m_connections[id]->request_slot_available())
+            best = id;
+    }
+    return best;
+}
+
+static mix_command request_mix_command(request_type type)
+{
+    switch (type) {
+        case rt_delete: return mc_delete;
+        case rt_incr:   return mc_incr;
+        case rt_decr:   return mc_decr;
+        case rt_append: return mc_append;
+        case rt_touch:  return mc_touch;
+        case rt_cas:    return mc_cas;
+        case rt_gets:   return mc_gets;
+        case rt_hset:   return mc_hset;
+        case rt_hget:   return mc_hget;
+        case rt_lpush:  return mc_lpush;
+        case rt_lrange: return mc_lrange;
+        case rt_zadd:   return mc_zadd;
+        case rt_zrangebyscore: return mc_zrangebyscore;
+        default:
+            assert(0);
+            return mc_count;
+    }
 }
 
 void client::handle_response(struct timeval timestamp, request *request, protocol_response *response)
@@ -446,12 +998,62 @@ void client::handle_response(struct timeval timestamp, request *request, protoco
             m_stats.update_wait_op(&timestamp,
                 ts_diff(request->m_sent_time, timestamp));
             break;
+        case rt_fence:
+            m_stats.update_set_batch(&timestamp, request->m_keys,
+                request->m_size + response->get_total_len(),
+                ts_diff(request->m_sent_time, timestamp));
+            break;
+        case rt_udp_get:
+            m_stats.update_udp_get_op(&timestamp,
+                request->m_size + response->get_total_len(),
+                ts_diff(request->m_sent_time, timestamp),
+                response->get_hits(),
+                request->m_keys - response->get_hits());
+            break;
+        case rt_gets:
+            if (response->get_hits() > 0) {
+                verify_request *vr = static_cast<verify_request *>(request);
+                if (vr->m_key_len <= sizeof(m_cas_key)) {
+                    memcpy(m_cas_key, vr->m_key, vr->m_key_len);
+                    m_cas_key_len = vr->m_key_len;
+                    m_cas_unique = response->get_cas();
+                }
+            }
+            // fall through
+        case rt_delete:
+        case rt_incr:
+        case rt_decr:
+        case rt_append:
+        case rt_touch:
+        case rt_cas:
+        case rt_hset:
+        case rt_hget:
+        case rt_lpush:
+        case rt_lrange:
+        case rt_zadd:
+        case rt_zrangebyscore:
+            m_stats.update_cmd_op(&timestamp, request_mix_command(request->m_type),
+                request->m_size + response->get_total_len(),
+                ts_diff(request->m_sent_time, timestamp),
+                response->get_hits(),
+                request->m_keys - response->get_hits());
+            break;
         default:
             assert(0);
             break;
     }
 }
 
+void client::handle_udp_loss(struct timeval timestamp, request *request)
+{
+    m_stats.update_udp_loss(&timestamp);
+}
+
+void client::handle_udp_send_failure(struct timeval timestamp, request *request)
+{
+    m_stats.update_udp_send_failure(&timestamp);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 
 verify_client::verify_client(struct event_base *event_base,
@@ -461,6 +1063,11 @@ verify_client::verify_client(struct event_base *event_base,
     m_finished(false), m_verified_keys(0), m_errors(0)
 {
     MAIN_CONNECTION->get_protocol()->set_keep_value(true);
+
+    // only a walk in file order meets every item a full run has SET
+    import_object_generator *import_gen = dynamic_cast<import_object_generator *>(m_obj_gen);
+    if (import_gen != NULL)
+        import_gen->set_file_order(true);
 }
 
 unsigned long long int verify_client::get_verified_keys(void)
@@ -597,6 +1204,8 @@ int client_group::create_clients(int num)
 
         if (m_config->cluster_mode)
             c = new cluster_client(this);
+        else if (m_config->servers.is_defined())
+            c = new ketama_client(this);
         else
             c = new client(this);
 
@@ -613,22 +1222,19 @@ int client_group::create_clients(int num)
     return num;
 }
 
+// Runs on the group's own thread, concurrently with the other groups; only
+// the server thread placement of client::prepare() is serialized.
 int client_group::prepare(void)
 {
-    // Add a mutex here so that we can make sure server threads are spread
-    // across all client threads.
-    pthread_mutex_lock(&client_group::m_conn_mutex);
     for (std::vector<client*>::iterator i = m_clients.begin(); i != m_clients.end(); i++) {
         client* c = *i;
         int ret = c->prepare();
 
         if (ret < 0) {
             fprintf(stderr, "Fail to prepare client!\n");
-            pthread_mutex_unlock(&client_group::m_conn_mutex);
             return ret;
         }
     }
-    pthread_mutex_unlock(&client_group::m_conn_mutex);
     return 0;
 }
 
@@ -695,6 +1301,25 @@ void client_group::merge_run_stats(run_stats* target)
     }
 }
 
+// Sums the responses and their latency by connection index, which for a
+// ketama client is the index of the server
+void client_group::merge_conn_stats(std::vector<unsigned long>& responses,
+                                    std::vector<unsigned long long>& latency)
+{
+    for (std::vector<client*>::iterator i = m_clients.begin(); i != m_clients.end(); i++) {
+        const std::vector<shard_connection*>& conns = (*i)->get_connections();
+
+        if (responses.size() < conns.size()) {
+            responses.resize(conns.size(), 0);
+            latency.resize(conns.size(), 0);
+        }
+        for (unsigned int j = 0; j < conns.size(); j++) {
+            responses[j] += conns[j]->get_responses();
+            latency[j] += conns[j]->get_response_latency();
+        }
+    }
+}
+
 void client_group::write_client_stats(const char *prefix)
 {
     unsigned int client_id = 0;
@@ -708,6 +1333,518 @@ void client_group::write_client_stats(const char *prefix)
         }
     }        
 }
+
+///////////////////////////////////////////////////////////////////////////
+
+#define IDLE_TICK_USEC  10000
+
+idle_connections::idle_connections(benchmark_config* config) :
+    m_config(config), m_base(NULL), m_tick_event(NULL), m_stop(false),
+    m_commands(NULL), m_setup_len(0), m_commands_len(0),
+    m_next(0), m_keepalive_credit(0), m_keepalives(0), m_dropped(0)
+{
+    struct event_config *ev_config;
+    ev_config = event_config_new();
+    event_config_set_flag(ev_config, EVENT_BASE_FLAG_NOLOCK);
+    m_base = event_base_new_with_config(ev_config);
+    event_config_free(ev_config);
+    assert(m_base != NULL);
+}
+
+idle_connections::~idle_connections()
+{
+    for (unsigned int i = 0; i < m_conns.size(); i++) {
+        if (m_conns[i].fd != -1)
+            close_conn(m_conns[i]);
+    }
+    m_conns.clear();
+
+    if (m_tick_event != NULL)
+        event_free(m_tick_event);
+    if (m_commands != NULL)
+        free(m_commands);
+    if (m_base != NULL)
+        event_base_free(m_base);
+}
+
+void idle_connections::close_conn(idle_conn& conn)
+{
+    event_free(conn.read_event);
+    conn.read_event = NULL;
+    close(conn.fd);
+    conn.fd = -1;
+}
+
+// Opens count connections in one batch.  Keep count a multiple of the
+// server threads, then every thread gets the same share and the placement
+// of the clients connecting afterwards is unchanged.
+int idle_connections::open(int count)
+{
+    struct connect_info addr;
+    if (!m_config->unix_socket && m_config->server_addr->get_connect_info(&addr) != 0) {
+        benchmark_error_log("idle connections: resolve error: %s\n", m_config->server_addr->get_last_error());
+        return -1;
+    }
+
+    // the commands are the same for every connection, so render them once
+    abstract_protocol* protocol = protocol_factory(m_config->protocol);
+    struct evbuffer* buf = evbuffer_new();
+    char key[256];
+
+    assert(protocol != NULL && buf != NULL);
+    protocol->set_buffers(NULL, buf);
+    if (m_config->authenticate)
+        protocol->authenticate(m_config->authenticate);
+    if (m_config->select_db)
+        protocol->select_db(m_config->select_db);
+    m_setup_len = evbuffer_get_length(buf);
+
+    int key_len = snprintf(key, sizeof(key), "%sidle", m_config->key_prefix);
+    protocol->write_command_get(key, key_len, 0);
+    m_commands_len = evbuffer_get_length(buf);
+    m_commands = (char *) malloc(m_commands_len);
+    assert(m_commands != NULL);
+    evbuffer_remove(buf, m_commands, m_commands_len);
+    evbuffer_free(buf);
+    delete protocol;
+
+    std::vector<int> sockfds;
+    if (connect_sockets(m_config, &addr, count, sockfds) < 0) {
+        benchmark_error_log("idle connections: failed to connect: %s\n", strerror(errno));
+        return -1;
+    }
+
+    m_conns.resize(sockfds.size());
+    for (unsigned int i = 0; i < sockfds.size(); i++) {
+        idle_conn& conn = m_conns[i];
+
+        conn.fd = sockfds[i];
+        conn.owner = this;
+        conn.read_event = event_new(m_base, conn.fd, EV_READ|EV_PERSIST, read_handler, (void *)&conn);
+        assert(conn.read_event != NULL);
+        event_add(conn.read_event, NULL);
+
+        if (m_setup_len > 0 &&
+            send(conn.fd, m_commands, m_setup_len, MSG_NOSIGNAL) != (ssize_t) m_setup_len) {
+            benchmark_error_log("idle connections: failed to send setup commands: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Replies are read only to keep the socket buffers empty, and thrown away
+void idle_connections::read_handler(evutil_socket_t fd, short evtype, void *arg)
+{
+    idle_conn* conn = (idle_conn*) arg;
+    char buf[4096];
+    ssize_t ret;
+
+    while ((ret = recv(fd, buf, sizeof(buf), 0)) > 0)
+        ;
+
+    if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        conn->owner->close_conn(*conn);
+        conn->owner->m_dropped++;
+    }
+}
+
+// Keepalives are spread over the connections round-robin, a few on every
+// tick, instead of giving each connection a timer of its own
+void idle_connections::tick_handler(evutil_socket_t fd, short evtype, void *arg)
+{
+    idle_connections* ic = (idle_connections*) arg;
+
+    if (ic->m_stop) {
+        event_base_loopbreak(ic->m_base);
+        return;
+    }
+
+    ic->m_keepalive_credit += ic->m_config->idle_rate * ic->get_open_conns() * IDLE_TICK_USEC / 1000000.0;
+    unsigned int keepalive_len = ic->m_commands_len - ic->m_setup_len;
+    unsigned int tries = ic->m_conns.size();
+
+    while (ic->m_keepalive_credit >= 1 && tries-- > 0) {
+        idle_conn& conn = ic->m_conns[ic->m_next];
+        ic->m_next = (ic->m_next + 1) % ic->m_conns.size();
+        if (conn.fd == -1)
+            continue;
+
+        // a GET this small only fails to go out whole if the server stopped reading
+        if (send(conn.fd, ic->m_commands + ic->m_setup_len, keepalive_len,
+                 MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t) keepalive_len) {
+            ic->close_conn(conn);
+            ic->m_dropped++;
+            continue;
+        }
+
+        ic->m_keepalives++;
+        ic->m_keepalive_credit -= 1;
+    }
+}
+
+void* idle_connections::thread_main(void *arg)
+{
+    idle_connections* ic = (idle_connections*) arg;
+
+    event_base_dispatch(ic->m_base);
+    return NULL;
+}
+
+int idle_connections::start(void)
+{
+    struct timeval tick = { 0, IDLE_TICK_USEC };
+
+    m_tick_event = event_new(m_base, -1, EV_PERSIST, tick_handler, (void *)this);
+    assert(m_tick_event != NULL);
+    event_add(m_tick_event, &tick);
+
+    return pthread_create(&m_thread, NULL, thread_main, (void *)this);
+}
+
+void idle_connections::stop(void)
+{
+    m_stop = true;
+    pthread_join(m_thread, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+void histogram_print(FILE * out, json_handler * jsonhandler, const char * type, float msec, float percent);
+
+churn_connections::churn_connections(benchmark_config* config) :
+    m_config(config), m_base(NULL), m_tick_event(NULL), m_stop(false),
+    m_protocol(NULL), m_commands(NULL), m_setup_len(0), m_setup_cmds(0), m_commands_len(0),
+    m_open_credit(0), m_opened(0), m_completed(0), m_failed(0), m_skipped(0),
+    m_total_connect_latency(0), m_total_setup_latency(0), m_total_first_latency(0)
+{
+    struct event_config *ev_config;
+    ev_config = event_config_new();
+    event_config_set_flag(ev_config, EVENT_BASE_FLAG_NOLOCK);
+    m_base = event_base_new_with_config(ev_config);
+    event_config_free(ev_config);
+    assert(m_base != NULL);
+
+    memset(&m_addr, 0, sizeof(m_addr));
+    memset(&m_unix_addr, 0, sizeof(m_unix_addr));
+}
+
+churn_connections::~churn_connections()
+{
+    // the ones still open when the test ended count neither way
+    for (unsigned int i = 0; i < m_conns.size(); i++) {
+        if (m_conns[i].fd != -1) {
+            event_free(m_conns[i].event);
+            close(m_conns[i].fd);
+            delete m_conns[i].protocol;
+        }
+        evbuffer_free(m_conns[i].read_buf);
+    }
+    m_conns.clear();
+
+    if (m_tick_event != NULL)
+        event_free(m_tick_event);
+    if (m_protocol != NULL)
+        delete m_protocol;
+    if (m_commands != NULL)
+        free(m_commands);
+    if (m_base != NULL)
+        event_base_free(m_base);
+}
+
+void churn_connections::open_conn(void)
+{
+    churn_conn& conn = m_conns[m_free.back()];
+    int fd = m_config->unix_socket ?
+        socket(AF_UNIX, SOCK_STREAM, 0) :
+        socket(m_addr.ci_family, m_addr.ci_socktype, m_addr.ci_protocol);
+
+    m_opened++;
+    if (fd < 0) {
+        m_failed++;
+        return;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    gettimeofday(&conn.step_start, NULL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+        (::connect(fd,
+                   m_config->unix_socket ? (struct sockaddr *) &m_unix_addr : m_addr.ci_addr,
+                   m_config->unix_socket ? sizeof(m_unix_addr) : m_addr.ci_addrlen) == -1 &&
+         errno != EINPROGRESS)) {
+        close(fd);
+        m_failed++;
+        return;
+    }
+
+    m_free.pop_back();
+    conn.fd = fd;
+    conn.state = churn_connecting;
+    conn.protocol = m_protocol->clone();
+    conn.protocol->set_buffers(conn.read_buf, NULL);
+    conn.event = event_new(m_base, fd, EV_WRITE, event_handler, (void *)&conn);
+    assert(conn.event != NULL);
+    event_add(conn.event, NULL);
+}
+
+void churn_connections::close_conn(churn_conn& conn, bool failed)
+{
+    event_free(conn.event);
+    conn.event = NULL;
+    close(conn.fd);
+    conn.fd = -1;
+    evbuffer_drain(conn.read_buf, evbuffer_get_length(conn.read_buf));
+    delete conn.protocol;
+    conn.protocol = NULL;
+
+    m_free.push_back(&conn - &m_conns[0]);
+    if (failed)
+        m_failed++;
+    else
+        m_completed++;
+}
+
+// The commands are a few bytes on a fresh socket, they go out whole or the
+// connection failed
+bool churn_connections::send_commands(churn_conn& conn, unsigned int offset, unsigned int len)
+{
+    if (send(conn.fd, m_commands + offset, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t) len) {
+        close_conn(conn, true);
+        return false;
+    }
+
+    return true;
+}
+
+void churn_connections::end_step(churn_conn& conn, latency_map& map, unsigned long long int& total,
+                                 struct timeval& now)
+{
+    unsigned long long int latency =
+        (now.tv_sec - conn.step_start.tv_sec) * 1000000ULL + now.tv_usec - conn.step_start.tv_usec;
+
+    map[get_2_meaningful_digits((float)latency/1000)]++;
+    total += latency;
+    conn.step_start = now;
+}
+
+void churn_connections::event_handler(evutil_socket_t fd, short evtype, void *arg)
+{
+    churn_conn* conn = (churn_conn*) arg;
+    churn_connections* cc = conn->owner;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    if (conn->state == churn_connecting) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+            cc->close_conn(*conn, true);
+            return;
+        }
+        cc->end_step(*conn, cc->m_connect_latency_map, cc->m_total_connect_latency, now);
+
+        event_free(conn->event);
+        conn->event = event_new(cc->m_base, fd, EV_READ|EV_PERSIST, event_handler, (void *)conn);
+        assert(conn->event != NULL);
+        event_add(conn->event, NULL);
+
+        if (cc->m_setup_cmds > 0) {
+            conn->state = churn_setup;
+            conn->setup_replies = cc->m_setup_cmds;
+            cc->send_commands(*conn, 0, cc->m_setup_len);
+        } else {
+            conn->state = churn_first_request;
+            cc->send_commands(*conn, cc->m_setup_len, cc->m_commands_len - cc->m_setup_len);
+        }
+        return;
+    }
+
+    int ret = 1;
+    while (ret > 0)
+        ret = evbuffer_read(conn->read_buf, fd, -1);
+    if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        cc->close_conn(*conn, true);
+        return;
+    }
+
+    while ((ret = conn->protocol->parse_response()) > 0) {
+        if (conn->state == churn_setup) {
+            if (--conn->setup_replies > 0)
+                continue;
+            cc->end_step(*conn, cc->m_setup_latency_map, cc->m_total_setup_latency, now);
+            conn->state = churn_first_request;
+            if (!cc->send_commands(*conn, cc->m_setup_len, cc->m_commands_len - cc->m_setup_len))
+                return;
+        } else {
+            cc->end_step(*conn, cc->m_first_latency_map, cc->m_total_first_latency, now);
+            cc->close_conn(*conn, false);
+            return;
+        }
+    }
+
+    if (ret < 0)
+        cc->close_conn(*conn, true);
+}
+
+// New connections are opened a few on every tick, as many as the rate owes
+void churn_connections::tick_handler(evutil_socket_t fd, short evtype, void *arg)
+{
+    churn_connections* cc = (churn_connections*) arg;
+
+    if (cc->m_stop) {
+        event_base_loopbreak(cc->m_base);
+        return;
+    }
+
+    cc->m_open_credit += cc->m_config->churn_rate * IDLE_TICK_USEC / 1000000.0;
+    while (cc->m_open_credit >= 1) {
+        cc->m_open_credit -= 1;
+        if (cc->m_free.empty())
+            cc->m_skipped++;
+        else
+            cc->open_conn();
+    }
+}
+
+void* churn_connections::thread_main(void *arg)
+{
+    churn_connections* cc = (churn_connections*) arg;
+
+    event_base_dispatch(cc->m_base);
+    return NULL;
+}
+
+int churn_connections::start(void)
+{
+    if (m_config->unix_socket) {
+        m_unix_addr.sun_family = AF_UNIX;
+        strncpy(m_unix_addr.sun_path, m_config->unix_socket, sizeof(m_unix_addr.sun_path)-1);
+    } else if (m_config->server_addr->get_connect_info(&m_addr) != 0) {
+        benchmark_error_log("churn connections: resolve error: %s\n", m_config->server_addr->get_last_error());
+        return -1;
+    }
+
+    // the commands are the same for every connection, so render them once
+    struct evbuffer* buf = evbuffer_new();
+    char key[256];
+
+    m_protocol = protocol_factory(m_config->protocol);
+    assert(m_protocol != NULL && buf != NULL);
+    m_protocol->set_buffers(NULL, buf);
+    if (m_config->authenticate) {
+        m_protocol->authenticate(m_config->authenticate);
+        m_setup_cmds++;
+    }
+    if (m_config->select_db) {
+        m_protocol->select_db(m_config->select_db);
+        m_setup_cmds++;
+    }
+    m_setup_len = evbuffer_get_length(buf);
+
+    int key_len = snprintf(key, sizeof(key), "%schurn", m_config->key_prefix);
+    m_protocol->write_command_get(key, key_len, 0);
+    m_commands_len = evbuffer_get_length(buf);
+    m_commands = (char *) malloc(m_commands_len);
+    assert(m_commands != NULL);
+    evbuffer_remove(buf, m_commands, m_commands_len);
+    evbuffer_free(buf);
+
+    m_conns.resize(m_config->churn_conns);
+    for (unsigned int i = 0; i < m_conns.size(); i++) {
+        m_conns[i].fd = -1;
+        m_conns[i].event = NULL;
+        m_conns[i].protocol = NULL;
+        m_conns[i].owner = this;
+        m_conns[i].read_buf = evbuffer_new();
+        assert(m_conns[i].read_buf != NULL);
+        m_free.push_back(m_conns.size() - 1 - i);
+    }
+
+    struct timeval tick = { 0, IDLE_TICK_USEC };
+    m_tick_event = event_new(m_base, -1, EV_PERSIST, tick_handler, (void *)this);
+    assert(m_tick_event != NULL);
+    event_add(m_tick_event, &tick);
+
+    return pthread_create(&m_thread, NULL, thread_main, (void *)this);
+}
+
+void churn_connections::stop(void)
+{
+    m_stop = true;
+    pthread_join(m_thread, NULL);
+}
+
+void churn_connections::print(FILE *out, bool histogram, const char *header, json_handler *jsonhandler)
+{
+    struct {
+        const char *type;
+        const char *json;
+        latency_map* map;
+        unsigned long long int total;
+    } steps[] = {
+        { "CONNECT", "Connect", &m_connect_latency_map, m_total_connect_latency },
+        { "SETUP", "Setup", &m_setup_latency_map, m_total_setup_latency },
+        { "FIRST", "First Request", &m_first_latency_map, m_total_first_latency },
+    };
+    unsigned long int counts[sizeof(steps) / sizeof(steps[0])];
+
+    fprintf(out,
+            "\n\n"
+            "%s\n"
+            "========================================================================\n"
+            "%lu opened, %lu completed, %lu failed, %lu not opened at the churn-conns limit\n",
+            header, m_opened, m_completed, m_failed, m_skipped);
+    if (jsonhandler != NULL) {
+        jsonhandler->open_nesting(header);
+        jsonhandler->write_obj("Opened","%lu", m_opened);
+        jsonhandler->write_obj("Completed","%lu", m_completed);
+        jsonhandler->write_obj("Failed","%lu", m_failed);
+        jsonhandler->write_obj("Not Opened","%lu", m_skipped);
+    }
+
+    fprintf(out,
+            "\n"
+            "Churn Connection Latency\n"
+            "%-8s %12s %12s\n"
+            "------------------------------------------------------------------------\n",
+            "Step", "Count", "Latency");
+    for (unsigned int i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        counts[i] = 0;
+        for (latency_map_itr_const it = steps[i].map->begin(); it != steps[i].map->end(); it++)
+            counts[i] += it->second;
+        double latency = counts[i] ? (double) steps[i].total / counts[i] / 1000 : 0.0;
+        fprintf(out, "%-8s %12lu %12.5f\n", steps[i].type, counts[i], latency);
+        if (jsonhandler != NULL) {
+            jsonhandler->open_nesting(steps[i].json);
+            jsonhandler->write_obj("Count","%lu", counts[i]);
+            jsonhandler->write_obj("Latency","%.3f", latency);
+            jsonhandler->close_nesting();
+        }
+    }
+
+    if (histogram) {
+        fprintf(out,
+                "\n"
+                "Churn Connection Latency Distribution\n"
+                "%-6s %12s %12s\n"
+                "------------------------------------------------------------------------\n",
+                "Step", "<= msec   ", "Percent");
+        for (unsigned int i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+            unsigned long int total_count = 0;
+            if (i > 0)
+                fprintf(out, "---\n");
+            if (jsonhandler != NULL){ jsonhandler->open_nesting(steps[i].type,NESTED_ARRAY);}
+            for (latency_map_itr_const it = steps[i].map->begin(); it != steps[i].map->end(); it++) {
+                total_count += it->second;
+                histogram_print(out, jsonhandler, steps[i].type, it->first, (double) total_count / counts[i] * 100);
+            }
+            if (jsonhandler != NULL){ jsonhandler->close_nesting();}
+        }
+    }
+
+    if (jsonhandler != NULL){ jsonhandler->close_nesting();}
+}
 ///////////////////////////////////////////////////////////////////////////
 
 run_stats::one_second_stats::one_second_stats(unsigned int second)
@@ -724,6 +1861,17 @@ void run_stats::one_second_stats::reset(unsigned int second)
     m_total_get_latency = 0;
     m_total_set_latency = 0;
     m_total_wait_latency = 0;
+    m_bytes_udp_get = 0;
+    m_ops_udp_get = 0;
+    m_udp_get_hits = m_udp_get_misses = 0;
+    m_udp_losses = 0;
+    m_udp_send_failures = 0;
+    m_total_udp_get_latency = 0;
+    memset(m_bytes_cmd, 0, sizeof(m_bytes_cmd));
+    memset(m_ops_cmd, 0, sizeof(m_ops_cmd));
+    memset(m_cmd_hits, 0, sizeof(m_cmd_hits));
+    memset(m_cmd_misses, 0, sizeof(m_cmd_misses));
+    memset(m_total_cmd_latency, 0, sizeof(m_total_cmd_latency));
 }
 
 void run_stats::one_second_stats::merge(const one_second_stats& other)
@@ -738,6 +1886,20 @@ void run_stats::one_second_stats::merge(const one_second_stats& other)
     m_total_get_latency += other.m_total_get_latency;
     m_total_set_latency += other.m_total_set_latency;
     m_total_wait_latency += other.m_total_wait_latency;
+    m_bytes_udp_get += other.m_bytes_udp_get;
+    m_ops_udp_get += other.m_ops_udp_get;
+    m_udp_get_hits += other.m_udp_get_hits;
+    m_udp_get_misses += other.m_udp_get_misses;
+    m_udp_losses += other.m_udp_losses;
+    m_udp_send_failures += other.m_udp_send_failures;
+    m_total_udp_get_latency += other.m_total_udp_get_latency;
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        m_bytes_cmd[cmd] += other.m_bytes_cmd[cmd];
+        m_ops_cmd[cmd] += other.m_ops_cmd[cmd];
+        m_cmd_hits[cmd] += other.m_cmd_hits[cmd];
+        m_cmd_misses[cmd] += other.m_cmd_misses[cmd];
+        m_total_cmd_latency[cmd] += other.m_total_cmd_latency[cmd];
+    }
 }
 
 run_stats::totals::totals() :
@@ -754,12 +1916,28 @@ run_stats::totals::totals() :
     m_latency_get(0),
     m_latency_wait(0),
     m_latency(0),
+    m_ops_sec_udp_get(0),
+    m_udp_hits_sec(0),
+    m_udp_misses_sec(0),
+    m_bytes_sec_udp_get(0),
+    m_latency_udp_get(0),
+    m_udp_losses_sec(0),
     m_bytes(0),
     m_ops_set(0),
     m_ops_get(0),
     m_ops_wait(0),
-    m_ops(0)
+    m_ops(0),
+    m_ops_udp_get(0),
+    m_udp_losses(0),
+    m_udp_send_failures(0),
+    m_request_allocs(0)
 {
+    memset(m_ops_sec_cmd, 0, sizeof(m_ops_sec_cmd));
+    memset(m_hits_sec_cmd, 0, sizeof(m_hits_sec_cmd));
+    memset(m_misses_sec_cmd, 0, sizeof(m_misses_sec_cmd));
+    memset(m_bytes_sec_cmd, 0, sizeof(m_bytes_sec_cmd));
+    memset(m_latency_cmd, 0, sizeof(m_latency_cmd));
+    memset(m_ops_cmd, 0, sizeof(m_ops_cmd));
 }
     
 void run_stats::totals::add(const run_stats::totals& other)
@@ -777,15 +1955,34 @@ void run_stats::totals::add(const run_stats::totals& other)
     m_latency_get += other.m_latency_get;
     m_latency_wait += other.m_latency_wait;
     m_latency += other.m_latency;
+    m_ops_sec_udp_get += other.m_ops_sec_udp_get;
+    m_udp_hits_sec += other.m_udp_hits_sec;
+    m_udp_misses_sec += other.m_udp_misses_sec;
+    m_bytes_sec_udp_get += other.m_bytes_sec_udp_get;
+    m_latency_udp_get += other.m_latency_udp_get;
+    m_udp_losses_sec += other.m_udp_losses_sec;
     m_bytes += other.m_bytes;
     m_ops_set += other.m_ops_set;
     m_ops_get += other.m_ops_get;
     m_ops_wait += other.m_ops_wait;
     m_ops += other.m_ops;
+    m_ops_udp_get += other.m_ops_udp_get;
+    m_udp_losses += other.m_udp_losses;
+    m_udp_send_failures += other.m_udp_send_failures;
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        m_ops_sec_cmd[cmd] += other.m_ops_sec_cmd[cmd];
+        m_hits_sec_cmd[cmd] += other.m_hits_sec_cmd[cmd];
+        m_misses_sec_cmd[cmd] += other.m_misses_sec_cmd[cmd];
+        m_bytes_sec_cmd[cmd] += other.m_bytes_sec_cmd[cmd];
+        m_latency_cmd[cmd] += other.m_latency_cmd[cmd];
+        m_ops_cmd[cmd] += other.m_ops_cmd[cmd];
+    }
+    m_request_allocs += other.m_request_allocs;
 }
 
 run_stats::run_stats() :
-    m_cur_stats(0)
+    m_cur_stats(0),
+    m_request_allocs(0)
 {
     memset(&m_start_time, 0, sizeof(m_start_time));
     memset(&m_end_time, 0, sizeof(m_end_time));
@@ -813,6 +2010,11 @@ void run_stats::set_end_time(struct timeval* end_time)
     m_stats.push_back(m_cur_stats);
 }
 
+void run_stats::set_request_allocs(unsigned long int allocs)
+{
+    m_request_allocs = allocs;
+}
+
 void run_stats::roll_cur_stats(struct timeval* ts)
 {
     unsigned int sec = ts_diff(m_start_time, *ts) / 1000000;
@@ -872,6 +2074,32 @@ void run_stats::update_set_op(struct timeval* ts, unsigned int bytes, unsigned i
     m_set_latency_map[get_2_meaningful_digits((float)latency/1000)]++;
 }
 
+// --noreply SETs: each of them gets the latency of the fence that completed the batch
+void run_stats::update_set_batch(struct timeval* ts, unsigned int count, unsigned int bytes, unsigned int latency)
+{
+    if (setLatencies != NULL) {
+        uint32_t index = setArrayIndex.fetch_add(count);
+        if (index + count > MAX_ENTRIES) {
+            fprintf(stderr, "Death by setArrayIndex out of bounds: %u \n", index);
+            exit(0);
+        }
+        for (unsigned int i = 0; i < count; i++)
+            setLatencies[index + i] = latency;
+    }
+
+    roll_cur_stats(ts);
+    m_cur_stats.m_bytes_set += bytes;
+    m_cur_stats.m_ops_set += count;
+
+    m_cur_stats.m_total_set_latency += (unsigned long long) latency * count;
+
+    m_totals.m_bytes += bytes;
+    m_totals.m_ops += count;
+    m_totals.m_latency += (unsigned long long) latency * count;
+
+    m_set_latency_map[get_2_meaningful_digits((float)latency/1000)] += count;
+}
+
 void run_stats::update_wait_op(struct timeval *ts, unsigned int latency)
 {
     roll_cur_stats(ts);
@@ -885,6 +2113,53 @@ void run_stats::update_wait_op(struct timeval *ts, unsigned int latency)
     m_wait_latency_map[get_2_meaningful_digits((float)latency/1000)]++;
 }
 
+void run_stats::update_udp_get_op(struct timeval* ts, unsigned int bytes, unsigned int latency, unsigned int hits, unsigned int misses)
+{
+    roll_cur_stats(ts);
+    m_cur_stats.m_bytes_udp_get += bytes;
+    m_cur_stats.m_ops_udp_get++;
+    m_cur_stats.m_udp_get_hits += hits;
+    m_cur_stats.m_udp_get_misses += misses;
+
+    m_cur_stats.m_total_udp_get_latency += latency;
+
+    m_totals.m_bytes += bytes;
+    m_totals.m_ops++;
+    m_totals.m_latency += latency;
+
+    m_udp_get_latency_map[get_2_meaningful_digits((float)latency/1000)]++;
+}
+
+void run_stats::update_udp_loss(struct timeval* ts)
+{
+    roll_cur_stats(ts);
+    m_cur_stats.m_udp_losses++;
+}
+
+void run_stats::update_udp_send_failure(struct timeval* ts)
+{
+    roll_cur_stats(ts);
+    m_cur_stats.m_udp_send_failures++;
+}
+
+void run_stats::update_cmd_op(struct timeval* ts, mix_command cmd, unsigned int bytes, unsigned int latency,
+                              unsigned int hits, unsigned int misses)
+{
+    roll_cur_stats(ts);
+    m_cur_stats.m_bytes_cmd[cmd] += bytes;
+    m_cur_stats.m_ops_cmd[cmd]++;
+    m_cur_stats.m_cmd_hits[cmd] += hits;
+    m_cur_stats.m_cmd_misses[cmd] += misses;
+
+    m_cur_stats.m_total_cmd_latency[cmd] += latency;
+
+    m_totals.m_bytes += bytes;
+    m_totals.m_ops++;
+    m_totals.m_latency += latency;
+
+    m_cmd_latency_map[cmd][get_2_meaningful_digits((float)latency/1000)]++;
+}
+
 unsigned int run_stats::get_duration(void)
 {
     return m_cur_stats.m_second;
@@ -916,6 +2191,30 @@ unsigned long int run_stats::get_total_latency(void)
     return m_totals.m_latency;
 }
 
+// --command-mix report names (summary row, histogram, JSON); SET and GET
+// are reported through the regular Sets/Gets rows
+static const struct {
+    const char *row;
+    const char *histogram;
+    const char *json;
+} mix_stats_labels[mc_count] = {
+    { NULL, NULL, NULL },
+    { NULL, NULL, NULL },
+    { "Dels",   "DELETE", "Deletes" },
+    { "Incrs",  "INCR",   "Incrs" },
+    { "Decrs",  "DECR",   "Decrs" },
+    { "Appnds", "APPEND", "Appends" },
+    { "Touchs", "TOUCH",  "Touches" },
+    { "Cas",    "CAS",    "Cas" },
+    { "CasGet", "GETS",   "CasGets" },
+    { "HSets",  "HSET",   "HSets" },
+    { "HGets",  "HGET",   "HGets" },
+    { "LPushs", "LPUSH",  "LPushes" },
+    { "LRange", "LRANGE", "LRanges" },
+    { "ZAdds",  "ZADD",   "ZAdds" },
+    { "ZRange", "ZRANGEBYSCORE", "ZRangeByScores" },
+};
+
 #define AVERAGE(total, count) \
     ((unsigned int) ((count) > 0 ? (total) / (count) : 0))
 #define USEC_FORMAT(value) \
@@ -929,10 +2228,26 @@ bool run_stats::save_csv(const char *filename)
         return false;
     }
 
+    // --command-mix commands get columns only when they were used
+    unsigned long int total_cmd_ops[mc_count] = { 0 };
+    for (std::vector<one_second_stats>::iterator i = m_stats.begin();
+            i != m_stats.end(); i++) {
+        for (int cmd = 0; cmd < mc_count; cmd++)
+            total_cmd_ops[cmd] += i->m_ops_cmd[cmd];
+    }
+
     fprintf(f, "Per-Second Benchmark Data\n");
     fprintf(f, "Second,SET Requests,SET Average Latency,SET Total Bytes,"
                "GET Requests,GET Average Latency,GET Total Bytes,GET Misses, GET Hits,"
-               "WAIT Requests,WAIT Average Latency\n");
+               "WAIT Requests,WAIT Average Latency");
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        if (total_cmd_ops[cmd] > 0)
+            fprintf(f, ",%s Requests,%s Average Latency,%s Total Bytes,%s Misses,%s Hits",
+                    mix_stats_labels[cmd].histogram, mix_stats_labels[cmd].histogram,
+                    mix_stats_labels[cmd].histogram, mix_stats_labels[cmd].histogram,
+                    mix_stats_labels[cmd].histogram);
+    }
+    fprintf(f, "\n");
 
     unsigned long int total_get_ops = 0;
     unsigned long int total_set_ops = 0;
@@ -941,7 +2256,7 @@ bool run_stats::save_csv(const char *filename)
     for (std::vector<one_second_stats>::iterator i = m_stats.begin();
             i != m_stats.end(); i++) {
 
-        fprintf(f, "%u,%lu,%u.%06u,%lu,%lu,%u.%06u,%lu,%u,%u,%lu,%u.%06u\n",
+        fprintf(f, "%u,%lu,%u.%06u,%lu,%lu,%u.%06u,%lu,%u,%u,%lu,%u.%06u",
             i->m_second,
             i->m_ops_set,
             USEC_FORMAT(AVERAGE(i->m_total_set_latency, i->m_ops_set)),
@@ -953,6 +2268,16 @@ bool run_stats::save_csv(const char *filename)
             i->m_get_hits,
             i->m_ops_wait,
             USEC_FORMAT(AVERAGE(i->m_total_wait_latency, i->m_ops_wait)));
+        for (int cmd = 0; cmd < mc_count; cmd++) {
+            if (total_cmd_ops[cmd] > 0)
+                fprintf(f, ",%lu,%u.%06u,%lu,%u,%u",
+                    i->m_ops_cmd[cmd],
+                    USEC_FORMAT(AVERAGE(i->m_total_cmd_latency[cmd], i->m_ops_cmd[cmd])),
+                    i->m_bytes_cmd[cmd],
+                    i->m_cmd_misses[cmd],
+                    i->m_cmd_hits[cmd]);
+        }
+        fprintf(f, "\n");
 
         total_get_ops += i->m_ops_get;
         total_set_ops += i->m_ops_set;
@@ -984,6 +2309,18 @@ bool run_stats::save_csv(const char *filename)
         fprintf(f, "%8.3f,%.2f\n", it->first, total_count_float / total_wait_ops * 100);
     }
 
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        if (!total_cmd_ops[cmd])
+            continue;
+        total_count_float = 0;
+        fprintf(f, "\n" "Full-Test %s Latency\n", mix_stats_labels[cmd].histogram);
+        fprintf(f, "Latency (<= msec),Percent\n");
+        for ( latency_map_itr it = m_cmd_latency_map[cmd].begin(); it != m_cmd_latency_map[cmd].end() ; it++ ) {
+            total_count_float += it->second;
+            fprintf(f, "%8.3f,%.2f\n", it->first, total_count_float / total_cmd_ops[cmd] * 100);
+        }
+    }
+
     fclose(f);
     return true;
 }
@@ -1051,6 +2388,14 @@ void run_stats::aggregate_average(const std::vector<run_stats>& all_stats)
         for (latency_map_itr_const it = i->m_wait_latency_map.begin() ; it != i->m_wait_latency_map.end() ; it++) {
             m_wait_latency_map[it->first] += it->second;
         }
+        for (latency_map_itr_const it = i->m_udp_get_latency_map.begin() ; it != i->m_udp_get_latency_map.end() ; it++) {
+            m_udp_get_latency_map[it->first] += it->second;
+        }
+        for (int cmd = 0; cmd < mc_count; cmd++) {
+            for (latency_map_itr_const it = i->m_cmd_latency_map[cmd].begin() ; it != i->m_cmd_latency_map[cmd].end() ; it++) {
+                m_cmd_latency_map[cmd][it->first] += it->second;
+            }
+        }
     }
     m_totals.m_ops_sec_set /= all_stats.size();
     m_totals.m_ops_sec_get /= all_stats.size();
@@ -1065,6 +2410,20 @@ void run_stats::aggregate_average(const std::vector<run_stats>& all_stats)
     m_totals.m_latency_get /= all_stats.size();
     m_totals.m_latency_wait /= all_stats.size();
     m_totals.m_latency /= all_stats.size();
+    m_totals.m_ops_sec_udp_get /= all_stats.size();
+    m_totals.m_udp_hits_sec /= all_stats.size();
+    m_totals.m_udp_misses_sec /= all_stats.size();
+    m_totals.m_bytes_sec_udp_get /= all_stats.size();
+    m_totals.m_latency_udp_get /= all_stats.size();
+    m_totals.m_udp_losses_sec /= all_stats.size();
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        m_totals.m_ops_sec_cmd[cmd] /= all_stats.size();
+        m_totals.m_hits_sec_cmd[cmd] /= all_stats.size();
+        m_totals.m_misses_sec_cmd[cmd] /= all_stats.size();
+        m_totals.m_bytes_sec_cmd[cmd] /= all_stats.size();
+        m_totals.m_latency_cmd[cmd] /= all_stats.size();
+    }
+    m_totals.m_request_allocs /= all_stats.size();
 
 }
 
@@ -1104,6 +2463,7 @@ void run_stats::merge(const run_stats& other, int iteration)
     // aggregate totals
     m_totals.m_bytes += other.m_totals.m_bytes;
     m_totals.m_ops += other.m_totals.m_ops;
+    m_request_allocs += other.m_request_allocs;
     
     // aggregate latency data
     for (latency_map_itr_const it = other.m_get_latency_map.begin() ; it != other.m_get_latency_map.end() ; it++) {
@@ -1115,6 +2475,14 @@ void run_stats::merge(const run_stats& other, int iteration)
     for (latency_map_itr_const it = other.m_wait_latency_map.begin() ; it != other.m_wait_latency_map.end() ; it++) {
         m_wait_latency_map[it->first] += it->second;
     }
+    for (latency_map_itr_const it = other.m_udp_get_latency_map.begin() ; it != other.m_udp_get_latency_map.end() ; it++) {
+        m_udp_get_latency_map[it->first] += it->second;
+    }
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        for (latency_map_itr_const it = other.m_cmd_latency_map[cmd].begin() ; it != other.m_cmd_latency_map[cmd].end() ; it++) {
+            m_cmd_latency_map[cmd][it->first] += it->second;
+        }
+    }
 }
 
 void run_stats::summarize(totals& result) const
@@ -1132,8 +2500,31 @@ void run_stats::summarize(totals& result) const
     result.m_ops_get = totals.m_ops_get;
     result.m_ops_wait = totals.m_ops_wait;
 
-    result.m_ops = totals.m_ops_get + totals.m_ops_set + totals.m_ops_wait;
-    result.m_bytes = totals.m_bytes_get + totals.m_bytes_set;
+    result.m_ops_udp_get = totals.m_ops_udp_get;
+    result.m_udp_losses = totals.m_udp_losses;
+    result.m_udp_send_failures = totals.m_udp_send_failures;
+    result.m_request_allocs = m_request_allocs;
+
+    result.m_ops = totals.m_ops_get + totals.m_ops_set + totals.m_ops_wait + totals.m_ops_udp_get;
+    result.m_bytes = totals.m_bytes_get + totals.m_bytes_set + totals.m_bytes_udp_get;
+
+    unsigned long long int total_cmd_latency = 0;
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        result.m_ops_cmd[cmd] = totals.m_ops_cmd[cmd];
+        result.m_ops += totals.m_ops_cmd[cmd];
+        result.m_bytes += totals.m_bytes_cmd[cmd];
+        total_cmd_latency += totals.m_total_cmd_latency[cmd];
+
+        result.m_ops_sec_cmd[cmd] = (double) totals.m_ops_cmd[cmd] / test_duration_usec * 1000000;
+        if (totals.m_ops_cmd[cmd] > 0) {
+            result.m_latency_cmd[cmd] = (double) (totals.m_total_cmd_latency[cmd] / totals.m_ops_cmd[cmd]) / 1000;
+        } else {
+            result.m_latency_cmd[cmd] = 0;
+        }
+        result.m_bytes_sec_cmd[cmd] = (totals.m_bytes_cmd[cmd] / 1024.0) / test_duration_usec * 1000000;
+        result.m_hits_sec_cmd[cmd] = (double) totals.m_cmd_hits[cmd] / test_duration_usec * 1000000;
+        result.m_misses_sec_cmd[cmd] = (double) totals.m_cmd_misses[cmd] / test_duration_usec * 1000000;
+    }
 
     result.m_ops_sec_set = (double) totals.m_ops_set / test_duration_usec * 1000000;
     if (totals.m_ops_set > 0) {
@@ -1160,9 +2551,21 @@ void run_stats::summarize(totals& result) const
         result.m_latency_wait = 0;
     }
 
+    result.m_ops_sec_udp_get = (double) totals.m_ops_udp_get / test_duration_usec * 1000000;
+    if (totals.m_ops_udp_get > 0) {
+        result.m_latency_udp_get = (double) (totals.m_total_udp_get_latency / totals.m_ops_udp_get) / 1000;
+    } else {
+        result.m_latency_udp_get = 0;
+    }
+    result.m_bytes_sec_udp_get = (totals.m_bytes_udp_get / 1024.0) / test_duration_usec * 1000000;
+    result.m_udp_hits_sec = (double) totals.m_udp_get_hits / test_duration_usec * 1000000;
+    result.m_udp_misses_sec = (double) totals.m_udp_get_misses / test_duration_usec * 1000000;
+    result.m_udp_losses_sec = (double) totals.m_udp_losses / test_duration_usec * 1000000;
+
     result.m_ops_sec = (double) result.m_ops / test_duration_usec * 1000000;
     if (result.m_ops > 0) {
-        result.m_latency = (double) ((totals.m_total_get_latency + totals.m_total_set_latency + totals.m_total_wait_latency) / result.m_ops) / 1000;
+        result.m_latency = (double) ((totals.m_total_get_latency + totals.m_total_set_latency + totals.m_total_wait_latency +
+                                      totals.m_total_udp_get_latency + total_cmd_latency) / result.m_ops) / 1000;
     } else {
         result.m_latency = 0;
     }
@@ -1244,15 +2647,61 @@ void run_stats::print(FILE *out, bool histogram, const char * header/*=NULL*/,
             m_totals.m_latency_wait,
             "---");
 
+    // UDP rows only show up when the run used the UDP transport
+    bool udp_used = m_totals.m_ops_udp_get > 0 || m_totals.m_udp_losses > 0 ||
+                    m_totals.m_udp_send_failures > 0;
+    if (udp_used) {
+        fprintf(out,
+               "%-6s %12.2f %12.2f %12.2f %12.05f %12.2f\n",
+               "UdpGet",
+               m_totals.m_ops_sec_udp_get,
+               m_totals.m_udp_hits_sec,
+               m_totals.m_udp_misses_sec,
+               m_totals.m_latency_udp_get,
+               m_totals.m_bytes_sec_udp_get);
+
+        fprintf(out,
+               "%-6s %12.2f %12s %12s %12s %12s\n",
+               "Losses",
+               m_totals.m_udp_losses_sec,
+               "---", "---", "---", "---");
+    }
+
+    // likewise for the commands of a --command-mix
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        if (mix_stats_labels[cmd].row == NULL || !m_totals.m_ops_cmd[cmd])
+            continue;
+        fprintf(out,
+               "%-6s %12.2f %12.2f %12.2f %12.05f %12.2f\n",
+               mix_stats_labels[cmd].row,
+               m_totals.m_ops_sec_cmd[cmd],
+               m_totals.m_hits_sec_cmd[cmd],
+               m_totals.m_misses_sec_cmd[cmd],
+               m_totals.m_latency_cmd[cmd],
+               m_totals.m_bytes_sec_cmd[cmd]);
+    }
+
     fprintf(out,
            "%-6s %12.2f %12.2f %12.2f %12.05f %12.2f\n",
            "Totals",
            m_totals.m_ops_sec,
-           m_totals.m_hits_sec,
-           m_totals.m_misses_sec,
+           m_totals.m_hits_sec + m_totals.m_udp_hits_sec + m_totals.m_hits_sec_cmd[mc_gets],
+           m_totals.m_misses_sec + m_totals.m_udp_misses_sec + m_totals.m_misses_sec_cmd[mc_gets],
            m_totals.m_latency,
            m_totals.m_bytes_sec);
 
+    fprintf(out, "\nRequest allocations: %lu\n", m_totals.m_request_allocs);
+
+    if (udp_used) {
+        unsigned long int udp_requests = m_totals.m_ops_udp_get + m_totals.m_udp_losses;
+        fprintf(out, "UDP loss: %.2f%% (%lu of %lu requests)\n",
+                (double) m_totals.m_udp_losses / udp_requests * 100,
+                m_totals.m_udp_losses, udp_requests);
+        if (m_totals.m_udp_send_failures > 0)
+            fprintf(out, "UDP send failures: %lu requests refused by the local socket\n",
+                    m_totals.m_udp_send_failures);
+    }
+
     ////////////////////////////////////////
     // JSON print handling
     // ------------------
@@ -1272,9 +2721,32 @@ void run_stats::print(FILE *out, bool histogram, const char * header/*=NULL*/,
                                                 0.0,
                                                 m_totals.m_latency_wait,
                                                 0.0);
+        if (udp_used) {
+            result_print_to_json(jsonhandler,"UDP Gets",m_totals.m_ops_sec_udp_get,
+                                                m_totals.m_udp_hits_sec,
+                                                m_totals.m_udp_misses_sec,
+                                                m_totals.m_latency_udp_get,
+                                                m_totals.m_bytes_sec_udp_get);
+            result_print_to_json(jsonhandler,"UDP Losses",m_totals.m_udp_losses_sec,
+                                                0.0,
+                                                0.0,
+                                                0.0,
+                                                0.0);
+            jsonhandler->write_obj("UDP Send Failures","%lu", m_totals.m_udp_send_failures);
+        }
+        for (int cmd = 0; cmd < mc_count; cmd++) {
+            if (mix_stats_labels[cmd].json == NULL || !m_totals.m_ops_cmd[cmd])
+                continue;
+            result_print_to_json(jsonhandler,mix_stats_labels[cmd].json,m_totals.m_ops_sec_cmd[cmd],
+                                                m_totals.m_hits_sec_cmd[cmd],
+                                                m_totals.m_misses_sec_cmd[cmd],
+                                                m_totals.m_latency_cmd[cmd],
+                                                m_totals.m_bytes_sec_cmd[cmd]);
+        }
+        jsonhandler->write_obj("Request Allocations","%lu", m_totals.m_request_allocs);
         result_print_to_json(jsonhandler,"Totals",m_totals.m_ops_sec,
-                                                m_totals.m_hits_sec,
-                                                m_totals.m_misses_sec,
+                                                m_totals.m_hits_sec + m_totals.m_udp_hits_sec + m_totals.m_hits_sec_cmd[mc_gets],
+                                                m_totals.m_misses_sec + m_totals.m_udp_misses_sec + m_totals.m_misses_sec_cmd[mc_gets],
                                                 m_totals.m_latency,
                                                 m_totals.m_bytes_sec);
     }
@@ -1317,6 +2789,32 @@ void run_stats::print(FILE *out, bool histogram, const char * header/*=NULL*/,
             histogram_print(out, jsonhandler, "WAIT",it->first,(double) total_count / m_totals.m_ops_wait * 100);
         }
         if (jsonhandler != NULL){ jsonhandler->close_nesting();}
+        // UDP GETs
+        // --------
+        if (udp_used) {
+            fprintf(out, "---\n");
+            total_count = 0;
+            if (jsonhandler != NULL){ jsonhandler->open_nesting("UDPGET",NESTED_ARRAY);}
+            for( latency_map_itr_const it = m_udp_get_latency_map.begin() ; it != m_udp_get_latency_map.end() ; it++) {
+                total_count += it->second;
+                histogram_print(out, jsonhandler, "UDPGET",it->first,(double) total_count / m_totals.m_ops_udp_get * 100);
+            }
+            if (jsonhandler != NULL){ jsonhandler->close_nesting();}
+        }
+        // --command-mix commands
+        // ----------------------
+        for (int cmd = 0; cmd < mc_count; cmd++) {
+            if (mix_stats_labels[cmd].histogram == NULL || !m_totals.m_ops_cmd[cmd])
+                continue;
+            fprintf(out, "---\n");
+            total_count = 0;
+            if (jsonhandler != NULL){ jsonhandler->open_nesting(mix_stats_labels[cmd].histogram,NESTED_ARRAY);}
+            for( latency_map_itr_const it = m_cmd_latency_map[cmd].begin() ; it != m_cmd_latency_map[cmd].end() ; it++) {
+                total_count += it->second;
+                histogram_print(out, jsonhandler, mix_stats_labels[cmd].histogram,it->first,(double) total_count / m_totals.m_ops_cmd[cmd] * 100);
+            }
+            if (jsonhandler != NULL){ jsonhandler->close_nesting();}
+        }
     }
     // This close_nesting closes either:
     //      jsonhandler->open_nesting(header); or
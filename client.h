@@ -41,6 +41,18 @@
 
 #define MAIN_CONNECTION m_connections[0]
 
+// Children of a client's node in the seed tree, the node being the child
+// of the --seed root at the client index
+#define SEED_BRANCH_KEYS        1   // keys, value sizes and expiries
+#define SEED_BRANCH_ARRIVALS    2   // inter-arrival times, one child per connection
+#define SEED_BRANCH_SIZES       3   // --data-size-per-key sizes, under the keys branch
+                                    // of the root, so all clients agree on them
+
+// --command-mix lists are trimmed back to ds_fields elements every this
+// many LPUSHes of a client, so a list holds ds_fields elements plus the
+// pushes it got since its last trim instead of growing over the run
+#define LIST_TRIM_PUSHES        8
+
 class client;               // forward decl
 class client_group;         // forward decl
 struct benchmark_config;
@@ -69,6 +81,23 @@ protected:
         unsigned long long int m_total_set_latency;
         unsigned long long int m_total_wait_latency;
 
+        // GETs sent over UDP, kept apart from the TCP numbers
+        unsigned long int m_bytes_udp_get;
+        unsigned long int m_ops_udp_get;
+        unsigned int m_udp_get_hits;
+        unsigned int m_udp_get_misses;
+        unsigned int m_udp_losses;
+        unsigned int m_udp_send_failures;   // refused by the kernel, never on the network
+        unsigned long long int m_total_udp_get_latency;
+
+        // --command-mix commands, indexed by mix_command; SET and GET
+        // keep using the fields above
+        unsigned long int m_bytes_cmd[mc_count];
+        unsigned long int m_ops_cmd[mc_count];
+        unsigned int m_cmd_hits[mc_count];
+        unsigned int m_cmd_misses[mc_count];
+        unsigned long long int m_total_cmd_latency[mc_count];
+
         one_second_stats(unsigned int second);
         void reset(unsigned int second);
         void merge(const one_second_stats& other);
@@ -97,11 +126,29 @@ protected:
         double m_latency_wait;
         double m_latency;
 
+        double m_ops_sec_udp_get;
+        double m_udp_hits_sec;
+        double m_udp_misses_sec;
+        double m_bytes_sec_udp_get;
+        double m_latency_udp_get;
+        double m_udp_losses_sec;
+
+        double m_ops_sec_cmd[mc_count];
+        double m_hits_sec_cmd[mc_count];
+        double m_misses_sec_cmd[mc_count];
+        double m_bytes_sec_cmd[mc_count];
+        double m_latency_cmd[mc_count];
+
         unsigned long int m_bytes;
         unsigned long int m_ops_set;
         unsigned long int m_ops_get;
         unsigned long int m_ops_wait;
         unsigned long int m_ops;
+        unsigned long int m_ops_udp_get;
+        unsigned long int m_udp_losses;
+        unsigned long int m_udp_send_failures;
+        unsigned long int m_ops_cmd[mc_count];
+        unsigned long int m_request_allocs;
 
         totals();
         void add(const totals& other);
@@ -113,16 +160,26 @@ protected:
     latency_map m_get_latency_map;
     latency_map m_set_latency_map;
     latency_map m_wait_latency_map;
+    latency_map m_udp_get_latency_map;
+    latency_map m_cmd_latency_map[mc_count];
+    unsigned long int m_request_allocs;     // allocations made for request tracking
     void roll_cur_stats(struct timeval* ts);
 
 public:
     run_stats();
     void set_start_time(struct timeval* start_time);
     void set_end_time(struct timeval* end_time);
+    void set_request_allocs(unsigned long int allocs);
 
     void update_get_op(struct timeval* ts, unsigned int bytes, unsigned int latency, unsigned int hits, unsigned int misses);
     void update_set_op(struct timeval* ts, unsigned int bytes, unsigned int latency);
+    void update_set_batch(struct timeval* ts, unsigned int count, unsigned int bytes, unsigned int latency);
     void update_wait_op(struct timeval* ts, unsigned int latency);
+    void update_udp_get_op(struct timeval* ts, unsigned int bytes, unsigned int latency, unsigned int hits, unsigned int misses);
+    void update_udp_loss(struct timeval* ts);
+    void update_udp_send_failure(struct timeval* ts);
+    void update_cmd_op(struct timeval* ts, mix_command cmd, unsigned int bytes, unsigned int latency,
+                       unsigned int hits, unsigned int misses);
 
     void aggregate_average(const std::vector<run_stats>& all_stats);
     void summarize(totals& result) const;
@@ -160,13 +217,31 @@ protected:
     unsigned long m_tot_set_ops;        // Total number of SET ops
     unsigned long m_tot_wait_ops;       // Total number of WAIT ops
 
+    unsigned int m_mix_counts[mc_count];    // commands sent in this --command-mix round
+    char m_mix_key[256];                    // INCR/DECR or data structure key, derived from a generated key
+    char m_cas_key[256];                    // key of the last GETS hit, for the next CAS
+    unsigned int m_cas_key_len;             // 0 when no cas unique is available
+    unsigned long long m_cas_unique;
+    char *m_ds_value;                       // ds_member_size bytes, HSET values and LPUSH members
+    unsigned int m_untrimmed_pushes;        // LPUSHes since the last LTRIM
+
     keylist *m_keylist;                 // used to construct multi commands
+    unsigned int m_next_conn;           // next connection in turn, for round-robin dispatch
+    unsigned long long m_seed;          // node of the client in the seed tree
 
     static pthread_mutex_t m_skew_mutex; // used to serialize skewed assignment to memcached server
     static int skew_count;               // used to count the number of clients
                                          // piled up on thread "0" for memcached server
     static int total_conns;              // used to count the total created connections
     static int real_conns;               // used to count the real number of connections to the server
+    static int filler_conns;             // connections only opened to rotate the server's dispatch
+    static int skew_batch;               // clients placed in the current batch of server_threads
+    static bool migration_placing;       // a migration owns the dispatch until its reconnect is established
+
+    int connect_conn(shard_connection* sc);
+    void init_schedule(shard_connection* sc);
+    int open_fillers(int count);
+    unsigned int dispatch_conn(unsigned int conn_id);
 public:
     client(client_group* group);
     client(struct event_base *event_base, benchmark_config *config, abstract_protocol *protocol, object_generator *obj_gen);
@@ -174,9 +249,14 @@ public:
     virtual bool setup_client(benchmark_config *config, abstract_protocol *protocol, object_generator *obj_gen);
     virtual int prepare(void);
 
+    // connections made so far, and those only opened for thread placement
+    static int placed_conns(void) { return real_conns; }
+    static int placement_fillers(void) { return filler_conns; }
+
     bool initialized(void);
 
     run_stats* get_stats(void) { return &m_stats; }
+    const std::vector<shard_connection*>& get_connections(void) { return m_connections; }
 
     // client manager api's
     unsigned int get_reqs_processed() {
@@ -200,13 +280,20 @@ public:
     }
 
     virtual void handle_response(struct timeval timestamp, request *request, protocol_response *response);
+    virtual void handle_udp_loss(struct timeval timestamp, request *request);
+    virtual void handle_udp_send_failure(struct timeval timestamp, request *request);
     virtual bool finished(void);
     virtual void set_start_time();
     virtual void set_end_time();
     virtual void create_request(struct timeval timestamp, unsigned int conn_id);
+    void create_mix_request(struct timeval timestamp, unsigned int conn_id);
+    const char *ds_key(int cmd, int iter, unsigned int *len);
     virtual bool hold_pipeline(unsigned int conn_id);
     virtual int connect(void);
     virtual void disconnect(void);
+    virtual int migrate_conn(unsigned int conn_id, int tid);
+    virtual void end_migration(unsigned int conn_id, int tid, bool moved);
+    void reconnect_migrated(unsigned int conn_id, bool placed);
 
     // Utility function to get the object iterator type based on the config
     inline int obj_iter_type(benchmark_config *cfg, unsigned char index)
@@ -215,6 +302,12 @@ public:
             return OBJECT_GENERATOR_KEY_RANDOM;
         else if (cfg->key_pattern[index] == 'G')
             return OBJECT_GENERATOR_KEY_GAUSSIAN;
+        else if (cfg->key_pattern[index] == 'Z')
+            return OBJECT_GENERATOR_KEY_ZIPF;
+        else if (cfg->key_pattern[index] == 'H')
+            return OBJECT_GENERATOR_KEY_HOTSPOT;
+        else if (cfg->key_pattern[index] == 'L')
+            return OBJECT_GENERATOR_KEY_LATEST;
         return OBJECT_GENERATOR_KEY_SET_ITER;
     }
 
@@ -264,8 +357,122 @@ public:
     unsigned long int get_duration_usec(void);
 
     void merge_run_stats(run_stats* target);
+    void merge_conn_stats(std::vector<unsigned long>& responses,
+                          std::vector<unsigned long long>& latency);
     std::vector<client*> m_clients;
-    static pthread_mutex_t m_conn_mutex; // used to serialize assignment to memcached server
+};
+
+// Connections that only take a slot on the server: opened evenly over its
+// threads before the measured clients connect, and run from a thread of
+// their own that at most sends them an occasional keepalive GET.
+class idle_connections {
+protected:
+    struct idle_conn {
+        int fd;
+        struct event* read_event;
+        idle_connections* owner;
+    };
+
+    benchmark_config* m_config;
+    struct event_base* m_base;
+    struct event* m_tick_event;
+    std::vector<idle_conn> m_conns;
+    pthread_t m_thread;
+    volatile bool m_stop;
+
+    char* m_commands;                   // setup commands, then the keepalive GET
+    unsigned int m_setup_len;
+    unsigned int m_commands_len;
+
+    unsigned int m_next;                // next connection due a keepalive
+    double m_keepalive_credit;          // keepalives owed since the last tick
+    unsigned long int m_keepalives;
+    unsigned int m_dropped;
+
+    void close_conn(idle_conn& conn);
+    static void read_handler(evutil_socket_t fd, short evtype, void *arg);
+    static void tick_handler(evutil_socket_t fd, short evtype, void *arg);
+    static void* thread_main(void *arg);
+public:
+    idle_connections(benchmark_config* config);
+    ~idle_connections();
+
+    int open(int count);
+    int start(void);
+    void stop(void);
+
+    unsigned int get_open_conns(void) { return m_conns.size() - m_dropped; }
+    unsigned long int get_keepalives(void) { return m_keepalives; }
+};
+
+// Connections opened at a steady rate, apart from the measured clients:
+// each one connects, sends the setup commands, then a single GET, and is
+// closed once that is answered.  The latency of the three steps is kept in
+// histograms of its own.  Like the idle connections they run from a thread
+// of their own.
+class churn_connections {
+protected:
+    enum churn_state { churn_connecting, churn_setup, churn_first_request };
+
+    struct churn_conn {
+        int fd;                         // -1 while the slot is free
+        churn_state state;
+        unsigned int setup_replies;     // setup replies still missing
+        struct timeval step_start;
+        struct event* event;
+        struct evbuffer* read_buf;
+        abstract_protocol* protocol;
+        churn_connections* owner;
+    };
+
+    benchmark_config* m_config;
+    struct event_base* m_base;
+    struct event* m_tick_event;
+    struct connect_info m_addr;
+    struct sockaddr_un m_unix_addr;
+    std::vector<churn_conn> m_conns;
+    std::vector<unsigned int> m_free;
+    pthread_t m_thread;
+    volatile bool m_stop;
+
+    abstract_protocol* m_protocol;      // cloned for every connection opened
+    char* m_commands;                   // setup commands, then the GET
+    unsigned int m_setup_len;
+    unsigned int m_setup_cmds;
+    unsigned int m_commands_len;
+
+    double m_open_credit;               // connections owed since the last tick
+    unsigned long int m_opened;
+    unsigned long int m_completed;
+    unsigned long int m_failed;
+    unsigned long int m_skipped;        // not opened, churn-conns were all open
+
+    latency_map m_connect_latency_map;
+    latency_map m_setup_latency_map;
+    latency_map m_first_latency_map;
+    unsigned long long int m_total_connect_latency;
+    unsigned long long int m_total_setup_latency;
+    unsigned long long int m_total_first_latency;
+
+    void open_conn(void);
+    void close_conn(churn_conn& conn, bool failed);
+    bool send_commands(churn_conn& conn, unsigned int offset, unsigned int len);
+    void end_step(churn_conn& conn, latency_map& map, unsigned long long int& total, struct timeval& now);
+    static void event_handler(evutil_socket_t fd, short evtype, void *arg);
+    static void tick_handler(evutil_socket_t fd, short evtype, void *arg);
+    static void* thread_main(void *arg);
+public:
+    churn_connections(benchmark_config* config);
+    ~churn_connections();
+
+    int start(void);
+    void stop(void);
+    void print(FILE *out, bool histogram, const char *header, json_handler *jsonhandler = NULL);
+
+    unsigned long int get_opened(void) { return m_opened; }
+    unsigned long int get_completed(void) { return m_completed; }
+    unsigned long int get_failed(void) { return m_failed; }
+    unsigned long int get_skipped(void) { return m_skipped; }
 };
 
 
@@ -105,6 +105,8 @@ static uint32_t calc_hslot_crc16_cluster(const char *str, size_t length)
 
 cluster_client::cluster_client(client_group* group) : client(group)
 {
+    if (m_obj_gen != NULL)
+        m_key = m_obj_gen->get_key_builder();
 }
 
 cluster_client::~cluster_client() {
@@ -270,7 +272,7 @@ bool cluster_client::get_key_for_conn(unsigned int conn_id, int iter, unsigned l
     // first check if we already have key in pool
     if (!m_key_index_pools[conn_id]->empty()) {
         *key_index = m_key_index_pools[conn_id]->front();
-        m_key_len = snprintf(m_key_buffer, sizeof(m_key_buffer)-1, "%s%llu", m_obj_gen->get_key_prefix(), *key_index);
+        m_key.build(*key_index);
 
         m_key_index_pools[conn_id]->pop();
         return true;
@@ -280,10 +282,10 @@ bool cluster_client::get_key_for_conn(unsigned int conn_id, int iter, unsigned l
     while (true) {
         // generate key
         *key_index = m_obj_gen->get_key_index(iter);
-        m_key_len = snprintf(m_key_buffer, sizeof(m_key_buffer)-1, "%s%llu", m_obj_gen->get_key_prefix(), *key_index);
+        m_key.build(*key_index);
 
         // check if the key match for this connection
-        unsigned int hslot = calc_hslot_crc16_cluster(m_key_buffer, m_key_len);
+        unsigned int hslot = calc_hslot_crc16_cluster(m_key.get_key(), m_key.get_len());
         if (m_slot_to_shard[hslot] == conn_id) {
             m_reqs_generated++;
             return true;
@@ -334,7 +336,7 @@ void cluster_client::create_request(struct timeval timestamp, unsigned int conn_
         unsigned int value_len;
         const char *value = m_obj_gen->get_value(key_index, &value_len);
 
-        m_connections[conn_id]->send_set_command(&timestamp, m_key_buffer, m_key_len,
+        m_connections[conn_id]->send_set_command(&timestamp, m_key.get_key(), m_key.get_len(),
                                                  value, value_len, m_obj_gen->get_expiry(),
                                                  m_config->data_offset);
         m_set_ratio_count++;
@@ -347,7 +349,7 @@ void cluster_client::create_request(struct timeval timestamp, unsigned int conn_
         if (!get_key_for_conn(conn_id, obj_iter_type(m_config, 2), &key_index))
             return;
 
-        m_connections[conn_id]->send_get_command(&timestamp, m_key_buffer, m_key_len, m_config->data_offset);
+        m_connections[conn_id]->send_get_command(&timestamp, m_key.get_key(), m_key.get_len(), m_config->data_offset);
         m_get_ratio_count++;
     } else {
         // overlap counters
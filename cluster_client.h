@@ -32,8 +32,7 @@ protected:
     std::vector<key_index_pool*> m_key_index_pools;
     unsigned int m_slot_to_shard[16384];
 
-    char m_key_buffer[250];
-    int m_key_len;
+    key_builder m_key;
 
     virtual int connect(void);
     virtual void disconnect(void);
@@ -192,6 +192,160 @@ const char* config_weight_list::print(char *buf, int buf_len)
     return start;
 }
 
+static const char *mix_command_names[mc_count] = {
+    "set", "get", "delete", "incr", "decr", "append", "touch", "cas", "gets",
+    "hset", "hget", "lpush", "lrange", "zadd", "zrangebyscore"
+};
+
+config_command_mix::config_command_mix()
+{
+    memset(weights, 0, sizeof(weights));
+}
+
+// Parse a list of command:weight pairs, e.g. "set:1,get:8,incr:1".
+config_command_mix::config_command_mix(const char *str)
+{
+    assert(str != NULL);
+    memset(weights, 0, sizeof(weights));
+
+    do {
+        const char *colon = strchr(str, ':');
+        if (colon == NULL)
+            goto error;
+
+        int cmd;
+        for (cmd = 0; cmd < mc_count; cmd++) {
+            if (strlen(mix_command_names[cmd]) == (size_t) (colon - str) &&
+                strncmp(str, mix_command_names[cmd], colon - str) == 0)
+                break;
+        }
+        if (cmd == mc_count)
+            goto error;
+
+        char *p = NULL;
+        weights[cmd] = strtoul(colon + 1, &p, 10);
+        if (!p || p == colon + 1 || (*p != ',' && *p != '\0'))
+            goto error;
+
+        str = p;
+        if (*str) str++;
+    } while (*str);
+
+    return;
+error:
+    memset(weights, 0, sizeof(weights));
+}
+
+bool config_command_mix::is_defined(void)
+{
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        if (weights[cmd] > 0)
+            return true;
+    }
+    return false;
+}
+
+// the hash, list and sorted set commands only exist in redis
+bool config_command_mix::has_data_structures(void)
+{
+    for (int cmd = mc_hset; cmd < mc_count; cmd++) {
+        if (weights[cmd] > 0)
+            return true;
+    }
+    return false;
+}
+
+const char* config_command_mix::print(char *buf, int buf_len)
+{
+    const char* start = buf;
+    bool first = true;
+    assert(buf != NULL && buf_len > 0);
+
+    *buf = '\0';
+    for (int cmd = 0; cmd < mc_count; cmd++) {
+        if (!weights[cmd])
+            continue;
+
+        int n = snprintf(buf, buf_len, "%s%s:%u",
+                first ? "" : ",", mix_command_names[cmd], weights[cmd]);
+        if (n >= buf_len)
+            return NULL;
+        buf += n;
+        buf_len -= n;
+        first = false;
+    }
+
+    return start;
+}
+
+const char* config_command_mix::command_name(mix_command cmd)
+{
+    assert(cmd < mc_count);
+    return mix_command_names[cmd];
+}
+
+config_server_list::config_server_list(const char *str)
+{
+    assert(str != NULL);
+
+    do {
+        struct server_item item;
+        const char *colon = strchr(str, ':');
+        char *p = NULL;
+
+        if (!colon || colon == str) {
+            servers.clear();
+            return;
+        }
+        item.hostname.assign(str, colon - str);
+        item.port = strtoul(colon + 1, &p, 10);
+        item.weight = 1;
+        item.addr = NULL;
+        if (!item.port || !p || (*p != ':' && *p != ',' && *p != '\0')) {
+            servers.clear();
+            return;
+        }
+
+        if (*p == ':') {
+            item.weight = strtoul(p + 1, &p, 10);
+            if (!item.weight || !p || (*p != ',' && *p != '\0')) {
+                servers.clear();
+                return;
+            }
+        }
+
+        str = p;
+        if (*str) str++;
+        servers.push_back(item);
+    } while (*str);
+}
+
+unsigned int config_server_list::total_weight(void)
+{
+    unsigned int total = 0;
+    for (unsigned int i = 0; i < servers.size(); i++)
+        total += servers[i].weight;
+
+    return total;
+}
+
+const char* config_server_list::print(char *buf, int buf_len)
+{
+    const char* start = buf;
+    assert(buf != NULL && buf_len > 0);
+
+    *buf = '\0';
+    for (unsigned int i = 0; i < servers.size(); i++) {
+        int n = snprintf(buf, buf_len, "%s%s:%u:%u", i ? "," : "",
+                servers[i].hostname.c_str(), servers[i].port, servers[i].weight);
+        if (n >= buf_len)
+            return NULL;
+        buf += n;
+        buf_len -= n;
+    }
+
+    return start;
+}
 
 server_addr::server_addr(const char *hostname, int port) :
     m_hostname(hostname), m_port(port), m_server_addr(NULL), m_used_addr(NULL), m_last_error(0)
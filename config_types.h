@@ -67,6 +67,43 @@ struct config_weight_list {
     unsigned int get_next_size(void);
 };
 
+// Commands a --command-mix can be made of
+enum mix_command { mc_set, mc_get, mc_delete, mc_incr, mc_decr, mc_append, mc_touch, mc_cas, mc_gets,
+                   mc_hset, mc_hget, mc_lpush, mc_lrange, mc_zadd, mc_zrangebyscore, mc_count };
+
+struct config_command_mix {
+    unsigned int weights[mc_count];
+
+    config_command_mix();
+    config_command_mix(const char *str);
+
+    bool is_defined(void);
+    bool has_data_structures(void);
+    const char *print(char *buf, int buf_len);
+    static const char *command_name(mix_command cmd);
+};
+
+struct server_addr;
+
+// --servers targets; the keys are hashed over them by weight
+struct config_server_list {
+    struct server_item {
+        std::string hostname;
+        unsigned short port;
+        unsigned int weight;
+        struct server_addr *addr;   // resolved once the list is final
+    };
+
+    std::vector<server_item> servers;
+
+    config_server_list() { }
+    config_server_list(const char *str);
+
+    bool is_defined(void) { return servers.size() > 0; }
+    unsigned int total_weight(void);
+    const char *print(char *buf, int buf_len);
+};
+
 struct connect_info {
     int ci_family;
     int ci_socktype;
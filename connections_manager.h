@@ -32,12 +32,16 @@ public:
 
     virtual void handle_cluster_slots(protocol_response *r) = 0;
     virtual void handle_response(struct timeval timestamp, request *request, protocol_response *response) = 0;
+    virtual void handle_udp_loss(struct timeval timestamp, request *request) = 0;
+    virtual void handle_udp_send_failure(struct timeval timestamp, request *request) = 0;
 
     virtual void create_request(struct timeval timestamp, unsigned int conn_id) = 0;
     virtual bool hold_pipeline(unsigned int conn_id) = 0;
 
     virtual int connect(void) = 0;
     virtual void disconnect(void) = 0;
+    virtual int migrate_conn(unsigned int conn_id, int tid) = 0;
+    virtual void end_migration(unsigned int conn_id, int tid, bool moved) = 0;
 
 };
 
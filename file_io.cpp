@@ -22,11 +22,21 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "file_io.h"
 
 /** largest support line length */
 #define MAX_LINE_BUFFER     1024
 
+/** smallest share of a dump file worth a loading thread of its own */
+#define IMPORT_MIN_CHUNK    (64 * 1024 * 1024)
+
 /** \brief file_reader constructor.
  * \param filename name of file to open.
  */
@@ -288,6 +298,464 @@ memcache_item* file_reader::read_item(void)
 
 /////////////////////////////////////////////////////////////////////
 
+/** share of a mapped dump file parsed by one thread */
+struct import_chunk {
+    const char *filename;
+    const char *map;
+    size_t start;               /** nominal share [start, end) of the file */
+    size_t end;
+    bool quotes_odd;            /** odd number of '"' in the nominal share */
+    bool start_odd;             /** odd number of '"' before start */
+    char *arena;                /** records go to the arena from out_start */
+    size_t out_start;
+    size_t out_len;
+    std::vector<uint64_t> offsets;  /** of the records, from out_start */
+    bool ok;
+};
+
+static void* import_count_quotes(void *arg)
+{
+    import_chunk *c = (import_chunk *) arg;
+    const char *p = c->map + c->start;
+    const char *end = c->map + c->end;
+    unsigned long quotes = 0;
+
+    while ((p = (const char *) memchr(p, '"', end - p)) != NULL) {
+        quotes++;
+        p++;
+    }
+    c->quotes_odd = quotes % 2;
+    return NULL;
+}
+
+/** \brief find where the first record starting at or after pos begins.
+ *
+ * Quoted fields double their quotes and unquoted ones have none, so a line
+ * break ends a record exactly when an even number of quotes precedes it.
+ * \param odd whether an odd number of quotes precedes pos.
+ */
+static size_t import_record_boundary(const char *map, size_t map_len, size_t pos, bool odd)
+{
+    for (; pos < map_len; pos++) {
+        if (map[pos] == '"')
+            odd = !odd;
+        else if (map[pos] == '\n' && !odd)
+            return pos + 1;
+    }
+    return map_len;
+}
+
+static inline void import_skip_spaces(const char **p, const char *end)
+{
+    while (*p < end && (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n'))
+        (*p)++;
+}
+
+/** \brief copy a column of up to len bytes, de-quoting it if quoted, like
+ * file_reader::read_string does.
+ * \return false if a quoted column is not terminated.
+ */
+static bool import_string(const char **pp, const char *end, unsigned int len,
+                          char *out, unsigned int *actual_len)
+{
+    const char *p = *pp;
+    unsigned int n = 0;
+
+    if (p < end && *p == '"') {
+        p++;
+        while (n < len && p < end) {
+            if (*p == '"') {
+                if (p + 1 < end && p[1] == '"') {
+                    out[n++] = '"';
+                    p += 2;
+                    continue;
+                }
+                break;
+            }
+            out[n++] = *p++;
+        }
+        if (p >= end || *p != '"')
+            return false;
+        p++;
+    } else {
+        while (n < len && p < end && *p != ',' && *p != '\r' && *p != '\n')
+            out[n++] = *p++;
+    }
+
+    *pp = p;
+    *actual_len = n;
+    return true;
+}
+
+/** \brief parse the records of a share into the arena.  The shortest line
+ * of a record still outsizes its header and padding, so each record fits in
+ * place of its own text.
+ */
+static void* import_parse_chunk(void *arg)
+{
+    import_chunk *c = (import_chunk *) arg;
+    const char *p = c->map + c->start;
+    const char *end = c->map + c->end;
+    char *base = c->arena + c->out_start;
+    char *out = base;
+
+    c->ok = false;
+    while (true) {
+        import_skip_spaces(&p, end);
+        if (p >= end)
+            break;
+
+        // dumpflags, time, exptime, nbytes, nsuffix, it_flags, clsid, nkey
+        unsigned int values[8];
+        for (int i = 0; i < 8; i++) {
+            import_skip_spaces(&p, end);
+            if (p >= end || *p < '0' || *p > '9') {
+                fprintf(stderr, "%s: offset %lu: error parsing item values.\n",
+                    c->filename, (unsigned long) (p - c->map));
+                return NULL;
+            }
+            values[i] = 0;
+            while (p < end && *p >= '0' && *p <= '9')
+                values[i] = values[i] * 10 + (*p++ - '0');
+            import_skip_spaces(&p, end);
+            if (p >= end || *p != ',') {
+                fprintf(stderr, "%s: offset %lu: error parsing item values.\n",
+                    c->filename, (unsigned long) (p - c->map));
+                return NULL;
+            }
+            p++;
+        }
+        import_skip_spaces(&p, end);
+
+        unsigned int nkey = values[7];
+        unsigned int nbytes = values[3];
+        char *key = out + sizeof(dataset_record);
+        unsigned int key_actlen = 0;
+        if (!import_string(&p, end, nkey, key, &key_actlen)) {
+            fprintf(stderr, "%s: offset %lu: unterminated key column.\n",
+                c->filename, (unsigned long) (p - c->map));
+            return NULL;
+        }
+        if (key_actlen != nkey) {
+            fprintf(stderr, "%s: offset %lu: warning: key column is %u bytes, expected %u bytes.\n",
+                c->filename, (unsigned long) (p - c->map), key_actlen, nkey);
+        }
+
+        // the delimiter and the space after it
+        if (p >= end || *p != ',' || nbytes < 2) {
+            fprintf(stderr, "%s: offset %lu: error parsing csv file, delimiter expected.\n",
+                c->filename, (unsigned long) (p - c->map));
+            return NULL;
+        }
+        p += 2;
+
+        unsigned int data_actlen = 0;
+        if (p > end || !import_string(&p, end, nbytes - 2, key + key_actlen, &data_actlen)) {
+            fprintf(stderr, "%s: offset %lu: unterminated data column.\n",
+                c->filename, (unsigned long) (p - c->map));
+            return NULL;
+        }
+
+        while (p < end && *p != '\n')
+            p++;
+        if (data_actlen != nbytes - 2) {
+            fprintf(stderr, "%s: offset %lu: warning: data column is %u bytes, expected %u bytes.\n",
+                c->filename, (unsigned long) (p - c->map), data_actlen, nbytes);
+            continue;
+        }
+        key[key_actlen + data_actlen] = '\r';
+        key[key_actlen + data_actlen + 1] = '\n';
+
+        // the share may start unaligned in the arena, so the header is
+        // copied and padding counts from the start of the share
+        dataset_record r;
+        r.nkey = key_actlen;
+        r.nbytes = nbytes;
+        r.exptime = values[2];
+        memcpy(out, &r, sizeof(r));
+        c->offsets.push_back(out - base);
+        out += (sizeof(dataset_record) + key_actlen + nbytes + 3) & ~3;
+    }
+
+    c->out_len = out - base;
+    c->ok = true;
+    return NULL;
+}
+
+/** \brief run fn over all chunks, one thread each.
+ */
+static void import_run_threads(std::vector<import_chunk>& chunks, void* (*fn)(void *))
+{
+    std::vector<pthread_t> threads(chunks.size());
+    std::vector<bool> started(chunks.size(), false);
+
+    // a share that gets no thread of its own is parsed inline
+    for (unsigned int i = 1; i < chunks.size(); i++) {
+        if (pthread_create(&threads[i], NULL, fn, &chunks[i]) == 0)
+            started[i] = true;
+        else
+            fn(&chunks[i]);
+    }
+    fn(&chunks[0]);
+    for (unsigned int i = 1; i < chunks.size(); i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+    }
+}
+
+imported_dataset::imported_dataset(const char *filename) :
+    m_filename(filename), m_arena(NULL), m_arena_len(0), m_map(NULL), m_map_len(0),
+    m_records(NULL), m_index(NULL), m_items(0)
+{
+}
+
+imported_dataset::~imported_dataset()
+{
+    if (m_arena != NULL)
+        free(m_arena);
+    if (m_map != NULL)
+        munmap(m_map, m_map_len);
+}
+
+/** \brief load all items of the file, a binary dataset or else CSV.
+ * \param threads most threads to parse CSV with.
+ * \return true for success, false for error.
+ */
+bool imported_dataset::load(unsigned int threads)
+{
+    int fd = open(m_filename, O_RDONLY);
+    if (fd < 0) {
+        perror(m_filename);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "%s: invalid file, unexpected CSV header.\n", m_filename);
+        close(fd);
+        return false;
+    }
+
+    // binary datasets are shared read-only as they are
+    size_t map_len = st.st_size;
+    const char *map = (const char *) mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(m_filename);
+        return false;
+    }
+
+    if (map_len >= sizeof(dataset_header) &&
+        memcmp(map, DATASET_MAGIC, sizeof(((dataset_header *) 0)->magic)) == 0) {
+        m_map = (void *) map;
+        m_map_len = map_len;
+        return load_binary();
+    }
+
+    bool ret = load_csv(map, map_len, threads);
+    munmap((void *) map, map_len);
+    return ret;
+}
+
+bool imported_dataset::load_binary(void)
+{
+    dataset_header h;
+
+    memcpy(&h, m_map, sizeof(h));
+    if (h.version != DATASET_VERSION || h.record_size != sizeof(dataset_record)) {
+        fprintf(stderr, "%s: unsupported dataset version %u.\n", m_filename, h.version);
+        return false;
+    }
+    if (h.index_offset % sizeof(uint64_t) != 0 || h.index_offset < sizeof(dataset_header) ||
+        h.index_offset > m_map_len ||
+        h.items > (m_map_len - h.index_offset) / sizeof(uint64_t) || h.items > UINT_MAX) {
+        fprintf(stderr, "%s: invalid dataset, index out of file.\n", m_filename);
+        return false;
+    }
+
+    m_records = (const char *) m_map;
+    m_index = (const uint64_t *) (m_records + h.index_offset);
+    m_items = h.items;
+
+    // records are checked once here, so items can be used unchecked
+    for (unsigned int i = 0; i < m_items; i++) {
+        if (m_index[i] % 4 != 0 || m_index[i] < sizeof(dataset_header) || m_index[i] > h.index_offset ||
+            m_index[i] + sizeof(dataset_record) > h.index_offset) {
+            fprintf(stderr, "%s: invalid dataset, item %u out of file.\n", m_filename, i);
+            m_items = 0;
+            return false;
+        }
+        const dataset_record *r = get_record(i);
+        if (r->nbytes < 2 ||
+            m_index[i] + sizeof(dataset_record) + r->nkey + r->nbytes > h.index_offset) {
+            fprintf(stderr, "%s: invalid dataset, item %u out of file.\n", m_filename, i);
+            m_items = 0;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool imported_dataset::load_csv(const char *map, size_t map_len, unsigned int threads)
+{
+    const char expected_header_line[] = "dumpflags, time, exptime";
+
+    madvise((void *) map, map_len, MADV_SEQUENTIAL);
+
+    const char *header_end = (const char *) memchr(map, '\n', map_len);
+    if (map_len < strlen(expected_header_line) ||
+        memcmp(map, expected_header_line, strlen(expected_header_line)) != 0 || header_end == NULL) {
+        fprintf(stderr, "%s: invalid file, unexpected CSV header.\n", m_filename);
+        return false;
+    }
+
+    // records take no more room parsed than as text
+    size_t data_start = header_end + 1 - map;
+    size_t data_len = map_len - data_start;
+    m_arena = (char *) malloc(data_len > 0 ? data_len : 1);
+    if (m_arena == NULL) {
+        fprintf(stderr, "%s: out of memory.\n", m_filename);
+        return false;
+    }
+
+    unsigned int count = data_len / IMPORT_MIN_CHUNK;
+    if (count > threads)
+        count = threads;
+    if (count < 1)
+        count = 1;
+
+    std::vector<import_chunk> chunks(count);
+    for (unsigned int i = 0; i < count; i++) {
+        import_chunk& c = chunks[i];
+        c.filename = m_filename;
+        c.map = map;
+        c.start = data_start + data_len / count * i;
+        c.end = i + 1 < count ? data_start + data_len / count * (i + 1) : map_len;
+        c.arena = m_arena;
+        c.ok = false;
+    }
+
+    // the quotes before every share tell where its first record starts
+    if (count > 1) {
+        import_run_threads(chunks, import_count_quotes);
+        bool odd = false;
+        for (unsigned int i = 0; i < count; i++) {
+            chunks[i].start_odd = odd;
+            odd = odd != chunks[i].quotes_odd;
+        }
+        for (unsigned int i = 1; i < count; i++) {
+            chunks[i].start = import_record_boundary(map, map_len, chunks[i].start, chunks[i].start_odd);
+            chunks[i - 1].end = chunks[i].start;
+        }
+    }
+    for (unsigned int i = 0; i < count; i++)
+        chunks[i].out_start = chunks[i].start - data_start;
+
+    import_run_threads(chunks, import_parse_chunk);
+
+    // close the gaps the shares left and index the items in file order
+    m_arena_len = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        import_chunk& c = chunks[i];
+        if (!c.ok)
+            return false;
+
+        memmove(m_arena + m_arena_len, m_arena + c.out_start, c.out_len);
+        for (unsigned int j = 0; j < c.offsets.size(); j++)
+            m_offsets.push_back(m_arena_len + c.offsets[j]);
+        m_arena_len += c.out_len;
+        std::vector<uint64_t>().swap(c.offsets);
+    }
+    if (m_offsets.size() > UINT_MAX) {
+        fprintf(stderr, "%s: too many items.\n", m_filename);
+        return false;
+    }
+
+    char *arena = (char *) realloc(m_arena, m_arena_len > 0 ? m_arena_len : 1);
+    if (arena != NULL)
+        m_arena = arena;
+
+    m_records = m_arena;
+    m_index = m_offsets.data();
+    m_items = m_offsets.size();
+
+    return true;
+}
+
+/** \brief write the items as a binary dataset.
+ * \return true for success, false for error.
+ */
+bool imported_dataset::save(const char *filename)
+{
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        perror(filename);
+        return false;
+    }
+
+    dataset_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DATASET_MAGIC, sizeof(h.magic));
+    h.version = DATASET_VERSION;
+    h.record_size = sizeof(dataset_record);
+    h.items = m_items;
+
+    // records keep their order and padding, so offsets only shift by the header
+    uint64_t records_start = sizeof(h);
+    uint64_t records_len = 0;
+    for (unsigned int i = 0; i < m_items; i++) {
+        const dataset_record *r = get_record(i);
+        records_len += (sizeof(dataset_record) + r->nkey + r->nbytes + 3) & ~3;
+    }
+    h.index_offset = (records_start + records_len + 7) & ~7ULL;
+
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (unsigned int i = 0; ok && i < m_items; i++) {
+        const dataset_record *r = get_record(i);
+        ok = fwrite(r, (sizeof(dataset_record) + r->nkey + r->nbytes + 3) & ~3, 1, f) == 1;
+    }
+    if (ok && h.index_offset > records_start + records_len) {
+        static const char pad[8] = { 0 };
+        ok = fwrite(pad, h.index_offset - records_start - records_len, 1, f) == 1;
+    }
+
+    uint64_t offset = records_start;
+    for (unsigned int i = 0; ok && i < m_items; i++) {
+        const dataset_record *r = get_record(i);
+        ok = fwrite(&offset, sizeof(offset), 1, f) == 1;
+        offset += (sizeof(dataset_record) + r->nkey + r->nbytes + 3) & ~3;
+    }
+
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok)
+        perror(filename);
+    return ok;
+}
+
+const char* imported_dataset::get_key(unsigned int pos, unsigned int *len) const
+{
+    if (pos >= m_items)
+        return NULL;
+
+    const dataset_record *r = get_record(pos);
+    if (len != NULL) *len = r->nkey;
+    return r->key;
+}
+
+const char* imported_dataset::get_data(unsigned int pos, unsigned int *nbytes) const
+{
+    if (pos >= m_items)
+        return NULL;
+
+    const dataset_record *r = get_record(pos);
+    if (nbytes != NULL) *nbytes = r->nbytes;
+    return r->key + r->nkey;
+}
+
+/////////////////////////////////////////////////////////////////////
+
 /** \brief file_writer constructor.
  * \param filename name of file to open.
  */
@@ -20,6 +20,8 @@
 #define _FILE_IO_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <vector>
 #include "item.h"
 
 /** Provides a mechanism to read a CSV-like memcache_dump file and extract memcache
@@ -44,6 +46,73 @@ public:
 };
 
 
+/** Binary dataset file, as written by --data-convert:
+ *
+ *   dataset_header
+ *   dataset_record, key, data (with trailing CRLF), padded to 4 bytes ...
+ *   uint64_t offset of every record, at header.index_offset
+ *
+ * All integers are in host byte order.
+ */
+#define DATASET_MAGIC       "MTDSET"
+#define DATASET_VERSION     1
+
+struct dataset_header {
+    char magic[6];
+    uint16_t version;
+    uint32_t record_size;       /** sizeof(dataset_record) */
+    uint32_t reserved;
+    uint64_t items;
+    uint64_t index_offset;
+};
+
+struct dataset_record {
+    uint32_t nkey;
+    uint32_t nbytes;            /** data size, including trailing CRLF */
+    uint32_t exptime;
+    char key[0];                /** data follows the key */
+};
+
+/** Loads a whole CSV-like memcache_dump file or a binary dataset into memory.
+ *
+ * A CSV file is mapped and split at record boundaries into one share per
+ * thread, which parse their records in parallel into dataset records.  A
+ * binary dataset is mapped read-only as is, shared by all client threads.
+ * Either way items are found through an index of record offsets, in file
+ * order.
+ */
+class imported_dataset {
+protected:
+    const char *m_filename;     /** name of file */
+    char *m_arena;              /** records parsed from CSV */
+    size_t m_arena_len;
+    std::vector<uint64_t> m_offsets;
+    void *m_map;                /** mapped binary dataset */
+    size_t m_map_len;
+
+    const char *m_records;
+    const uint64_t *m_index;
+    unsigned int m_items;
+
+    bool load_csv(const char *map, size_t map_len, unsigned int threads);
+    bool load_binary(void);
+    const dataset_record* get_record(unsigned int pos) const {
+        return (const dataset_record *) (m_records + m_index[pos]);
+    }
+public:
+    imported_dataset(const char *filename);
+    ~imported_dataset();
+
+    bool load(unsigned int threads);
+    bool save(const char *filename);
+    unsigned int size(void) const { return m_items; }
+    bool is_binary(void) const { return m_map != NULL; }
+
+    const char* get_key(unsigned int pos, unsigned int *len) const;
+    const char* get_data(unsigned int pos, unsigned int *nbytes) const;
+    unsigned int get_exptime(unsigned int pos) const { return get_record(pos)->exptime; }
+};
+
 /** Provides a mechanism to write memcache items into a CSV-like memcache_dump file.
  */
 class file_writer {
@@ -1,7 +0,0 @@
-// -*- c++ -*-
-
-#include "generator.h"
-
-// A uniformly-distributed int random generator
-// Used to seed the mt19937 pseudo-random generator
-std::random_device Generator::rd;
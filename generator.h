@@ -10,6 +10,8 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "prng.h"
+
 enum DistributionType { NONE = 0, POISSON, UNIFORM };
 
 // Generator types are based on distribution type
@@ -17,7 +19,7 @@ enum DistributionType { NONE = 0, POISSON, UNIFORM };
 // Now we support Poisson and Uniform, may support fixed
 class Generator {
   public:
-    Generator() {}
+    Generator(uint64_t seed = 0) : gen(seed) {}
     virtual ~Generator() {}
 
     virtual double generate() { return 0.0; }
@@ -25,14 +27,17 @@ class Generator {
     virtual bool set_lambda(double lambda) { return false; }
     virtual double get_lambda() { return 0.0; }
 
-    static std::random_device rd;
+  protected:
+    // Every generator draws from its own engine, seeded from the seed tree:
+    // a xoshiro256** is small enough to keep per connection
+    xoshiro256ss gen;
 };
 
 // Poisson distribution, lambda is creations per second
 class Poisson : public Generator {
   public:
-    Poisson(double _lambda = 1.0)
-        : lambda(_lambda), gen(rd()), expIG(_lambda) {}
+    Poisson(double _lambda = 1.0, uint64_t seed = 0)
+        : Generator(seed), lambda(_lambda), expIG(_lambda) {}
 
     virtual double generate() override {
         if (this->lambda <= 0.0)
@@ -55,7 +60,6 @@ class Poisson : public Generator {
 
   private:
     double lambda;
-    std::mt19937 gen;
     std::exponential_distribution<double> expIG;
 };
 
@@ -64,8 +68,8 @@ class Poisson : public Generator {
 // So we need to use 2.0 instead of 1.0 when setting max value.
 class Uniform : public Generator {
   public:
-    Uniform(double _lambda = 1.0)
-        : lambda(_lambda), gen(rd()), uniformIG(0, 2.0 / _lambda) {}
+    Uniform(double _lambda = 1.0, uint64_t seed = 0)
+        : Generator(seed), lambda(_lambda), uniformIG(0, 2.0 / _lambda) {}
 
     virtual double generate() override {
         if (this->lambda <= 0.0)
@@ -89,7 +93,6 @@ class Uniform : public Generator {
 
   private:
     double lambda;
-    std::mt19937 gen;
     std::uniform_real_distribution<double> uniformIG;
 };
 
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2011-2017 Redis Labs Ltd.
+ *
+ * This file is part of memtier_benchmark.
+ *
+ * memtier_benchmark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * memtier_benchmark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with memtier_benchmark.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#ifdef HAVE_ASSERT_H
+#include <assert.h>
+#endif
+
+#include "ketama_client.h"
+#include "memtier_benchmark.h"
+#include "obj_gen.h"
+#include "shard_connection.h"
+
+static void md5_block(uint32_t h[4], const unsigned char *block)
+{
+    static const uint32_t k[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+    static const unsigned int r[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+    };
+
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+        const unsigned char *p = block + i * 4;
+        w[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+
+        uint32_t tmp = d;
+        uint32_t x = a + f + k[i] + w[g];
+        d = c;
+        c = b;
+        b = b + ((x << r[i]) | (x >> (32 - r[i])));
+        a = tmp;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+}
+
+// RFC 1321 MD5, as ketama hashes both the server points and the keys with it.
+// Whole blocks are hashed in place; only the tail is padded, on the stack.
+static void md5_digest(const char *data, size_t len, unsigned char digest[16])
+{
+    uint32_t h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    size_t full = len & ~(size_t) 63;
+
+    for (size_t block = 0; block < full; block += 64)
+        md5_block(h, (const unsigned char *) data + block);
+
+    // the rest, 0x80, zero padding and the bit length fill one or two blocks
+    unsigned char tail[128];
+    size_t rest = len - full;
+    size_t tail_len = rest + 8 < 64 ? 64 : 128;
+    memcpy(tail, data + full, rest);
+    tail[rest] = 0x80;
+    memset(tail + rest + 1, 0, tail_len - rest - 1);
+    for (int i = 0; i < 8; i++)
+        tail[tail_len - 8 + i] = (unsigned char) ((unsigned long long) len * 8 >> (8 * i));
+
+    for (size_t block = 0; block < tail_len; block += 64)
+        md5_block(h, tail + block);
+
+    for (int i = 0; i < 16; i++)
+        digest[i] = (unsigned char) (h[i / 4] >> (8 * (i % 4)));
+}
+
+static inline uint32_t ketama_point(const unsigned char *digest, int n)
+{
+    return ((uint32_t) digest[3 + n * 4] << 24) | ((uint32_t) digest[2 + n * 4] << 16) |
+           ((uint32_t) digest[1 + n * 4] << 8) | digest[n * 4];
+}
+
+ketama_continuum::ketama_continuum(config_server_list& servers)
+{
+    unsigned int total_weight = servers.total_weight();
+    unsigned int count = servers.servers.size();
+
+    for (unsigned int i = 0; i < count; i++) {
+        config_server_list::server_item& server = servers.servers[i];
+        double share = (double) server.weight / total_weight;
+        unsigned int hashes = (unsigned int) floor(share * 40.0 * count);
+
+        for (unsigned int k = 0; k < hashes; k++) {
+            char name[300];
+            unsigned char digest[16];
+            int len = snprintf(name, sizeof(name), "%s:%u-%u", server.hostname.c_str(), server.port, k);
+
+            md5_digest(name, len, digest);
+            for (int n = 0; n < 4; n++) {
+                point p = { ketama_point(digest, n), i };
+                m_points.push_back(p);
+            }
+        }
+    }
+
+    std::sort(m_points.begin(), m_points.end());
+    assert(m_points.size() > 0);
+}
+
+unsigned int ketama_continuum::get_server(const char *key, unsigned int key_len) const
+{
+    unsigned char digest[16];
+    point p = { 0, 0 };
+
+    md5_digest(key, key_len, digest);
+    p.value = ketama_point(digest, 0);
+
+    // past the last point the continuum wraps around to the first
+    std::vector<point>::const_iterator i = std::lower_bound(m_points.begin(), m_points.end(), p);
+    if (i == m_points.end())
+        i = m_points.begin();
+
+    return i->server;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ketama_client::ketama_client(client_group* group) : client(group),
+    m_blocked(false), m_blocked_conn(0)
+{
+    if (m_obj_gen != NULL)
+        m_key = m_obj_gen->get_key_builder();
+
+    // the main connection goes to the first server, one more for every other
+    for (unsigned int i = 1; i < m_config->servers.servers.size(); i++) {
+        shard_connection* sc = new shard_connection(m_connections.size(), this,
+                                                    m_config, m_event_base,
+                                                    MAIN_CONNECTION->get_protocol());
+        m_connections.push_back(sc);
+    }
+    m_deferred.resize(m_connections.size());
+}
+
+ketama_client::~ketama_client()
+{
+}
+
+int ketama_client::connect(void)
+{
+    for (unsigned int i = 0; i < m_connections.size(); i++) {
+        config_server_list::server_item& server = m_config->servers.servers[i];
+        shard_connection* sc = m_connections[i];
+        struct connect_info ci;
+        char port_str[20];
+
+        if (server.addr->get_connect_info(&ci) != 0) {
+            benchmark_error_log("connect: resolve error: %s\n", server.addr->get_last_error());
+            return -1;
+        }
+
+        snprintf(port_str, sizeof(port_str)-1, "%u", server.port);
+        sc->set_address_port(server.hostname.c_str(), port_str);
+
+        int ret = sc->connect(&ci);
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
+// Without thread placement, every connection runs at the rate of a client
+// of the first server thread
+int ketama_client::prepare(void)
+{
+    if (connect() < 0) {
+        benchmark_error_log("prepare: failed to connect, test aborted.\n");
+        return -1;
+    }
+
+    this->serverTid = 0;
+    for (unsigned int i = 0; i < m_connections.size(); i++) {
+        m_connections[i]->serverTid = 0;
+        init_schedule(m_connections[i]);
+    }
+
+    pthread_mutex_lock(&client::m_skew_mutex);
+    client::real_conns += m_connections.size();
+    client::total_conns += m_connections.size();
+    pthread_mutex_unlock(&client::m_skew_mutex);
+
+    return 0;
+}
+
+unsigned int ketama_client::route_request(unsigned long long key_index)
+{
+    m_key.build(key_index);
+    return m_config->continuum->get_server(m_key.get_key(), m_key.get_len());
+}
+
+// m_key holds the key of req: route_request() just built it, or it was
+// rebuilt for a request that waited
+void ketama_client::send_request(struct timeval timestamp, unsigned int conn_id, const deferred_request& req)
+{
+    if (req.set) {
+        unsigned int value_len;
+        const char *value = m_obj_gen->get_value(req.key_index, &value_len);
+
+        m_connections[conn_id]->send_set_command(&timestamp, m_key.get_key(), m_key.get_len(),
+                                                 value, value_len, m_obj_gen->get_expiry(),
+                                                 m_config->data_offset);
+    } else {
+        m_connections[conn_id]->send_get_command(&timestamp, m_key.get_key(), m_key.get_len(), m_config->data_offset);
+    }
+}
+
+// The request goes out on the connection of its server right away when that
+// one has room, which the asking connection always has, and waits in the
+// queue of that connection otherwise.  False when the queue is full too.
+bool ketama_client::place_request(struct timeval timestamp, unsigned int conn_id,
+                                  unsigned int target, const deferred_request& req)
+{
+    if (m_deferred[target].empty() &&
+        (target == conn_id || m_connections[target]->request_slot_available())) {
+        send_request(timestamp, target, req);
+        return true;
+    }
+
+    if (m_deferred[target].size() < m_config->pipeline) {
+        m_deferred[target].push(req);
+        return true;
+    }
+
+    return false;
+}
+
+bool ketama_client::hold_pipeline(unsigned int conn_id)
+{
+    // requests already routed here are always sent
+    if (!m_deferred[conn_id].empty())
+        return false;
+
+    // a blocked request stops the others until its server takes it
+    if (m_blocked)
+        return conn_id != m_blocked_conn;
+
+    // don't exceed requests
+    if (m_config->requests && m_reqs_generated >= m_config->requests)
+        return true;
+
+    return false;
+}
+
+void ketama_client::create_request(struct timeval timestamp, unsigned int conn_id)
+{
+    // requests routed here while the connection was busy go first
+    if (!m_deferred[conn_id].empty()) {
+        deferred_request req = m_deferred[conn_id].front();
+        m_deferred[conn_id].pop();
+        m_key.build(req.key_index);
+        send_request(timestamp, conn_id, req);
+        return;
+    }
+
+    if (m_blocked) {
+        m_key.build(m_blocked_request.key_index);
+        if (place_request(timestamp, conn_id, m_blocked_conn, m_blocked_request))
+            m_blocked = false;
+        return;
+    }
+
+    // are we set or get? this depends on the ratio
+    deferred_request req;
+    if (m_set_ratio_count < m_config->ratio.a) {
+        req.set = true;
+        m_set_ratio_count++;
+        m_tot_set_ops++;
+    } else {
+        req.set = false;
+        m_get_ratio_count++;
+    }
+
+    // Overlap counters
+    if ((m_set_ratio_count == m_config->ratio.a) &&
+        (m_get_ratio_count == m_config->ratio.b)) {
+        m_get_ratio_count = m_set_ratio_count = 0;
+    }
+
+    req.key_index = m_obj_gen->get_key_index(obj_iter_type(m_config, req.set ? 0 : 2));
+    m_reqs_generated++;
+
+    unsigned int target = route_request(req.key_index);
+    if (!place_request(timestamp, conn_id, target, req)) {
+        m_blocked = true;
+        m_blocked_request = req;
+        m_blocked_conn = target;
+    }
+}
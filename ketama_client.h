@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2011-2017 Redis Labs Ltd.
+ *
+ * This file is part of memtier_benchmark.
+ *
+ * memtier_benchmark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * memtier_benchmark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with memtier_benchmark.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMTIER_BENCHMARK_KETAMA_CLIENT_H
+#define MEMTIER_BENCHMARK_KETAMA_CLIENT_H
+
+#include <stdint.h>
+#include <queue>
+#include "client.h"
+
+// The ketama continuum of libketama and libmemcached: 40 * servers points
+// per server, scaled by its weight, each point four words of the MD5 of
+// "host:port-N".  A key belongs to the first point at or after its hash.
+class ketama_continuum {
+protected:
+    struct point {
+        uint32_t value;
+        unsigned int server;
+
+        bool operator<(const point& other) const { return value < other.value; }
+    };
+
+    std::vector<point> m_points;
+public:
+    ketama_continuum(config_server_list& servers);
+
+    unsigned int get_server(const char *key, unsigned int key_len) const;
+};
+
+// A client with a connection to every --servers target, sending each key
+// to the server owning it on the continuum
+class ketama_client : public client {
+protected:
+    struct deferred_request {
+        unsigned long long key_index;
+        bool set;
+    };
+
+    // requests routed to a connection while it had no room, sent by it next
+    std::vector<std::queue<deferred_request> > m_deferred;
+    // the request waiting for room in its connection's queue, if any
+    bool m_blocked;
+    deferred_request m_blocked_request;
+    unsigned int m_blocked_conn;
+
+    key_builder m_key;
+
+    unsigned int route_request(unsigned long long key_index);
+    bool place_request(struct timeval timestamp, unsigned int conn_id,
+                       unsigned int target, const deferred_request& req);
+    void send_request(struct timeval timestamp, unsigned int conn_id, const deferred_request& req);
+
+public:
+    ketama_client(client_group* group);
+    virtual ~ketama_client();
+
+    virtual int prepare(void);
+    virtual int connect(void);
+
+    // client manager api's
+    virtual void create_request(struct timeval timestamp, unsigned int conn_id);
+    virtual bool hold_pipeline(unsigned int conn_id);
+};
+
+
+#endif //MEMTIER_BENCHMARK_KETAMA_CLIENT_H
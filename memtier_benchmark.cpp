@@ -40,6 +40,7 @@
 #include <stdexcept>
 
 #include "client.h"
+#include "ketama_client.h"
 #include "JSON_handler.h"
 #include "obj_gen.h"
 #include "memtier_benchmark.h"
@@ -51,6 +52,17 @@ bool master_finished = false;
 // QPS for each clieint on each server thread
 std::vector<double> qpsPerClient;
 
+// Migrations of the benchmark file, in order, and how many the master started
+migration* migrations = NULL;
+std::atomic<unsigned int> migrationsStarted(0);
+static unsigned int numMigrations = 0;
+
+// Hot windows of the H and L key patterns: the first from the key-hot
+// options, one more for every hotset of the benchmark file.  The master
+// switches between them, the object generators read the current one.
+static std::vector<key_hot_window> hotWindows(1);
+static std::atomic<unsigned int> hotWindowCurrent(0);
+
 // A global array to store SET latencies
 uint64_t* setLatencies = NULL;
 
@@ -80,6 +92,8 @@ struct Interval {
     int64_t timeToRun; // The time (in ns) we spend on this interval
     double requestsPerSecond;
     double skewFactor; // Proportion of the QPS to the first server thread
+    int migration; // Migration started with this interval, -1 if none
+    int hotWindow; // Hot window taking over with this interval, -1 if none
 } *intervals;
 
 static size_t numIntervals; // Num of intervals in the config file
@@ -97,6 +111,21 @@ static uint64_t timeval_to_ts(struct timeval a)
     return (uint64_t)a.tv_sec * 1000000 + (uint64_t)a.tv_usec;
 }
 
+// Resident memory of the process in bytes, 0 where /proc isn't available
+static unsigned long get_resident_bytes(void)
+{
+    unsigned long size, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f == NULL)
+        return 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(f);
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
 void benchmark_log_file_line(int level, const char *filename, unsigned int line, const char *fmt, ...)
 {
     if (level > log_level)
@@ -187,6 +216,8 @@ static void stop_video_decoding(struct benchmark_config *cfg) {
 static void config_print(FILE *file, struct benchmark_config *cfg)
 {
     char tmpbuf[512];
+    char tmpbuf2[512];
+    char tmpbuf3[512];
     
     fprintf(file,
         "server = %s\n"
@@ -200,35 +231,59 @@ static void config_print(FILE *file, struct benchmark_config *cfg)
         "requests = %u\n"
         "clients = %u\n"
         "threads = %u\n"
+        "conns_per_client = %u\n"
+        "conn_dispatch = %s\n"
+        "spread_conns = %s\n"
         "test_time = %u\n"
         "ratio = %u:%u\n"
+        "command_mix = %s\n"
+        "ds_fields = %u\n"
+        "ds_member_size = %u\n"
+        "ds_range = %u\n"
         "pipeline = %u\n"
+        "seed = %llu\n"
         "data_size = %u\n"
         "data_offset = %u\n"
         "random_data = %s\n"
+        "zero_copy = %s\n"
+        "zero_copy_threshold = %u\n"
+        "noreply = %s\n"
+        "noreply_fence = %u\n"
         "data_size_range = %u-%u\n"
         "data_size_list = %s\n"
         "data_size_pattern = %s\n"
+        "data_size_dist = %s\n"
+        "data_size_per_key = %s\n"
         "expiry_range = %u-%u\n"
         "data_import = %s\n"
+        "data_convert = %s\n"
         "data_verify = %s\n"
         "verify_only = %s\n"
         "generate_keys = %s\n"
         "key_prefix = %s\n"
+        "key_width = %u\n"
         "key_minimum = %llu\n"
         "key_maximum = %llu\n"
         "key_pattern = %s\n"
         "key_stddev = %f\n"
         "key_median = %f\n"
+        "key_zipf_exp = %f\n"
+        "key_zipf_scramble = %s\n"
+        "key_hot_start = %llu\n"
+        "key_hot_size = %llu\n"
+        "key_hot_fraction = %f\n"
         "reconnect_interval = %u\n"
         "multi_key_get = %u\n"
+        "udp = %s\n"
+        "udp_timeout = %u\n"
         "authenticate = %s\n"
         "select-db = %d\n"
         "no-expiry = %s\n"
         "wait-ratio = %u:%u\n"
         "num-slaves = %u-%u\n"
         "wait-timeout = %u-%u\n"
-        "json-out-file = %s\n",
+        "json-out-file = %s\n"
+        "servers = %s\n",
         cfg->server,
         cfg->port,
         cfg->unix_socket,
@@ -240,40 +295,66 @@ static void config_print(FILE *file, struct benchmark_config *cfg)
         cfg->requests,
         cfg->clients,
         cfg->threads,
+        cfg->conns_per_client,
+        cfg->conn_dispatch == dispatch_round_robin ? "round-robin" : "least-outstanding",
+        cfg->spread_conns ? "yes" : "no",
         cfg->test_time,
         cfg->ratio.a, cfg->ratio.b,
+        cfg->command_mix.print(tmpbuf2, sizeof(tmpbuf2)-1),
+        cfg->ds_fields,
+        cfg->ds_member_size,
+        cfg->ds_range,
         cfg->pipeline,
+        cfg->seed,
         cfg->data_size,
         cfg->data_offset,
         cfg->random_data ? "yes" : "no",
+        cfg->zero_copy ? "yes" : "no",
+        cfg->zero_copy_threshold,
+        cfg->noreply ? "yes" : "no",
+        cfg->noreply_fence,
         cfg->data_size_range.min, cfg->data_size_range.max,
         cfg->data_size_list.print(tmpbuf, sizeof(tmpbuf)-1),
         cfg->data_size_pattern,
+        cfg->data_size_dist ? cfg->data_size_dist : "",
+        cfg->data_size_per_key ? "yes" : "no",
         cfg->expiry_range.min, cfg->expiry_range.max,
         cfg->data_import,
+        cfg->data_convert ? cfg->data_convert : "",
         cfg->data_verify ? "yes" : "no",
         cfg->verify_only ? "yes" : "no",
         cfg->generate_keys ? "yes" : "no",
         cfg->key_prefix,
+        cfg->key_width,
         cfg->key_minimum,
         cfg->key_maximum,
         cfg->key_pattern,
         cfg->key_stddev,
         cfg->key_median,
+        cfg->key_zipf_exp,
+        cfg->key_zipf_scramble ? "yes" : "no",
+        cfg->key_hot_start,
+        cfg->key_hot_size,
+        cfg->key_hot_fraction,
         cfg->reconnect_interval,
         cfg->multi_key_get,
+        cfg->udp ? "yes" : "no",
+        cfg->udp_timeout,
         cfg->authenticate ? cfg->authenticate : "",
         cfg->select_db,
         cfg->no_expiry ? "yes" : "no",
         cfg->wait_ratio.a, cfg->wait_ratio.b,
         cfg->num_slaves.min, cfg->num_slaves.max,
         cfg->wait_timeout.min, cfg->wait_timeout.max,
-        cfg->json_out_file);
+        cfg->json_out_file,
+        cfg->servers.print(tmpbuf3, sizeof(tmpbuf3)-1));
 }
 
 static void config_print_to_json(json_handler * jsonhandler, struct benchmark_config *cfg)
 {
     char tmpbuf[512];
+    char tmpbuf2[512];
+    char tmpbuf3[512];
     
     jsonhandler->open_nesting("configuration");  
 
@@ -288,34 +369,58 @@ static void config_print_to_json(json_handler * jsonhandler, struct benchmark_co
     jsonhandler->write_obj("requests"          ,"%u",          	cfg->requests);
     jsonhandler->write_obj("clients"           ,"%u",          	cfg->clients);
     jsonhandler->write_obj("threads"           ,"%u",          	cfg->threads);
+    jsonhandler->write_obj("conns_per_client"  ,"%u",          	cfg->conns_per_client);
+    jsonhandler->write_obj("conn_dispatch"     ,"\"%s\"",      	cfg->conn_dispatch == dispatch_round_robin ? "round-robin" : "least-outstanding");
+    jsonhandler->write_obj("spread_conns"      ,"\"%s\"",      	cfg->spread_conns ? "true" : "false");
     jsonhandler->write_obj("test_time"         ,"%u",          	cfg->test_time);
     jsonhandler->write_obj("ratio"             ,"\"%u:%u\"",   	cfg->ratio.a, cfg->ratio.b);
+    jsonhandler->write_obj("command_mix"       ,"\"%s\"",      	cfg->command_mix.print(tmpbuf2, sizeof(tmpbuf2)-1));
+    jsonhandler->write_obj("ds_fields"         ,"%u",          	cfg->ds_fields);
+    jsonhandler->write_obj("ds_member_size"    ,"%u",          	cfg->ds_member_size);
+    jsonhandler->write_obj("ds_range"          ,"%u",          	cfg->ds_range);
     jsonhandler->write_obj("pipeline"          ,"%u",          	cfg->pipeline);
+    jsonhandler->write_obj("seed"              ,"%llu",         cfg->seed);
     jsonhandler->write_obj("data_size"         ,"%u",          	cfg->data_size);
     jsonhandler->write_obj("data_offset"       ,"%u",          	cfg->data_offset);
     jsonhandler->write_obj("random_data"       ,"\"%s\"",      	cfg->random_data ? "true" : "false");
+    jsonhandler->write_obj("zero_copy"         ,"\"%s\"",      	cfg->zero_copy ? "true" : "false");
+    jsonhandler->write_obj("zero_copy_threshold","%u",          	cfg->zero_copy_threshold);
+    jsonhandler->write_obj("noreply"           ,"\"%s\"",      	cfg->noreply ? "true" : "false");
+    jsonhandler->write_obj("noreply_fence"     ,"%u",          	cfg->noreply_fence);
     jsonhandler->write_obj("data_size_range"   ,"\"%u:%u\"",	cfg->data_size_range.min, cfg->data_size_range.max);
     jsonhandler->write_obj("data_size_list"    ,"\"%s\"",   	cfg->data_size_list.print(tmpbuf, sizeof(tmpbuf)-1));
     jsonhandler->write_obj("data_size_pattern" ,"\"%s\"", 		cfg->data_size_pattern);
+    jsonhandler->write_obj("data_size_dist"    ,"\"%s\"",       cfg->data_size_dist ? cfg->data_size_dist : "");
+    jsonhandler->write_obj("data_size_per_key" ,"%s",           cfg->data_size_per_key ? "true" : "false");
     jsonhandler->write_obj("expiry_range"      ,"\"%u:%u\"",   	cfg->expiry_range.min, cfg->expiry_range.max);
     jsonhandler->write_obj("data_import"       ,"\"%s\"",       cfg->data_import);
+    jsonhandler->write_obj("data_convert"      ,"\"%s\"",       cfg->data_convert ? cfg->data_convert : "");
     jsonhandler->write_obj("data_verify"       ,"\"%s\"",       cfg->data_verify ? "true" : "false");
     jsonhandler->write_obj("verify_only"       ,"\"%s\"",       cfg->verify_only ? "true" : "false");
     jsonhandler->write_obj("generate_keys"     ,"\"%s\"",     	cfg->generate_keys ? "true" : "false");
     jsonhandler->write_obj("key_prefix"        ,"\"%s\"",       cfg->key_prefix);
+    jsonhandler->write_obj("key_width"         ,"%u",           cfg->key_width);
     jsonhandler->write_obj("key_minimum"       ,"%11u",        	cfg->key_minimum);
     jsonhandler->write_obj("key_maximum"       ,"%11u",        	cfg->key_maximum);
     jsonhandler->write_obj("key_pattern"       ,"\"%s\"",       cfg->key_pattern);
     jsonhandler->write_obj("key_stddev"        ,"%f",           cfg->key_stddev);
     jsonhandler->write_obj("key_median"        ,"%f",           cfg->key_median);
+    jsonhandler->write_obj("key_zipf_exp"      ,"%f",           cfg->key_zipf_exp);
+    jsonhandler->write_obj("key_zipf_scramble" ,"%s",           cfg->key_zipf_scramble ? "true" : "false");
+    jsonhandler->write_obj("key_hot_start"     ,"%llu",         cfg->key_hot_start);
+    jsonhandler->write_obj("key_hot_size"      ,"%llu",         cfg->key_hot_size);
+    jsonhandler->write_obj("key_hot_fraction"  ,"%f",           cfg->key_hot_fraction);
     jsonhandler->write_obj("reconnect_interval","%u",    		cfg->reconnect_interval);
     jsonhandler->write_obj("multi_key_get"     ,"%u",         	cfg->multi_key_get);
+    jsonhandler->write_obj("udp"               ,"\"%s\"",       cfg->udp ? "true" : "false");
+    jsonhandler->write_obj("udp_timeout"       ,"%u",           cfg->udp_timeout);
     jsonhandler->write_obj("authenticate"      ,"\"%s\"",      	cfg->authenticate ? cfg->authenticate : "");
     jsonhandler->write_obj("select-db"         ,"%d",           cfg->select_db);
     jsonhandler->write_obj("no-expiry"         ,"\"%s\"",       cfg->no_expiry ? "true" : "false");
     jsonhandler->write_obj("wait-ratio"        ,"\"%u:%u\"",    cfg->wait_ratio.a, cfg->wait_ratio.b);
     jsonhandler->write_obj("num-slaves"        ,"\"%u:%u\"",    cfg->num_slaves.min, cfg->num_slaves.max);
     jsonhandler->write_obj("wait-timeout"      ,"\"%u-%u\"",   	cfg->wait_timeout.min, cfg->wait_timeout.max);
+    jsonhandler->write_obj("servers"           ,"\"%s\"",      	cfg->servers.print(tmpbuf3, sizeof(tmpbuf3)-1));
 
     jsonhandler->close_nesting();
 }
@@ -334,12 +439,25 @@ static void config_init_defaults(struct benchmark_config *cfg)
         cfg->clients = 50;
     if (!cfg->threads)
         cfg->threads = 4;
-    if (!cfg->ratio.is_defined())
+    if (!cfg->conns_per_client)
+        cfg->conns_per_client = 1;
+    if (!cfg->ratio.is_defined() && !cfg->command_mix.is_defined())
         cfg->ratio = config_ratio("1:10");
     if (!cfg->pipeline)
         cfg->pipeline = 1;
-    if (!cfg->data_size && !cfg->data_size_list.is_defined() && !cfg->data_size_range.is_defined() && !cfg->data_import)
+    if (!cfg->ds_fields)
+        cfg->ds_fields = 10;
+    if (!cfg->ds_range)
+        cfg->ds_range = 10;
+    if (!cfg->udp_timeout)
+        cfg->udp_timeout = 100;
+    if (!cfg->noreply_fence)
+        cfg->noreply_fence = 100;
+    if (!cfg->data_size && !cfg->data_size_list.is_defined() && !cfg->data_size_range.is_defined() &&
+        !cfg->data_size_dist && !cfg->data_import)
         cfg->data_size = 32;
+    if (!cfg->ds_member_size)
+        cfg->ds_member_size = cfg->data_size ? cfg->data_size : 32;
     if (cfg->generate_keys || !cfg->data_import) {
         if (!cfg->key_prefix)
             cfg->key_prefix = "memtier-";
@@ -384,6 +502,9 @@ static bool verify_cluster_option(struct benchmark_config *cfg) {
     } else if (cfg->wait_ratio.is_defined()) {
         fprintf(stderr, "error: cluster mode dose not support wait-ratio option.\n");
         return false;
+    } else if (cfg->command_mix.is_defined()) {
+        fprintf(stderr, "error: cluster mode dose not support command-mix option.\n");
+        return false;
     } else if (cfg->protocol && strcmp(cfg->protocol, "redis")) {
         fprintf(stderr, "error: cluster mode supported only in redis protocol.\n");
         return false;
@@ -392,34 +513,83 @@ static bool verify_cluster_option(struct benchmark_config *cfg) {
     return true;
 }
 
+static bool verify_servers_option(struct benchmark_config *cfg) {
+    if (cfg->cluster_mode) {
+        fprintf(stderr, "error: servers cannot be used with cluster-mode.\n");
+        return false;
+    } else if (cfg->reconnect_interval || cfg->multi_key_get || cfg->wait_ratio.is_defined() ||
+               cfg->command_mix.is_defined()) {
+        fprintf(stderr, "error: servers does not support reconnect-interval, multi-key-get, wait-ratio or command-mix.\n");
+        return false;
+    } else if (cfg->unix_socket || cfg->udp || cfg->noreply) {
+        fprintf(stderr, "error: servers does not support unix-socket, udp or noreply.\n");
+        return false;
+    } else if (cfg->conns_per_client > 1 || cfg->idle_conns > 0 || cfg->churn_rate > 0) {
+        fprintf(stderr, "error: servers cannot be used with conns-per-client, idle-conns or churn-rate.\n");
+        return false;
+    } else if (cfg->skew_level > 0 || cfg->server_threads > 1) {
+        fprintf(stderr, "error: servers cannot be used with skew-level or server-threads.\n");
+        return false;
+    } else if (cfg->data_import) {
+        // routing builds generated keys and values of its own
+        fprintf(stderr, "error: servers cannot be used with data-import.\n");
+        return false;
+    }
+
+    return true;
+}
+
 static int config_parse_args(int argc, char *argv[], struct benchmark_config *cfg)
 {
     enum extended_options {
         o_test_time = 128,
+        o_conns_per_client,
+        o_conn_dispatch,
+        o_spread_conns,
         o_ratio,
+        o_command_mix,
+        o_ds_fields,
+        o_ds_member_size,
+        o_ds_range,
         o_pipeline,
         o_data_size_range,
         o_data_size_list,
         o_data_size_pattern,
+        o_data_size_dist,
+        o_data_size_per_key,
         o_data_offset,
+        o_zero_copy,
+        o_zero_copy_threshold,
+        o_noreply,
+        o_noreply_fence,
         o_expiry_range,
         o_data_import,
+        o_data_convert,
         o_data_verify,
         o_verify_only,
         o_key_prefix,
+        o_key_width,
         o_key_minimum,
         o_key_maximum,
         o_key_pattern,
         o_key_stddev,
         o_key_median,
+        o_key_zipf_exp,
+        o_key_zipf_scramble,
+        o_key_hot_start,
+        o_key_hot_size,
+        o_key_hot_fraction,
         o_show_config,
         o_hide_histogram,
         o_distinct_client_seed,
         o_randomize,
+        o_seed,
         o_client_stats,
         o_reconnect_interval,
         o_generate_keys,
         o_multi_key_get,
+        o_udp,
+        o_udp_timeout,
         o_select_db,
         o_no_expiry,
         o_wait_ratio,
@@ -427,7 +597,12 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
         o_wait_timeout, 
         o_json_out_file,
         o_cluster_mode,
+        o_servers,
         o_server_threads,
+        o_idle_conns,
+        o_idle_rate,
+        o_churn_rate,
+        o_churn_conns,
         o_config_file,
         o_ir_distribution,
         o_log_dir,
@@ -450,31 +625,54 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
         { "hide-histogram",             0, 0, o_hide_histogram },
         { "distinct-client-seed",       0, 0, o_distinct_client_seed },
         { "randomize",                  0, 0, o_randomize },
+        { "seed",                       1, 0, o_seed },
         { "requests",                   1, 0, 'n' },
         { "clients",                    1, 0, 'c' },
         { "threads",                    1, 0, 't' },        
+        { "conns-per-client",           1, 0, o_conns_per_client },
+        { "conn-dispatch",              1, 0, o_conn_dispatch },
+        { "spread-conns",               0, 0, o_spread_conns },
         { "test-time",                  1, 0, o_test_time },
         { "ratio",                      1, 0, o_ratio },
+        { "command-mix",                1, 0, o_command_mix },
+        { "ds-fields",                  1, 0, o_ds_fields },
+        { "ds-member-size",             1, 0, o_ds_member_size },
+        { "ds-range",                   1, 0, o_ds_range },
         { "pipeline",                   1, 0, o_pipeline },
         { "data-size",                  1, 0, 'd' },
         { "data-offset",                1, 0, o_data_offset },
         { "random-data",                0, 0, 'R' },
+        { "zero-copy",                  0, 0, o_zero_copy },
+        { "zero-copy-threshold",        1, 0, o_zero_copy_threshold },
+        { "noreply",                    0, 0, o_noreply },
+        { "noreply-fence",              1, 0, o_noreply_fence },
         { "data-size-range",            1, 0, o_data_size_range },
         { "data-size-list",             1, 0, o_data_size_list },
         { "data-size-pattern",          1, 0, o_data_size_pattern },
+        { "data-size-dist",             1, 0, o_data_size_dist },
+        { "data-size-per-key",          0, 0, o_data_size_per_key },
         { "expiry-range",               1, 0, o_expiry_range },
         { "data-import",                1, 0, o_data_import },
+        { "data-convert",               1, 0, o_data_convert },
         { "data-verify",                0, 0, o_data_verify },
         { "verify-only",                0, 0, o_verify_only },
         { "generate-keys",              0, 0, o_generate_keys },
         { "key-prefix",                 1, 0, o_key_prefix },
+        { "key-width",                  1, 0, o_key_width },
         { "key-minimum",                1, 0, o_key_minimum },
         { "key-maximum",                1, 0, o_key_maximum },
         { "key-pattern",                1, 0, o_key_pattern },
         { "key-stddev",                 1, 0, o_key_stddev },
         { "key-median",                 1, 0, o_key_median },
+        { "key-zipf-exp",               1, 0, o_key_zipf_exp },
+        { "key-zipf-scramble",          0, 0, o_key_zipf_scramble },
+        { "key-hot-start",              1, 0, o_key_hot_start },
+        { "key-hot-size",               1, 0, o_key_hot_size },
+        { "key-hot-fraction",           1, 0, o_key_hot_fraction },
         { "reconnect-interval",         1, 0, o_reconnect_interval },
         { "multi-key-get",              1, 0, o_multi_key_get },
+        { "udp",                        0, 0, o_udp },
+        { "udp-timeout",                1, 0, o_udp_timeout },
         { "authenticate",               1, 0, 'a' },
         { "select-db",                  1, 0, o_select_db },
         { "no-expiry",                  0, 0, o_no_expiry },
@@ -483,11 +681,16 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
         { "wait-timeout",               1, 0, o_wait_timeout },
         { "json-out-file",              1, 0, o_json_out_file },
         { "cluster-mode",                0, 0, o_cluster_mode },
+        { "servers",                    1, 0, o_servers },
         { "help",                       0, 0, 'h' },
         { "version",                    0, 0, 'v' },
         { "blocking",                   0, 0, 'b' },
         { "skew-level",                 1, 0, 'k'},
         { "server-threads",             1, 0, o_server_threads },
+        { "idle-conns",                 1, 0, o_idle_conns },
+        { "idle-rate",                  1, 0, o_idle_rate },
+        { "churn-rate",                 1, 0, o_churn_rate },
+        { "churn-conns",                1, 0, o_churn_conns },
         { "config-file",                1, 0, o_config_file},
         { "ir-dist",                    1, 0, o_ir_distribution},
         { "log-dir",                    1, 0, o_log_dir},
@@ -501,6 +704,7 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
     int option_index;
     int c;
     char *endptr;
+    bool seed_given = false;
     while ((c = getopt_long(argc, argv, 
                 "s:S:p:P:o:x:DRn:c:t:d:a:hbk:", long_options, &option_index)) != -1)
     {
@@ -535,6 +739,38 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                         return -1;
                     }
                     break;
+                case o_idle_conns:
+                    endptr = NULL;
+                    cfg->idle_conns = (int) strtoul(optarg, &endptr, 10);
+                    if (cfg->idle_conns < 1 || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: idle-conns must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
+                case o_idle_rate:
+                    endptr = NULL;
+                    cfg->idle_rate = strtod(optarg, &endptr);
+                    if (cfg->idle_rate < 0 || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: idle-rate must be a positive number.\n");
+                        return -1;
+                    }
+                    break;
+                case o_churn_rate:
+                    endptr = NULL;
+                    cfg->churn_rate = strtod(optarg, &endptr);
+                    if (cfg->churn_rate <= 0 || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: churn-rate must be a positive number.\n");
+                        return -1;
+                    }
+                    break;
+                case o_churn_conns:
+                    endptr = NULL;
+                    cfg->churn_conns = (int) strtoul(optarg, &endptr, 10);
+                    if (cfg->churn_conns < 1 || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: churn-conns must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
                 case o_config_file:
                     cfg->config_file = optarg;
                     break;
@@ -584,8 +820,9 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                 case 'P':
                     if (strcmp(optarg, "memcache_text") &&
                         strcmp(optarg, "memcache_binary") &&
+                        strcmp(optarg, "memcache_meta") &&
                         strcmp(optarg, "redis")) {
-                                fprintf(stderr, "error: supported protocols are 'memcache_text', 'memcache_binary' and 'redis'.\n");
+                                fprintf(stderr, "error: supported protocols are 'memcache_text', 'memcache_binary', 'memcache_meta' and 'redis'.\n");
                                 return -1;
                     }
                     cfg->protocol = optarg;
@@ -620,6 +857,15 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                     srandom(generate_random_seed());
                     cfg->randomize = random();
                     break;
+                case o_seed:
+                    endptr = NULL;
+                    cfg->seed = strtoull(optarg, &endptr, 10);
+                    if (!endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: seed must be a number.\n");
+                        return -1;
+                    }
+                    seed_given = true;
+                    break;
                 case 'n':
                     endptr = NULL;
                     if (strcmp(optarg, "allkeys")==0)
@@ -652,6 +898,27 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                         return -1;
                     }
                     break;
+                case o_conns_per_client:
+                    endptr = NULL;
+                    cfg->conns_per_client = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->conns_per_client || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: conns-per-client must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
+                case o_conn_dispatch:
+                    if (strcmp(optarg, "least-outstanding") == 0) {
+                        cfg->conn_dispatch = dispatch_least_outstanding;
+                    } else if (strcmp(optarg, "round-robin") == 0) {
+                        cfg->conn_dispatch = dispatch_round_robin;
+                    } else {
+                        fprintf(stderr, "error: conn-dispatch must be least-outstanding or round-robin.\n");
+                        return -1;
+                    }
+                    break;
+                case o_spread_conns:
+                    cfg->spread_conns = true;
+                    break;
                 case o_test_time:
                     endptr = NULL;
                     cfg->test_time = (unsigned int) strtoul(optarg, &endptr, 10);
@@ -671,6 +938,37 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                         return -1;
                     }
                     break;
+                case o_command_mix:
+                    cfg->command_mix = config_command_mix(optarg);
+                    if (!cfg->command_mix.is_defined()) {
+                        fprintf(stderr, "error: command-mix must be expressed as CMD:WEIGHT[,CMD:WEIGHT...].\n");
+                        return -1;
+                    }
+                    break;
+                case o_ds_fields:
+                    endptr = NULL;
+                    cfg->ds_fields = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->ds_fields || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: ds-fields must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
+                case o_ds_member_size:
+                    endptr = NULL;
+                    cfg->ds_member_size = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->ds_member_size || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: ds-member-size must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
+                case o_ds_range:
+                    endptr = NULL;
+                    cfg->ds_range = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->ds_range || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: ds-range must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
                 case o_pipeline:
                     endptr = NULL;
                     cfg->pipeline = (unsigned int) strtoul(optarg, &endptr, 10);
@@ -690,6 +988,30 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                 case 'R':
                     cfg->random_data = true;
                     break;
+                case o_zero_copy:
+                    cfg->zero_copy = true;
+                    break;
+                case o_zero_copy_threshold:
+                    endptr = NULL;
+                    cfg->zero_copy_threshold = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->zero_copy_threshold || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: zero-copy-threshold must be greater than zero.\n");
+                        return -1;
+                    }
+                    cfg->zero_copy = true;
+                    break;
+                case o_noreply:
+                    cfg->noreply = true;
+                    break;
+                case o_noreply_fence:
+                    endptr = NULL;
+                    cfg->noreply_fence = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->noreply_fence || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: noreply-fence must be greater than zero.\n");
+                        return -1;
+                    }
+                    cfg->noreply = true;
+                    break;
                 case o_data_offset:
                     endptr = NULL;
                     cfg->data_offset = (unsigned int) strtoul(optarg, &endptr, 10);
@@ -727,9 +1049,18 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                             return -1;
                     }
                     break;
+                case o_data_size_dist:
+                    cfg->data_size_dist = optarg;
+                    break;
+                case o_data_size_per_key:
+                    cfg->data_size_per_key = 1;
+                    break;
                 case o_data_import:
                     cfg->data_import = optarg;
                     break;
+                case o_data_convert:
+                    cfg->data_convert = optarg;
+                    break;
                 case o_data_verify:
                     cfg->data_verify = 1;
                     break;
@@ -740,6 +1071,14 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                 case o_key_prefix:
                     cfg->key_prefix = optarg;
                     break;
+                case o_key_width:
+                    endptr = NULL;
+                    cfg->key_width = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->key_width || cfg->key_width > 20 || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: key-width must be between 1 and 20.\n");
+                        return -1;
+                    }
+                    break;
                 case o_key_minimum:
                     endptr = NULL;
                     cfg->key_minimum = strtoull(optarg, &endptr, 10);
@@ -772,12 +1111,51 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                         return -1;
                     }
                     break;
+                case o_key_zipf_exp:
+                    endptr = NULL;
+                    cfg->key_zipf_exp = strtod(optarg, &endptr);
+                    if (cfg->key_zipf_exp <= 0 || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: key-zipf-exp must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
+                case o_key_zipf_scramble:
+                    cfg->key_zipf_scramble = 1;
+                    break;
+                case o_key_hot_start:
+                    endptr = NULL;
+                    cfg->key_hot_start = strtoull(optarg, &endptr, 10);
+                    if (!endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: key-hot-start must be a key ID.\n");
+                        return -1;
+                    }
+                    break;
+                case o_key_hot_size:
+                    endptr = NULL;
+                    cfg->key_hot_size = strtoull(optarg, &endptr, 10);
+                    if (!cfg->key_hot_size || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: key-hot-size must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
+                case o_key_hot_fraction:
+                    endptr = NULL;
+                    cfg->key_hot_fraction = strtod(optarg, &endptr);
+                    if (cfg->key_hot_fraction <= 0 || cfg->key_hot_fraction > 1 || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: key-hot-fraction must be in the range (0, 1].\n");
+                        return -1;
+                    }
+                    break;
                 case o_key_pattern:
                     cfg->key_pattern = optarg;
                     if (strlen(cfg->key_pattern) != 3 || cfg->key_pattern[1] != ':' ||
-                        (cfg->key_pattern[0] != 'R' && cfg->key_pattern[0] != 'S' && cfg->key_pattern[0] != 'G' && cfg->key_pattern[0] != 'P') ||
-                        (cfg->key_pattern[2] != 'R' && cfg->key_pattern[2] != 'S' && cfg->key_pattern[2] != 'G' && cfg->key_pattern[2] != 'P')) {
-                            fprintf(stderr, "error: key-pattern must be in the format of [S/R/G]:[S/R/G].\n");
+                        !strchr("RSGPZH", cfg->key_pattern[0]) || !strchr("RSGPZHL", cfg->key_pattern[2])) {
+                            fprintf(stderr, "error: key-pattern must be in the format of [S/R/G/Z/H]:[S/R/G/Z/H/L].\n");
+                            return -1;
+                    }
+                    // only sequential SETs make the keys behind the latest one the recently SET ones
+                    if (cfg->key_pattern[2] == 'L' && !strchr("SP", cfg->key_pattern[0])) {
+                            fprintf(stderr, "error: the L key-pattern needs a sequential (S or P) SET pattern.\n");
                             return -1;
                     }
                     break;
@@ -800,6 +1178,17 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                         return -1;
                     }
                     break;
+                case o_udp:
+                    cfg->udp = true;
+                    break;
+                case o_udp_timeout:
+                    endptr = NULL;
+                    cfg->udp_timeout = (unsigned int) strtoul(optarg, &endptr, 10);
+                    if (!cfg->udp_timeout || !endptr || *endptr != '\0') {
+                        fprintf(stderr, "error: udp-timeout must be greater than zero.\n");
+                        return -1;
+                    }
+                    break;
                 case 'a':
                     cfg->authenticate = optarg;
                     break;
@@ -840,6 +1229,13 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                 case o_cluster_mode:
                     cfg->cluster_mode = true;
                     break;
+                case o_servers:
+                    cfg->servers = config_server_list(optarg);
+                    if (!cfg->servers.is_defined()) {
+                        fprintf(stderr, "error: servers must be expressed as host:port[:weight],...\n");
+                        return -1;
+                    }
+                    break;
             default:
                     return -1;
                     break;
@@ -848,6 +1244,34 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
 
     if (cfg->cluster_mode && !verify_cluster_option(cfg))
         return -1;
+    if (cfg->servers.is_defined() && !verify_servers_option(cfg))
+        return -1;
+    if (cfg->command_mix.is_defined() && cfg->ratio.is_defined()) {
+        fprintf(stderr, "error: --command-mix and --ratio are mutually exclusive.\n");
+        return -1;
+    }
+    if (cfg->noreply && (!cfg->protocol || strncmp(cfg->protocol, "memcache_", 9) != 0)) {
+        fprintf(stderr, "error: noreply is supported only with the memcache protocols.\n");
+        return -1;
+    }
+    if (cfg->noreply && strcmp(cfg->protocol, "memcache_text") == 0) {
+        // memcached still answers a text noreply SET it failed to store,
+        // with nothing to tell which request the error belongs to
+        fprintf(stderr, "error: noreply is not supported with memcache_text; use memcache_binary or memcache_meta.\n");
+        return -1;
+    }
+    if (cfg->noreply && cfg->reconnect_interval) {
+        fprintf(stderr, "error: noreply cannot be used with reconnect-interval.\n");
+        return -1;
+    }
+    if (cfg->udp && (!cfg->protocol || strncmp(cfg->protocol, "memcache_", 9) != 0)) {
+        fprintf(stderr, "error: udp is supported only with the memcache protocols.\n");
+        return -1;
+    }
+    if (cfg->conns_per_client > 1 && (cfg->cluster_mode || cfg->reconnect_interval || cfg->noreply)) {
+        fprintf(stderr, "error: conns-per-client cannot be used with cluster-mode, reconnect-interval or noreply.\n");
+        return -1;
+    }
     if (cfg->blocking) {
         fprintf(stderr, "[CONFIG] In blocking libevent loop mode!\n");
     } else {
@@ -865,6 +1289,22 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
                     cfg->skew_level, cfg->server_threads);
         }
     }
+    if (cfg->idle_conns > 0) {
+        fprintf(stderr, "[CONFIG] Idle connections: %d per server thread, %.2f keepalives/sec each\n",
+                cfg->idle_conns, cfg->idle_rate);
+    } else if (cfg->idle_rate > 0) {
+        fprintf(stderr, "error: idle-rate is used only with idle-conns.\n");
+        return -1;
+    }
+    if (cfg->churn_rate > 0) {
+        if (!cfg->churn_conns)
+            cfg->churn_conns = 100;
+        fprintf(stderr, "[CONFIG] Churn: %.2f connections/sec, at most %d at once\n",
+                cfg->churn_rate, cfg->churn_conns);
+    } else if (cfg->churn_conns > 0) {
+        fprintf(stderr, "error: churn-conns is used only with churn-rate.\n");
+        return -1;
+    }
     if (cfg->config_file == NULL) {
         fprintf(stderr, "No benchmark file! use default mode. \n");
         master_finished = true;
@@ -910,6 +1350,15 @@ static int config_parse_args(int argc, char *argv[], struct benchmark_config *cf
     } else {
         fprintf(stderr, "No background videos \n");
     }
+
+    if (cfg->randomize) {
+        if (seed_given) {
+            fprintf(stderr, "error: use either randomize or seed.\n");
+            return -1;
+        }
+        cfg->seed = cfg->randomize;
+        fprintf(stderr, "[CONFIG] random seed: %llu (--seed=%llu repeats this run)\n", cfg->seed, cfg->seed);
+    }
     return 0;
 }
 
@@ -923,7 +1372,7 @@ void usage() {
             "  -S, --unix-socket=SOCKET       UNIX Domain socket name (default: none)\n"
             "  -P, --protocol=PROTOCOL        Protocol to use (default: redis).  Other\n"
             "                                 supported protocols are memcache_text,\n"
-            "                                 memcache_binary.\n"
+            "                                 memcache_binary, memcache_meta.\n"
             "  -x, --run-count=NUMBER         Number of full-test iterations to perform\n"
             "  -D, --debug                    Print debug output\n"
             "      --client-stats=FILE        Produce per-client stats file\n"
@@ -932,6 +1381,8 @@ void usage() {
             "      --show-config              Print detailed configuration before running\n"
             "      --hide-histogram           Don't print detailed latency histogram\n"
             "      --cluster-mode             Run client in cluster mode\n"
+            "      --servers=LIST             Spread the keys over host:port[:weight],... by ketama\n"
+            "                                 consistent hashing, instead of --server/--port\n"
             "      --help                     Display this help\n"
             "      --version                  Display version information\n"
             "\n"
@@ -940,32 +1391,61 @@ void usage() {
             "                                 use 'allkeys' to run on the entire key-range\n"
             "  -c, --clients=NUMBER           Number of clients per thread (default: 50)\n"
             "  -t, --threads=NUMBER           Number of threads (default: 4)\n"
+            "      --conns-per-client=NUM     Connections of every client, sharing its requests and stats (default: 1)\n"
+            "      --conn-dispatch=POLICY     How a client picks the connection of its next request:\n"
+            "                                 least-outstanding (default) or round-robin\n"
+            "      --spread-conns             Place each connection of a client on its own server thread,\n"
+            "                                 instead of all of them on the thread of the first one\n"
             "      --test-time=SECS           Number of seconds to run the test\n"
             "      --ratio=RATIO              Set:Get ratio (default: 1:10)\n"
+            "      --command-mix=LIST         Weighted command mix instead of --ratio, e.g. set:1,get:8,incr:1\n"
+            "                                 commands: set, get, delete, incr, decr, append, touch, cas, gets\n"
+            "                                 (incr/decr use '<key>:counter' keys, cas follows a gets hit)\n"
+            "                                 redis only: hset, hget, lpush, lrange, zadd, zrangebyscore\n"
+            "      --ds-fields=NUM            Fields per hash, members per sorted set and list (default: 10)\n"
+            "      --ds-member-size=SIZE      Size of hash values and list members (default: data-size)\n"
+            "      --ds-range=NUM             Elements read by lrange and zrangebyscore (default: 10)\n"
             "      --pipeline=NUMBER          Number of concurrent pipelined requests (default: 1)\n"
             "      --reconnect-interval=NUM   Number of requests after which re-connection is performed\n"
             "      --multi-key-get=NUM        Enable multi-key get commands, up to NUM keys (default: 0)\n"
+            "      --udp                      Send GET commands over UDP, other commands stay on TCP\n"
+            "      --udp-timeout=MSECS        UDP requests unanswered after MSECS are counted as lost (default: 100)\n"
             "  -a, --authenticate=CREDENTIALS Authenticate to redis using CREDENTIALS, which depending\n"
             "                                 on the protocol can be PASSWORD or USER:PASSWORD.\n"
             "      --select-db=DB             DB number to select, when testing a redis server\n"
             "      --distinct-client-seed     Use a different random seed for each client\n"
             "      --randomize                random seed based on timestamp (default is constant value)\n"
+            "      --seed=NUMBER              Seed every random stream of the run (keys, value sizes and\n"
+            "                                 inter-arrival times) is derived from (default: 0)\n"
             "\n"
             "Object Options:\n"
             "  -d  --data-size=SIZE           Object data size (default: 32)\n"
             "      --data-offset=OFFSET       Actual size of value will be data-size + data-offset\n"
             "                                 Will use SETRANGE / GETRANGE (default: 0)\n"
             "  -R  --random-data              Indicate that data should be randomized\n"
+            "      --zero-copy                Reference SET values from the generator instead of copying them\n"
+            "      --zero-copy-threshold=SIZE Also send writes of at least SIZE bytes with MSG_ZEROCOPY\n"
+            "                                 (implies --zero-copy, Linux only)\n"
+            "      --noreply                  Send SETs without a response (SETQ or ms q),\n"
+            "                                 memcache_binary and memcache_meta only\n"
+            "      --noreply-fence=NUM        Fence every NUM noreply SETs (a NOOP, or the last ms with a reply),\n"
+            "                                 which reports their errors and batch latency (default: 100)\n"
             "      --data-size-range=RANGE    Use random-sized items in the specified range (min-max)\n"
             "      --data-size-list=LIST      Use sizes from weight list (size1:weight1,..sizeN:weightN)\n"
             "      --data-size-pattern=R|S    Use together with data-size-range\n"
             "                                 when set to R, a random size from the defined data sizes will be used,\n"
             "                                 when set to S, the defined data sizes will be evenly distributed across\n"
             "                                 the key range, see --key-maximum (default R)\n"
+            "      --data-size-dist=DIST      Draw sizes from gev:LOC,SCALE,SHAPE or gpareto:LOC,SCALE,SHAPE,\n"
+            "                                 cut to data-size-range if given, or from cdf:FILE with lines of\n"
+            "                                 \"SIZE CDF\"\n"
+            "      --data-size-per-key        Give every key a size of its own, kept across SETs, with\n"
+            "                                 data-size-range or data-size-dist\n"
             "      --expiry-range=RANGE       Use random expiry values from the specified range\n"
             "\n"
             "Imported Data Options:\n"
-            "      --data-import=FILE         Read object data from file\n"
+            "      --data-import=FILE         Read object data from file, CSV or binary dataset\n"
+            "      --data-convert=FILE        Write the data-import file as a binary dataset and exit\n"
             "      --data-verify              Enable data verification when test is complete\n"
             "      --verify-only              Only perform --data-verify, without any other test\n"
             "      --generate-keys            Generate keys for imported objects\n"
@@ -973,17 +1453,30 @@ void usage() {
             "\n"
             "Key Options:\n"
             "      --key-prefix=PREFIX        Prefix for keys (default: \"memtier-\")\n"
+            "      --key-width=NUMBER         Zero pad key IDs to NUMBER digits (default: no padding)\n"
             "      --key-minimum=NUMBER       Key ID minimum value (default: 0)\n"
             "      --key-maximum=NUMBER       Key ID maximum value (default: 10000000)\n"
             "      --key-pattern=PATTERN      Set:Get pattern (default: R:R)\n"
             "                                 G for Gaussian distribution.\n"
             "                                 R for uniform Random.\n"
+            "                                 Z for Zipfian distribution.\n"
+            "                                 H for a Hot window of keys.\n"
+            "                                 L for a hot window behind the Latest SET key (Get only,\n"
+            "                                 with an S or P Set pattern).\n"
             "                                 S for Sequential.\n"
             "                                 P for Parallel (Sequential were each client has a subset of the key-range).\n"
             "      --key-stddev               The standard deviation used in the Gaussian distribution\n"
             "                                 (default is key range / 6)\n"
             "      --key-median               The median point used in the Gaussian distribution\n"
             "                                 (default is the center of the key range)\n"
+            "      --key-zipf-exp=EXP         The exponent of the Zipfian distribution (default: 0.99)\n"
+            "      --key-zipf-scramble        Spread the Zipfian hot keys over the key range instead\n"
+            "                                 of placing them at key-minimum and up\n"
+            "      --key-hot-start=NUMBER     First key of the H window (default: key-minimum)\n"
+            "      --key-hot-size=NUMBER      Keys in the H or L window (default: key range / 5)\n"
+            "      --key-hot-fraction=NUMBER  Share of the requests going to the window (default: 0.8)\n"
+            "                                 A benchmark file moves the window with \"hotset START SIZE [FRACTION]\"\n"
+            "                                 at the end of an interval line\n"
             "\n"
             "WAIT Options:\n"
             "      --wait-ratio=RATIO         Set:Wait ratio (default is no WAIT commands - 1:0)\n"
@@ -997,6 +1490,12 @@ void usage() {
             "SKEWED Option:\n"
             "  -k  --skew-level               How many clients pileup on memcached's 1st thread \n"
             "      --sever-threads            How many worker threads used in memcached server \n"
+            "      --idle-conns=NUM           Extra idle connections per server thread, opened before\n"
+            "                                 the measured clients and left out of the results\n"
+            "      --idle-rate=RATE           Keepalive GETs per second on each idle connection (default: 0)\n"
+            "      --churn-rate=RATE          Connections per second opened, set up, sent one GET and closed,\n"
+            "                                 apart from the measured clients, with their latency reported\n"
+            "      --churn-conns=NUM          Churn connections open at once at most (default: 100)\n"
             "\n"
             "SYNTHETIC Option:\n"
             "      --config-file              Input synthetic benchmark config file \n"
@@ -1016,6 +1515,11 @@ void usage() {
 
 static void* cg_thread_start(void *t);
 
+// every thread connects its clients on its own; the load starts once all of
+// them passed the barrier, and none of them failed to connect
+static pthread_barrier_t threads_prepared;
+static std::atomic<bool> prepare_failed(false);
+
 struct cg_thread {
     unsigned int m_thread_id;
     benchmark_config* m_config;
@@ -1048,7 +1552,7 @@ struct cg_thread {
     {
         if (m_cg->create_clients(m_config->clients) < (int) m_config->clients)
             return -1;
-        return m_cg->prepare();
+        return 0;
     }
     
     int start(void)
@@ -1070,7 +1574,15 @@ struct cg_thread {
 static void* cg_thread_start(void *t)
 {
     cg_thread* thread = (cg_thread*) t;
-    thread->m_cg->run();
+
+    if (thread->m_cg->prepare() < 0) {
+        benchmark_error_log("error: failed to prepare thread %u for test.\n", thread->m_thread_id);
+        prepare_failed.store(true);
+    }
+    pthread_barrier_wait(&threads_prepared);
+
+    if (!prepare_failed.load())
+        thread->m_cg->run();
     thread->m_finished = true;
     
     return t;
@@ -1110,7 +1622,9 @@ static void check_dir(std::string &dir) {
 static int parse_config_file(benchmark_config *cfg) {
     const char* config_file = cfg->config_file;
     int numServerThreads = cfg->server_threads;
-    int numClients = cfg->threads * cfg->clients;
+    // every connection runs its own schedule at the rate of its server thread
+    int numClients = cfg->threads * cfg->clients * cfg->conns_per_client *
+        std::max((int) cfg->servers.servers.size(), 1);
 
     if (config_file == NULL) {
         for (int i = 0; i < numServerThreads; ++i) {
@@ -1132,16 +1646,91 @@ static int parse_config_file(benchmark_config *cfg) {
     intervals = new Interval[numIntervals];
     numServerThreads = cfg->server_threads;
 
+    // An interval line may end in "migrate FRACTION FROM TO": when it starts,
+    // FRACTION of the connections on server thread FROM move to thread TO.
+    // It may also end in "hotset START SIZE [FRACTION]", moving the hot
+    // window of the H and L key patterns; FRACTION defaults to the last one.
+    std::vector<double> fractions;
+    std::vector<std::pair<int, int> > moves;
     for (size_t i = 0; i < numIntervals; ++i) {
         if (fgets(buffer, 1024, specFile) == NULL) {
             fprintf(stderr, "Error reading configuration file: %s\n", strerror(errno));
             return -1;
         }
-        sscanf(buffer, "%ld %lf %lf", &intervals[i].timeToRun,
-               &intervals[i].requestsPerSecond, &intervals[i].skewFactor);
+        int consumed = 0;
+        sscanf(buffer, "%ld %lf %lf %n", &intervals[i].timeToRun,
+               &intervals[i].requestsPerSecond, &intervals[i].skewFactor, &consumed);
+        intervals[i].migration = -1;
+        intervals[i].hotWindow = -1;
+
+        char directive[16];
+        int len = 0;
+        const char *rest = buffer + consumed;
+        while (consumed > 0 && sscanf(rest, "%15s %n", directive, &len) == 1) {
+            if (strcmp(directive, "migrate") == 0) {
+                double fraction;
+                int from_tid, to_tid;
+                if (sscanf(rest, "migrate %lf %d %d %n", &fraction, &from_tid, &to_tid, &len) != 3) {
+                    fprintf(stderr, "Interval %zu: expected \"migrate FRACTION FROM TO\"\n", i);
+                    return -1;
+                }
+                if (i == 0 || fraction <= 0 || fraction > 1 || from_tid == to_tid ||
+                    from_tid < 0 || from_tid >= numServerThreads || to_tid < 0 || to_tid >= numServerThreads) {
+                    fprintf(stderr, "Interval %zu: migration must start after the first interval, "
+                            "move (0-1] of the connections between two different server threads\n", i);
+                    return -1;
+                }
+                if (cfg->cluster_mode || cfg->servers.is_defined() || cfg->reconnect_interval || cfg->churn_rate > 0) {
+                    fprintf(stderr, "Migration cannot be used with cluster-mode, servers, reconnect-interval or churn-rate\n");
+                    return -1;
+                }
+                intervals[i].migration = fractions.size();
+                fractions.push_back(fraction);
+                moves.push_back(std::make_pair(from_tid, to_tid));
+            } else if (strcmp(directive, "hotset") == 0) {
+                // a fraction of 0 is resolved once the key options are known
+                key_hot_window w = { 0, 0, 0 };
+                if (sscanf(rest, "hotset %llu %llu %lf %n", &w.start, &w.size, &w.fraction, &len) != 3) {
+                    w.fraction = 0;
+                    if (sscanf(rest, "hotset %llu %llu %n", &w.start, &w.size, &len) != 2) {
+                        fprintf(stderr, "Interval %zu: expected \"hotset START SIZE [FRACTION]\"\n", i);
+                        return -1;
+                    }
+                }
+                if (i == 0 || w.size == 0 || w.fraction < 0 || w.fraction > 1) {
+                    fprintf(stderr, "Interval %zu: hotset must start after the first interval, "
+                            "with at least one key and a fraction in (0-1]\n", i);
+                    return -1;
+                }
+                intervals[i].hotWindow = hotWindows.size();
+                hotWindows.push_back(w);
+            } else {
+                fprintf(stderr, "Interval %zu: unknown directive \"%s\"\n", i, directive);
+                return -1;
+            }
+            rest += len;
+        }
     }
     fclose(specFile);
 
+    numMigrations = fractions.size();
+    if (numMigrations > 0) {
+        migrations = new migration[numMigrations];
+        for (unsigned int i = 0; i < numMigrations; i++) {
+            migrations[i].fraction = fractions[i];
+            migrations[i].from_tid = moves[i].first;
+            migrations[i].to_tid = moves[i].second;
+            migrations[i].start_ts = 0;
+            migrations[i].tickets.store(0);
+            migrations[i].moved.store(0);
+            migrations[i].failed.store(0);
+            migrations[i].total_cost.store(0);
+            migrations[i].max_cost.store(0);
+            migrations[i].window_responses.store(0);
+            migrations[i].window_latency.store(0);
+        }
+    }
+
     // Initialize per client qps
     currGoalQPS = intervals[0].requestsPerSecond;
     currentSkew = intervals[0].skewFactor;
@@ -1169,7 +1758,8 @@ static void* start_master(void *arg) {
     benchmark_config *cfg = (benchmark_config*)arg;
     // Initialize per client qps
     int numServerThreads = cfg->server_threads;
-    int numClients = cfg->threads * cfg->clients;
+    int numClients = cfg->threads * cfg->clients * cfg->conns_per_client *
+        std::max((int) cfg->servers.servers.size(), 1);
     double clientQPS = 0.0;
     double clientQPSskew = 0.0;
 
@@ -1225,6 +1815,16 @@ static void* start_master(void *arg) {
             shouldCount += intervals[currentInterval].requestsPerSecond *
                 (intervals[currentInterval].timeToRun / 1000000000);
 
+            if (intervals[currentInterval].migration >= 0) {
+                struct timeval now;
+                gettimeofday(&now, NULL);
+                migrations[intervals[currentInterval].migration].start_ts = timeval_to_ts(now);
+                migrationsStarted.fetch_add(1, std::memory_order_release);
+            }
+            if (intervals[currentInterval].hotWindow >= 0) {
+                hotWindowCurrent.store(intervals[currentInterval].hotWindow, std::memory_order_release);
+            }
+
             // Skew on the first thread
             currentSkew = intervals[currentInterval].skewFactor;
             currGoalQPS = intervals[currentInterval].requestsPerSecond;
@@ -1347,7 +1947,44 @@ static void process_results(std::string filePath) {
     fclose(latencyLog);
 }
 
-run_stats run_benchmark(int run_id, benchmark_config* cfg, object_generator* obj_gen)
+// One line per migration of the benchmark file, both to stderr and to the
+// log, whose timestamps line up with the latency and QPS logs
+static void report_migrations(int run_id, std::string filePath)
+{
+    FILE *migrationLog = fopen(filePath.c_str(), "w");
+    if (migrationLog == NULL) {
+        fprintf(stderr, "Fail to open log file: %s \n", filePath.c_str());
+    } else {
+        fprintf(stderr, "Storing migration log to %s \n", filePath.c_str());
+        fprintf(migrationLog, "TimeInUSecSinceEpoch,From,To,Fraction,Seen,Moved,Failed,"
+                "Avg Cost Usec,Max Cost Usec,Window Responses,Window Avg Latency Usec\n");
+    }
+
+    for (unsigned int i = 0; i < migrationsStarted.load(); i++) {
+        migration& m = migrations[i];
+        unsigned int moved = m.moved.load();
+        uint64_t responses = m.window_responses.load();
+        double avg_cost = moved ? (double) m.total_cost.load() / moved : 0.0;
+        double avg_latency = responses ? (double) m.window_latency.load() / responses : 0.0;
+
+        fprintf(stderr, "[RUN #%u] Migration %u: %u of %u connections from server thread %d to %d "
+                "(%u failed), %.3f msec avg cost (%.3f max), %.3f msec avg latency in the %u msec after\n",
+                run_id, i, moved, m.tickets.load(), m.from_tid, m.to_tid, m.failed.load(),
+                avg_cost / 1000.0, m.max_cost.load() / 1000.0,
+                avg_latency / 1000.0, MIGRATION_WINDOW_USEC / 1000);
+        if (migrationLog != NULL) {
+            fprintf(migrationLog, "%lu,%d,%d,%.4f,%u,%u,%u,%.2f,%lu,%lu,%.2f\n",
+                    m.start_ts, m.from_tid, m.to_tid, m.fraction, m.tickets.load(), moved, m.failed.load(),
+                    avg_cost, m.max_cost.load(), responses, avg_latency);
+        }
+    }
+
+    if (migrationLog != NULL)
+        fclose(migrationLog);
+}
+
+run_stats run_benchmark(int run_id, benchmark_config* cfg, object_generator* obj_gen,
+                        FILE *outfile, json_handler *jsonhandler)
 {
     fprintf(stderr, "[RUN #%u] Preparing benchmark client...\n", run_id);
 
@@ -1374,8 +2011,21 @@ run_stats run_benchmark(int run_id, benchmark_config* cfg, object_generator* obj
     setIndices.push_back(setArrayIndex);
     getIndices.push_back(getArrayIndex);
 
+    // idle connections come first, in whole rounds of the server threads, so
+    // the placement of the measured clients doesn't depend on them
+    idle_connections* idle = NULL;
+    if (cfg->idle_conns > 0) {
+        idle = new idle_connections(cfg);
+        if (idle->open(cfg->idle_conns * cfg->server_threads) < 0 || idle->start() != 0) {
+            benchmark_error_log("error: failed to open idle connections.\n");
+            exit(1);
+        }
+        fprintf(stderr, "[RUN #%u] Opened %d idle connections\n", run_id, cfg->idle_conns * cfg->server_threads);
+    }
+
     // prepare threads data
     std::vector<cg_thread*> threads;
+    unsigned long prepare_rss = get_resident_bytes();
     for (unsigned int i = 0; i < cfg->threads; i++) {
         cg_thread* t = new cg_thread(i, cfg, obj_gen);
         assert(t != NULL);
@@ -1387,12 +2037,50 @@ run_stats run_benchmark(int run_id, benchmark_config* cfg, object_generator* obj
         threads.push_back(t);
     }
 
-    // launch threads
+    // launch threads, they connect their clients concurrently
+    struct timeval prepare_start, prepare_end;
+    int prev_conns = client::placed_conns();
+    int prev_fillers = client::placement_fillers();
+    int ret = pthread_barrier_init(&threads_prepared, NULL, cfg->threads + 1);
+    assert(ret == 0);
+
     fprintf(stderr, "[RUN #%u] Launching threads now...\n", run_id);
+    gettimeofday(&prepare_start, NULL);
     for (std::vector<cg_thread*>::iterator i = threads.begin(); i != threads.end(); i++) {
         (*i)->start();
     }
 
+    pthread_barrier_wait(&threads_prepared);
+    gettimeofday(&prepare_end, NULL);
+    pthread_barrier_destroy(&threads_prepared);
+    if (prepare_failed.load())
+        exit(1);
+
+    fprintf(stderr, "[RUN #%u] Placed %d connections on %d server threads (%d placement connections) in %.3f secs\n",
+            run_id, client::placed_conns() - prev_conns, cfg->server_threads,
+            client::placement_fillers() - prev_fillers,
+            (timeval_to_ts(prepare_end) - timeval_to_ts(prepare_start)) / 1000000.0);
+
+    // clients, connections and their buffers as set up, before any load
+    unsigned long conns_rss = get_resident_bytes();
+    if (conns_rss > prepare_rss && client::placed_conns() > prev_conns) {
+        char size_buf[16];
+        size_to_str(conns_rss - prepare_rss, size_buf, sizeof(size_buf));
+        fprintf(stderr, "[RUN #%u] Connection memory: %s, %lu bytes per connection\n",
+                run_id, size_buf, (conns_rss - prepare_rss) / (client::placed_conns() - prev_conns));
+    }
+
+    // churn starts once the measured clients are placed, its connections
+    // would move the server's dispatch under them otherwise
+    churn_connections* churn = NULL;
+    if (cfg->churn_rate > 0) {
+        churn = new churn_connections(cfg);
+        if (churn->start() != 0) {
+            benchmark_error_log("error: failed to start churn connections.\n");
+            exit(1);
+        }
+    }
+
     // launch the master thread that controls the rate of requests
     pthread_t master_tid;
     if (cfg->config_file) {
@@ -1663,6 +2351,45 @@ run_stats run_benchmark(int run_id, benchmark_config* cfg, object_generator* obj
         (*i)->m_cg->merge_run_stats(&stats);
     }
 
+    if (cfg->servers.is_defined()) {
+        std::vector<unsigned long> responses;
+        std::vector<unsigned long long> latency;
+        unsigned long total_responses = 0;
+
+        for (std::vector<cg_thread*>::iterator i = threads.begin(); i != threads.end(); i++)
+            (*i)->m_cg->merge_conn_stats(responses, latency);
+        for (unsigned int i = 0; i < responses.size(); i++)
+            total_responses += responses[i];
+
+        for (unsigned int i = 0; i < responses.size(); i++) {
+            config_server_list::server_item& item = cfg->servers.servers[i];
+            fprintf(stderr, "[RUN #%u] Server %s:%u (weight %u): %lu ops, %.2f%% (expected %.2f%%), %.3f msec avg latency\n",
+                    run_id, item.hostname.c_str(), item.port, item.weight, responses[i],
+                    total_responses ? 100.0 * responses[i] / total_responses : 0.0,
+                    100.0 * item.weight / cfg->servers.total_weight(),
+                    responses[i] ? latency[i] / 1000.0 / responses[i] : 0.0);
+        }
+    }
+
+    if (idle != NULL) {
+        idle->stop();
+        fprintf(stderr, "[RUN #%u] Idle connections: %u still open, %lu keepalive GETs sent\n",
+                run_id, idle->get_open_conns(), idle->get_keepalives());
+        delete idle;
+    }
+
+    if (churn != NULL) {
+        churn->stop();
+        fprintf(stderr, "[RUN #%u] Churn connections: %lu opened, %lu completed, %lu failed, "
+                "%lu not opened at the churn-conns limit\n",
+                run_id, churn->get_opened(), churn->get_completed(), churn->get_failed(),
+                churn->get_skipped());
+        char churn_header[50];
+        snprintf(churn_header, sizeof(churn_header), "CHURN CONNECTIONS RUN #%u", run_id);
+        churn->print(outfile, !cfg->hide_histogram, churn_header, jsonhandler);
+        delete churn;
+    }
+
     // Do we need to produce client stats?
     if (cfg->client_stats != NULL) {
         unsigned int cg_id = 0;
@@ -1688,6 +2415,10 @@ run_stats run_benchmark(int run_id, benchmark_config* cfg, object_generator* obj
         process_results(std::string(logDir) + "/" + cfg->log_latency_file);
     }
 
+    if (numMigrations > 0) {
+        report_migrations(run_id, std::string(logDir) + "/migration.log");
+    }
+
 #ifdef PER_CLIENT
     delete []prevOpsPerClient;
     delete []currOpsPerClient;
@@ -1732,6 +2463,8 @@ int main(int argc, char *argv[])
         usage();
     }
 
+    // imported items are walked in file order unless a key pattern is asked for
+    bool key_pattern_given = cfg.key_pattern != NULL;
     config_init_defaults(&cfg);
     log_level = cfg.debug;
     if (cfg.show_config) {
@@ -1766,6 +2499,11 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    if (cfg.unix_socket != NULL && cfg.udp) {
+        benchmark_error_log("error: UDP cannot be used with a UNIX domain socket.\n");
+        exit(1);
+    }
+
     if (cfg.server != NULL && cfg.port > 0) {
         try {
             cfg.server_addr = new server_addr(cfg.server, cfg.port);
@@ -1776,7 +2514,23 @@ int main(int argc, char *argv[])
         }
     }
 
-    unsigned int fds_needed = (cfg.threads * cfg.clients) + (cfg.threads * 10) + 10;
+    if (cfg.servers.is_defined()) {
+        for (unsigned int i = 0; i < cfg.servers.servers.size(); i++) {
+            config_server_list::server_item& item = cfg.servers.servers[i];
+            try {
+                item.addr = new server_addr(item.hostname.c_str(), item.port);
+            } catch (std::runtime_error& e) {
+                benchmark_error_log("%s:%u: error: %s\n",
+                        item.hostname.c_str(), item.port, e.what());
+                exit(1);
+            }
+        }
+        cfg.continuum = new ketama_continuum(cfg.servers);
+    }
+
+    unsigned int fds_needed = (cfg.threads * cfg.clients * cfg.conns_per_client * (cfg.udp ? 2 : 1) *
+        std::max((unsigned int) cfg.servers.servers.size(), 1U)) + (cfg.threads * 10) + 10 +
+        cfg.idle_conns * cfg.server_threads + cfg.churn_conns;
     if (fds_needed > rlim.rlim_cur) {
         if (fds_needed > rlim.rlim_max && getuid() != 0) {
             benchmark_error_log("error: running the tool with this number of connections requires 'root' privilegs.\n");
@@ -1792,7 +2546,7 @@ int main(int argc, char *argv[])
 
     // create and configure object generator
     object_generator* obj_gen = NULL;
-    imported_keylist* keylist = NULL;
+    imported_dataset* dataset = NULL;
     if (!cfg.data_import) {
         if (cfg.data_verify) {
             fprintf(stderr, "error: use data-verify only with data-import\n");
@@ -1802,6 +2556,10 @@ int main(int argc, char *argv[])
             fprintf(stderr, "error: use no-expiry only with data-import\n");
             exit(1);
         }
+        if (cfg.data_convert) {
+            fprintf(stderr, "error: use data-convert only with data-import\n");
+            exit(1);
+        }
         
         obj_gen = new object_generator();
         assert(obj_gen != NULL);
@@ -1809,7 +2567,8 @@ int main(int argc, char *argv[])
         // check paramters
         if (cfg.data_size ||
             cfg.data_size_list.is_defined() ||
-            cfg.data_size_range.is_defined()) {
+            cfg.data_size_range.is_defined() ||
+            cfg.data_size_dist) {
             fprintf(stderr, "error: data size cannot be specified when importing.\n");
             exit(1);
         }
@@ -1820,32 +2579,41 @@ int main(int argc, char *argv[])
         }
 
         if (!cfg.generate_keys &&
-            (cfg.key_maximum || cfg.key_minimum || cfg.key_prefix)) {
-                fprintf(stderr, "error: use key-minimum, key-maximum and key-prefix only with generate-keys.\n");
+            (cfg.key_maximum || cfg.key_minimum || cfg.key_prefix || cfg.key_width)) {
+                fprintf(stderr, "error: use key-minimum, key-maximum, key-prefix and key-width only with generate-keys.\n");
                 exit(1);
         }
 
-        if (!cfg.generate_keys) {        
-            // read keys
-            fprintf(stderr, "Reading keys from %s...", cfg.data_import);
-            keylist = new imported_keylist(cfg.data_import);
-            assert(keylist != NULL);
-            
-            if (!keylist->read_keys()) {
-                fprintf(stderr, "\nerror: failed to read keys.\n");
+        // load the whole file up front, in parallel for big dumps
+        fprintf(stderr, "Reading %s...", cfg.data_import);
+        dataset = new imported_dataset(cfg.data_import);
+        assert(dataset != NULL);
+
+        if (!dataset->load(sysconf(_SC_NPROCESSORS_ONLN))) {
+            fprintf(stderr, "\nerror: failed to read items.\n");
+            exit(1);
+        } else if (dataset->size() == 0) {
+            fprintf(stderr, "\nerror: %s: no items.\n", cfg.data_import);
+            exit(1);
+        } else {
+            fprintf(stderr, " %u items read.\n", dataset->size());
+        }
+
+        if (cfg.data_convert) {
+            fprintf(stderr, "Writing %s...", cfg.data_convert);
+            if (!dataset->save(cfg.data_convert)) {
+                fprintf(stderr, "\nerror: failed to write dataset.\n");
                 exit(1);
-            } else {
-                fprintf(stderr, " %u keys read.\n", keylist->size());
             }
+            fprintf(stderr, " %u items written.\n", dataset->size());
+            exit(0);
         }
 
-        obj_gen = new import_object_generator(cfg.data_import, keylist, cfg.no_expiry);
-        assert(obj_gen != NULL);
-
-        if (dynamic_cast<import_object_generator*>(obj_gen)->open_file() != true) {
-            fprintf(stderr, "error: %s: failed to open.\n", cfg.data_import);
-            exit(1);
-        }
+        import_object_generator* import_gen =
+            new import_object_generator(dataset, !cfg.generate_keys, cfg.no_expiry);
+        assert(import_gen != NULL);
+        import_gen->set_file_order(!key_pattern_given);
+        obj_gen = import_gen;
     }
 
     if (cfg.authenticate) {
@@ -1878,18 +2646,36 @@ int main(int argc, char *argv[])
             usage();
         }
     }
+    if (cfg.command_mix.weights[mc_cas] && !strcmp(cfg.protocol, "redis")) {
+        fprintf(stderr, "error: the cas command of command-mix is not supported by the redis protocol.\n");
+        usage();
+    }
+    if (cfg.command_mix.has_data_structures() && strcmp(cfg.protocol, "redis")) {
+        fprintf(stderr, "error: the hash, list and sorted set commands of command-mix require the redis protocol.\n");
+        usage();
+    }
+    if (cfg.zero_copy && (cfg.data_import || cfg.random_data)) {
+        fprintf(stderr, "error: zero-copy cannot be used with data-import or random-data.\n");
+        usage();
+    }
     if (cfg.data_size) {
-        if (cfg.data_size_list.is_defined() || cfg.data_size_range.is_defined()) {
-            fprintf(stderr, "error: data-size cannot be used with data-size-list or data-size-range.\n");
+        if (cfg.data_size_list.is_defined() || cfg.data_size_range.is_defined() || cfg.data_size_dist) {
+            fprintf(stderr, "error: data-size cannot be used with data-size-list, data-size-range or data-size-dist.\n");
             usage();
         }
         obj_gen->set_data_size_fixed(cfg.data_size);
     } else if (cfg.data_size_list.is_defined()) {
-        if (cfg.data_size_range.is_defined()) {
-            fprintf(stderr, "error: data-size-list cannot be used with data-size-range.\n");
+        if (cfg.data_size_range.is_defined() || cfg.data_size_dist) {
+            fprintf(stderr, "error: data-size-list cannot be used with data-size-range or data-size-dist.\n");
             usage();
         }
         obj_gen->set_data_size_list(&cfg.data_size_list);
+    } else if (cfg.data_size_dist) {
+        size_distribution* size_dist = new size_distribution();
+        if (!size_dist->parse(cfg.data_size_dist, cfg.data_size_range.min, cfg.data_size_range.max))
+            usage();
+        fprintf(stderr, "[CONFIG] data-size-dist: %s, sizes up to %u\n", cfg.data_size_dist, size_dist->largest());
+        obj_gen->set_data_size_distribution(size_dist);
     } else if (cfg.data_size_range.is_defined()) {
         obj_gen->set_data_size_range(cfg.data_size_range.min, cfg.data_size_range.max);
         obj_gen->set_data_size_pattern(cfg.data_size_pattern);
@@ -1897,8 +2683,17 @@ int main(int argc, char *argv[])
         fprintf(stderr, "error: data-size, data-size-list or data-size-range must be specified.\n");
         usage();
     }
+    if (cfg.data_size_per_key) {
+        if (!cfg.data_size_dist && (!cfg.data_size_range.is_defined() || cfg.data_size_pattern[0] == 'S')) {
+            fprintf(stderr, "error: data-size-per-key is only allowed with data-size-dist or data-size-range with pattern R.\n");
+            usage();
+        }
+        obj_gen->set_data_size_per_key(true,
+            prng_seed_child(prng_seed_child(cfg.seed, SEED_BRANCH_KEYS), SEED_BRANCH_SIZES));
+    }
     
     if (!cfg.data_import || cfg.generate_keys) {
+        obj_gen->set_key_width(cfg.key_width);
         obj_gen->set_key_prefix(cfg.key_prefix);
         fprintf(stderr, "key prefix: %s \n", cfg.key_prefix);
         obj_gen->set_key_range(cfg.key_minimum, cfg.key_maximum);
@@ -1914,6 +2709,39 @@ int main(int argc, char *argv[])
         }
         obj_gen->set_key_distribution(cfg.key_stddev, cfg.key_median);
     }
+    if (cfg.key_pattern[0]=='Z' || cfg.key_pattern[2]=='Z') {
+        if (!cfg.key_zipf_exp)
+            cfg.key_zipf_exp = 0.99;
+        obj_gen->set_key_zipf(cfg.key_zipf_exp, cfg.key_zipf_scramble);
+    } else if (cfg.key_zipf_exp>0 || cfg.key_zipf_scramble) {
+        fprintf(stderr, "error: key-zipf-exp and key-zipf-scramble are only allowed together with key-pattern set to Z.\n");
+        usage();
+    }
+    if (cfg.key_pattern[0]=='H' || cfg.key_pattern[2]=='H' || cfg.key_pattern[2]=='L') {
+        if (!cfg.key_hot_start)
+            cfg.key_hot_start = cfg.key_minimum;
+        if (!cfg.key_hot_fraction)
+            cfg.key_hot_fraction = 0.8;
+
+        key_hot_window first = { cfg.key_hot_start, cfg.key_hot_size, cfg.key_hot_fraction };
+        hotWindows[0] = first;
+        for (unsigned int i = 0; i < hotWindows.size(); i++) {
+            key_hot_window& w = hotWindows[i];
+            if (!w.fraction)
+                w.fraction = hotWindows[i - 1].fraction;
+            if ((!cfg.data_import || cfg.generate_keys) &&
+                (w.start < cfg.key_minimum || w.start > cfg.key_maximum ||
+                 w.size > cfg.key_maximum - cfg.key_minimum + 1)) {
+                fprintf(stderr, "error: hot window %u must start between key-minimum and key-maximum "
+                        "and hold no more keys than the key range.\n", i);
+                usage();
+            }
+        }
+        obj_gen->set_key_hot_windows(&hotWindows[0], &hotWindowCurrent);
+    } else if (cfg.key_hot_start || cfg.key_hot_size || cfg.key_hot_fraction > 0 || hotWindows.size() > 1) {
+        fprintf(stderr, "error: key-hot options and hotset are only allowed together with key-pattern set to H or L.\n");
+        usage();
+    }
     obj_gen->set_expiry_range(cfg.expiry_range.min, cfg.expiry_range.max);
 
     // Prepare output file
@@ -1934,7 +2762,7 @@ int main(int argc, char *argv[])
             if (run_id > 1)
                 sleep(1);   // let connections settle
             
-            run_stats stats = run_benchmark(run_id, &cfg, obj_gen);
+            run_stats stats = run_benchmark(run_id, &cfg, obj_gen, outfile, jsonhandler);
             all_stats.push_back(stats);
         }
         //
@@ -2030,6 +2858,6 @@ int main(int argc, char *argv[])
     }
 
     delete obj_gen;
-    if (keylist != NULL)
-        delete keylist;
+    if (dataset != NULL)
+        delete dataset;
 }
@@ -36,6 +36,9 @@
 #define benchmark_error_log(...) \
     benchmark_log(LOGLEVEL_ERROR, __VA_ARGS__)
 
+// how a client with several connections picks one for the next request
+enum conn_dispatch_type { dispatch_least_outstanding, dispatch_round_robin };
+
 struct benchmark_config {
     const char *server;
     unsigned short port;
@@ -50,32 +53,55 @@ struct benchmark_config {
     int hide_histogram;
     int distinct_client_seed;
     int randomize;
+    unsigned long long seed;
     int next_client_idx;
     unsigned int requests;
     unsigned int clients;
     unsigned int threads;
+    unsigned int conns_per_client;
+    conn_dispatch_type conn_dispatch;
+    bool spread_conns;
     unsigned int test_time;
     config_ratio ratio;
+    config_command_mix command_mix;
+    unsigned int ds_fields;
+    unsigned int ds_member_size;
+    unsigned int ds_range;
     unsigned int pipeline;
     unsigned int data_size;
     unsigned int data_offset;
     bool random_data;
+    bool zero_copy;
+    unsigned int zero_copy_threshold;
+    bool noreply;
+    unsigned int noreply_fence;
     struct config_range data_size_range;
     config_weight_list data_size_list;
     const char *data_size_pattern;
+    const char *data_size_dist;
+    int data_size_per_key;
     struct config_range expiry_range;
     const char *data_import;
+    const char *data_convert;
     int data_verify;
     int verify_only;
     int generate_keys;
     const char *key_prefix;
+    unsigned int key_width;
     unsigned long long key_minimum;
     unsigned long long key_maximum;
     double key_stddev;
     double key_median;
+    double key_zipf_exp;
+    int key_zipf_scramble;
+    unsigned long long key_hot_start;
+    unsigned long long key_hot_size;
+    double key_hot_fraction;
     const char *key_pattern;
     unsigned int reconnect_interval;
     int multi_key_get;
+    bool udp;
+    unsigned int udp_timeout;
     const char *authenticate;
     int select_db;
     bool no_expiry;
@@ -87,10 +113,19 @@ struct benchmark_config {
     // JSON additions
     const char *json_out_file;
     bool cluster_mode;
+    // ketama pool of --servers targets, and the continuum built from it
+    config_server_list servers;
+    class ketama_continuum *continuum;
     // blocking libevent loop or not
     bool blocking;
     int skew_level;
     int server_threads;
+    // idle connections per server thread, and their keepalive GETs per second
+    int idle_conns;
+    double idle_rate;
+    // churn connections opened and closed per second, and how many at once
+    double churn_rate;
+    int churn_conns;
     const char *config_file;
     const char *ir_distribution;
     // To control the distribution of inter-requests time
@@ -113,6 +148,30 @@ extern void benchmark_log(int level, const char *fmt, ...);
 extern bool master_finished; // master thread finished or not?
 extern std::vector<double> qpsPerClient;
 
+// A move of connections from one server thread to another at an interval
+// boundary of the benchmark file, and what it cost
+struct migration {
+    double fraction;        // share of the connections on from_tid that move
+    int from_tid;
+    int to_tid;
+    uint64_t start_ts;      // usec since epoch, when the master started it
+
+    std::atomic<unsigned int> tickets;          // connections of from_tid seen
+    std::atomic<unsigned int> moved;
+    std::atomic<unsigned int> failed;           // left down after a failed reconnect
+    std::atomic<uint64_t> total_cost;           // usec from pick to reconnected
+    std::atomic<uint64_t> max_cost;
+    std::atomic<uint64_t> window_responses;     // of moved connections, right after
+    std::atomic<uint64_t> window_latency;
+};
+
+// Responses of a moved connection within this long after the move are
+// accounted to the migration
+#define MIGRATION_WINDOW_USEC 100000
+
+extern migration* migrations;
+extern std::atomic<unsigned int> migrationsStarted;
+
 // Latency recording related
 extern uint64_t* setLatencies;
 extern std::atomic<uint32_t> setArrayIndex;
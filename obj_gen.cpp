@@ -26,6 +26,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <math.h>
+#include <errno.h>
+#include <limits.h>
 
 #ifdef HAVE_ASSERT_H
 #include <assert.h>
@@ -39,58 +41,19 @@ random_generator::random_generator()
     set_seed(0);
 }
 
-void random_generator::set_seed(int seed)
+void random_generator::set_seed(unsigned long long seed)
 {
-    seed++; //http://stackoverflow.com/questions/27386470/srand0-and-srand1-give-the-same-results
-#ifdef HAVE_RANDOM_R
-    memset(&m_data_blob, 0, sizeof(m_data_blob));
-    memset(m_state_array, 0, sizeof(m_state_array));
-    
-    int ret = initstate_r(seed, m_state_array, sizeof(m_state_array), &m_data_blob);
-    assert(ret == 0);
-#elif (defined HAVE_DRAND48)
-    memset(&m_data_blob, 0, sizeof(m_data_blob));
-    memcpy(&m_data_blob, &seed, MIN(sizeof(seed), sizeof(m_data_blob)));
-#endif
+    m_engine.set_seed(seed);
 }
 
 unsigned long long random_generator::get_random()
 {
-    int rn;
-    unsigned long long llrn;
-#ifdef HAVE_RANDOM_R
-    int ret = random_r(&m_data_blob, &rn);//max is RAND_MAX
-    assert(ret == 0);
-
-    llrn = rn;
-    llrn = llrn << 32; // move to upper 32bits
-
-    ret = random_r(&m_data_blob, &rn);//max is RAND_MAX
-    assert(ret == 0);
-    llrn |= rn; // set lower 32bits
-#elif (defined HAVE_DRAND48)
-    rn = nrand48(m_data_blob); // max is 1<<31
-    llrn = rn;
-    llrn = llrn << 32; // move to upper 32bits
-
-    rn = nrand48(m_data_blob); // max is 1<<31
-    llrn |= rn; // set lower 32bits
-#else
-    #error no random function
-#endif
-    return llrn;
+    return m_engine.next();
 }
 
 unsigned long long random_generator::get_random_max() const
 {
-#ifdef HAVE_RANDOM_R
-    unsigned long long rand_max = RAND_MAX;
-    return (rand_max << 32) | RAND_MAX;
-#elif (defined HAVE_DRAND48)
-    return ((1<<31) << 32) | (1<<31);
-#else
-    #error no random function
-#endif
+    return xoshiro256ss::max();
 }
 
 //returns a value surrounding 0
@@ -134,9 +97,387 @@ unsigned long long gaussian_noise::gaussian_distribution_range(double stddev, do
     return val;
 }
 
+key_builder::key_builder() :
+    m_prefix_len(0), m_width(0), m_len(0)
+{
+    m_buffer[0] = '\0';
+}
+
+// room is left for the widest index, longer prefixes are cut
+void key_builder::set_prefix(const char* prefix, unsigned int width)
+{
+    unsigned int max_prefix = sizeof(m_buffer) - 1 - 20;
+    if (width > 20)
+        width = 20;
+
+    m_prefix_len = prefix != NULL ? strlen(prefix) : 0;
+    if (m_prefix_len > max_prefix)
+        m_prefix_len = max_prefix;
+    memcpy(m_buffer, prefix, m_prefix_len);
+    m_buffer[m_prefix_len] = '\0';
+    m_width = width;
+    m_len = m_prefix_len;
+}
+
+unsigned int key_builder::build(unsigned long long key_index)
+{
+    static const char pairs[201] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+    // two digits at a time, from the end
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    while (key_index >= 100) {
+        unsigned int i = (key_index % 100) * 2;
+        key_index /= 100;
+        *--p = pairs[i + 1];
+        *--p = pairs[i];
+    }
+    if (key_index >= 10) {
+        unsigned int i = key_index * 2;
+        *--p = pairs[i + 1];
+        *--p = pairs[i];
+    } else {
+        *--p = '0' + key_index;
+    }
+
+    unsigned int count = digits + sizeof(digits) - p;
+    char *out = m_buffer + m_prefix_len;
+    if (count < m_width) {
+        memset(out, '0', m_width - count);
+        out += m_width - count;
+    }
+    memcpy(out, p, count);
+    out[count] = '\0';
+
+    m_len = out + count - m_buffer;
+    return m_len;
+}
+
+zipf_distribution::zipf_distribution() :
+    m_n(0), m_exponent(0), m_h_integral_x1(0), m_h_integral_n(0), m_s(0),
+    m_scramble(false), m_half_bits(0)
+{
+}
+
+// log1p(x)/x and expm1(x)/x, taking their limits near 0
+static inline double zipf_helper1(double x)
+{
+    if (fabs(x) > 1e-8)
+        return log1p(x) / x;
+    return 1 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+static inline double zipf_helper2(double x)
+{
+    if (fabs(x) > 1e-8)
+        return expm1(x) / x;
+    return 1 + x * 0.5 * (1 + x * (1.0 / 3.0) * (1 + 0.25 * x));
+}
+
+// hat function h(x) = x^-exponent and its integral H, well defined for exponent 1 too
+double zipf_distribution::h(double x) const
+{
+    return exp(-m_exponent * log(x));
+}
+
+double zipf_distribution::h_integral(double x) const
+{
+    double log_x = log(x);
+    return zipf_helper2((1 - m_exponent) * log_x) * log_x;
+}
+
+double zipf_distribution::h_integral_inverse(double x) const
+{
+    double t = x * (1 - m_exponent);
+    if (t < -1)
+        t = -1;
+    return exp(zipf_helper1(t) * x);
+}
+
+void zipf_distribution::set_params(unsigned long long n, double exponent, bool scramble)
+{
+    assert(n > 0 && exponent > 0);
+
+    m_n = n;
+    m_exponent = exponent;
+    m_h_integral_x1 = h_integral(1.5) - 1;
+    m_h_integral_n = h_integral(n + 0.5);
+    m_s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+
+    m_scramble = scramble;
+    m_half_bits = 1;
+    while (m_half_bits < 32 && (1ULL << (2 * m_half_bits)) < n)
+        m_half_bits++;
+}
+
+unsigned long long zipf_distribution::sample(random_generator& random)
+{
+    while (true) {
+        double u = m_h_integral_n + (random.get_random() / (double) random.get_random_max()) *
+            (m_h_integral_x1 - m_h_integral_n);
+        double x = h_integral_inverse(u);
+        double k = floor(x + 0.5);
+
+        if (k < 1)
+            k = 1;
+        else if (k > m_n)
+            k = m_n;
+
+        if (k - x <= m_s || u >= h_integral(k + 0.5) - h(k)) {
+            unsigned long long rank = (unsigned long long) k - 1;
+            return m_scramble ? scramble(rank) : rank;
+        }
+    }
+}
+
+// A fixed 4 round Feistel network is a permutation of [0, 2^(2*bits)); values
+// outside [0, n) are walked on until they land inside, which keeps it one
+// to one over the key range
+unsigned long long zipf_distribution::scramble(unsigned long long rank) const
+{
+    static const unsigned long long round_keys[4] = {
+        0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0xd6e8feb86659fd39ULL
+    };
+    unsigned long long mask = (1ULL << m_half_bits) - 1;
+
+    do {
+        unsigned long long left = rank >> m_half_bits;
+        unsigned long long right = rank & mask;
+
+        for (int i = 0; i < 4; i++) {
+            unsigned long long f = (right ^ round_keys[i]) * 0xff51afd7ed558ccdULL;
+            f ^= f >> 33;
+            unsigned long long tmp = right;
+            right = left ^ (f & mask);
+            left = tmp;
+        }
+        rank = (left << m_half_bits) | right;
+    } while (rank >= m_n);
+
+    return rank;
+}
+
+size_distribution::size_distribution() :
+    m_largest(0)
+{
+}
+
+// CDF and quantile of the GEV and the generalized Pareto distributions
+static double size_cdf(bool gev, double loc, double scale, double shape, double x)
+{
+    double z = (x - loc) / scale;
+    if (gev) {
+        if (shape == 0)
+            return exp(-exp(-z));
+        if (1 + shape * z <= 0)
+            return shape > 0 ? 0 : 1;
+        return exp(-pow(1 + shape * z, -1 / shape));
+    }
+
+    if (z < 0)
+        return 0;
+    if (shape == 0)
+        return 1 - exp(-z);
+    if (1 + shape * z <= 0)
+        return 1;
+    return 1 - pow(1 + shape * z, -1 / shape);
+}
+
+static double size_quantile(bool gev, double loc, double scale, double shape, double p)
+{
+    if (gev) {
+        if (shape == 0)
+            return loc - scale * log(-log(p));
+        return loc + scale / shape * (pow(-log(p), -shape) - 1);
+    }
+
+    if (shape == 0)
+        return loc - scale * log(1 - p);
+    return loc + scale / shape * (pow(1 - p, -shape) - 1);
+}
+
+#define SIZE_DIST_MAX_SIZE  (1024 * 1024)   // default cut of unbounded tails
+
+// gev:LOC,SCALE,SHAPE, gpareto:LOC,SCALE,SHAPE or cdf:FILE.  Parametric
+// distributions are cut to [size_min, size_max] when given (0 if not).
+bool size_distribution::parse(const char* spec, unsigned int size_min, unsigned int size_max)
+{
+    if (strncmp(spec, "gev:", 4) == 0)
+        return parse_parametric(spec + 4, true, size_min, size_max);
+    if (strncmp(spec, "gpareto:", 8) == 0)
+        return parse_parametric(spec + 8, false, size_min, size_max);
+    if (strncmp(spec, "cdf:", 4) == 0) {
+        if (size_max) {
+            fprintf(stderr, "error: data-size-range cannot be used with a CDF file.\n");
+            return false;
+        }
+        return parse_cdf_file(spec + 4);
+    }
+
+    fprintf(stderr, "error: data-size-dist must be gev:LOC,SCALE,SHAPE, gpareto:LOC,SCALE,SHAPE or cdf:FILE.\n");
+    return false;
+}
+
+bool size_distribution::parse_parametric(const char* spec, bool gev, unsigned int size_min, unsigned int size_max)
+{
+    double loc, scale, shape;
+    int len = 0;
+    if (sscanf(spec, "%lf,%lf,%lf%n", &loc, &scale, &shape, &len) != 3 || spec[len] != '\0' || scale <= 0) {
+        fprintf(stderr, "error: data-size-dist parameters must be LOC,SCALE,SHAPE with SCALE greater than zero.\n");
+        return false;
+    }
+
+    // one bucket per size, from the smallest possible to far into the tail
+    unsigned int lo = size_min > 0 ? size_min : 1;
+    unsigned int hi = size_max;
+    if (!hi) {
+        double q = ceil(size_quantile(gev, loc, scale, shape, 1 - 1e-6));
+        hi = (q >= lo && q < SIZE_DIST_MAX_SIZE) ? (unsigned int) q : SIZE_DIST_MAX_SIZE;
+    }
+
+    std::vector<double> weights;
+    double total = 0;
+    for (unsigned int size = lo; size <= hi; size++) {
+        // without a minimum, the smallest size takes all the mass below it
+        double below = (size == lo && !size_min) ? 0 : size_cdf(gev, loc, scale, shape, size - 0.5);
+        double w = size_cdf(gev, loc, scale, shape, size + 0.5) - below;
+        bucket b = { size, size };
+        m_buckets.push_back(b);
+        weights.push_back(w);
+        total += w;
+    }
+    if (!(total > 0)) {
+        fprintf(stderr, "error: data-size-dist has no sizes in %u-%u.\n", lo, hi);
+        return false;
+    }
+
+    m_largest = hi;
+    build_alias_table(weights);
+    return true;
+}
+
+// Lines of "SIZE CDF", sizes ascending and CDF reaching 1; a line stands
+// for the sizes after the one of the previous line up to its own
+bool size_distribution::parse_cdf_file(const char* filename)
+{
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "error: %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+
+    std::vector<double> weights;
+    char line[256];
+    unsigned int line_num = 0;
+    unsigned int prev_size = 0;
+    double prev_cdf = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line_num++;
+
+        char* p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+            continue;
+
+        char* end = NULL;
+        unsigned long size = strtoul(p, &end, 10);
+        double cdf = -1;
+        if (end != p) {
+            p = end;
+            while (*p == ' ' || *p == '\t' || *p == ',')
+                p++;
+            cdf = strtod(p, &end);
+            if (end == p)
+                cdf = -1;
+        }
+        if (cdf < prev_cdf || cdf > 1 + 1e-9 || size == 0 || size <= prev_size || size > UINT_MAX) {
+            fprintf(stderr, "error: %s:%u: expected \"SIZE CDF\" with both ascending and CDF up to 1.\n",
+                    filename, line_num);
+            fclose(f);
+            return false;
+        }
+
+        bucket b = { weights.empty() ? (unsigned int) size : prev_size + 1, (unsigned int) size };
+        m_buckets.push_back(b);
+        weights.push_back(cdf - prev_cdf);
+        prev_size = size;
+        prev_cdf = cdf;
+    }
+    fclose(f);
+
+    if (weights.empty() || prev_cdf < 1 - 1e-6) {
+        fprintf(stderr, "error: %s: the CDF must reach 1.\n", filename);
+        return false;
+    }
+
+    m_largest = prev_size;
+    build_alias_table(weights);
+    return true;
+}
+
+// Vose's alias method: every bucket keeps its own share of a column and
+// lends the rest to one bucket with too much weight
+void size_distribution::build_alias_table(const std::vector<double>& weights)
+{
+    unsigned int n = weights.size();
+    double total = 0;
+    for (unsigned int i = 0; i < n; i++)
+        total += weights[i];
+
+    std::vector<double> scaled(n);
+    std::vector<unsigned int> small, large;
+    for (unsigned int i = 0; i < n; i++) {
+        scaled[i] = weights[i] * n / total;
+        if (scaled[i] < 1)
+            small.push_back(i);
+        else
+            large.push_back(i);
+    }
+
+    m_threshold.assign(n, 1ULL << 32);
+    m_alias.resize(n);
+    for (unsigned int i = 0; i < n; i++)
+        m_alias[i] = i;
+
+    while (!small.empty() && !large.empty()) {
+        unsigned int s = small.back();
+        unsigned int l = large.back();
+        small.pop_back();
+
+        m_threshold[s] = (unsigned long long) (scaled[s] * (1ULL << 32));
+        m_alias[s] = l;
+        scaled[l] -= 1 - scaled[s];
+        if (scaled[l] < 1) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+}
+
+// the upper half of u picks the column, the lower half the bucket in it
+unsigned int size_distribution::sample(unsigned long long u) const
+{
+    unsigned int i = ((u >> 32) * m_buckets.size()) >> 32;
+    if ((u & 0xffffffffULL) >= m_threshold[i])
+        i = m_alias[i];
+
+    const bucket& b = m_buckets[i];
+    if (b.lo == b.hi)
+        return b.lo;
+    return b.lo + ((u * 0x9e3779b97f4a7c15ULL) >> 32) % (b.hi - b.lo + 1);
+}
+
 object_generator::object_generator() :
     m_data_size_type(data_size_unknown),
     m_data_size_pattern(NULL),
+    m_data_size_per_key(false),
+    m_size_seed(0),
     m_random_data(false),
     m_expiry_min(0),
     m_expiry_max(0),
@@ -145,6 +486,10 @@ object_generator::object_generator() :
     m_key_max(0),
     m_key_stddev(0),
     m_key_median(0),
+    m_hot_windows(NULL),
+    m_hot_current(NULL),
+    m_latest_key(0),
+    m_key_width(0),
     m_value_buffer(NULL),
     m_random_fd(-1),
     m_value_buffer_size(0),
@@ -160,6 +505,8 @@ object_generator::object_generator(const object_generator& copy) :
     m_data_size_type(copy.m_data_size_type),
     m_data_size(copy.m_data_size),
     m_data_size_pattern(copy.m_data_size_pattern),
+    m_data_size_per_key(copy.m_data_size_per_key),
+    m_size_seed(copy.m_size_seed),
     m_random_data(copy.m_random_data),
     m_expiry_min(copy.m_expiry_min),
     m_expiry_max(copy.m_expiry_max),
@@ -168,6 +515,12 @@ object_generator::object_generator(const object_generator& copy) :
     m_key_max(copy.m_key_max),
     m_key_stddev(copy.m_key_stddev),
     m_key_median(copy.m_key_median),
+    m_key_zipf(copy.m_key_zipf),
+    m_hot_windows(copy.m_hot_windows),
+    m_hot_current(copy.m_hot_current),
+    m_latest_key(copy.m_key_min),
+    m_key_width(copy.m_key_width),
+    m_key(copy.m_key),
     m_value_buffer(NULL),
     m_random_fd(-1),
     m_value_buffer_size(0),
@@ -201,7 +554,7 @@ object_generator* object_generator::clone(void)
     return new object_generator(*this);
 }
 
-void object_generator::set_random_seed(int seed)
+void object_generator::set_random_seed(unsigned long long seed)
 {
     m_random.set_seed(seed);
 }
@@ -220,6 +573,8 @@ void object_generator::alloc_value_buffer(void)
     else if (m_data_size_type == data_size_weighted) {
         size = m_data_size.size_list->largest();
     }
+    else if (m_data_size_type == data_size_distribution)
+        size = m_data_size.size_dist->largest();
 
     m_value_buffer_size = size;
     if (size > 0) {
@@ -277,6 +632,8 @@ void object_generator::alloc_value_buffer(const char* copy_from)
         size = m_data_size.size_range.size_max;
     else if (m_data_size_type == data_size_weighted)
         size = m_data_size.size_list->largest();
+    else if (m_data_size_type == data_size_distribution)
+        size = m_data_size.size_dist->largest();
 
     m_value_buffer_size = size;
     if (size > 0) {
@@ -321,6 +678,22 @@ void object_generator::set_data_size_pattern(const char* pattern)
     m_data_size_pattern = pattern;
 }
 
+void object_generator::set_data_size_distribution(const size_distribution* size_dist)
+{
+    if (m_data_size_type == data_size_weighted && m_data_size.size_list != NULL) {
+        delete m_data_size.size_list;
+    }
+    m_data_size_type = data_size_distribution;
+    m_data_size.size_dist = size_dist;
+    alloc_value_buffer();
+}
+
+void object_generator::set_data_size_per_key(bool per_key, unsigned long long seed)
+{
+    m_data_size_per_key = per_key;
+    m_size_seed = seed;
+}
+
 void object_generator::set_expiry_range(unsigned int expiry_min, unsigned int expiry_max)
 {
     m_expiry_min = expiry_min;
@@ -330,12 +703,23 @@ void object_generator::set_expiry_range(unsigned int expiry_min, unsigned int ex
 void object_generator::set_key_prefix(const char *key_prefix)
 {
     m_key_prefix = key_prefix;
+    m_key.set_prefix(m_key_prefix, m_key_width);
+}
+
+void object_generator::set_key_width(unsigned int key_width)
+{
+    m_key_width = key_width;
+    m_key.set_prefix(m_key_prefix, m_key_width);
 }
 
 void object_generator::set_key_range(unsigned long long key_min, unsigned long long key_max)
 {
     m_key_min = key_min;
     m_key_max = key_max;
+
+    // a Zipf sampler follows the range, e.g. a client's share under P
+    if (m_key_zipf.is_set())
+        m_key_zipf.set_n(m_key_max - m_key_min + 1);
 }
 
 void object_generator::set_key_distribution(double key_stddev, double key_median)
@@ -344,6 +728,18 @@ void object_generator::set_key_distribution(double key_stddev, double key_median
     m_key_median = key_median;
 }
 
+void object_generator::set_key_zipf(double exponent, bool scramble)
+{
+    m_key_zipf.set_params(m_key_max - m_key_min + 1, exponent, scramble);
+}
+
+void object_generator::set_key_hot_windows(const key_hot_window* windows, const std::atomic<unsigned int>* current)
+{
+    m_hot_windows = windows;
+    m_hot_current = current;
+    m_latest_key = m_key_min;
+}
+
 // return a random number between r_min and r_max
 unsigned long long object_generator::random_range(unsigned long long r_min, unsigned long long  r_max)
 {
@@ -357,15 +753,44 @@ unsigned long long object_generator::normal_distribution(unsigned long long r_mi
     return m_random.gaussian_distribution_range(r_stddev, r_median, r_min, r_max);
 }
 
+// return a key of the current hot window with its fraction, any other key otherwise
+unsigned long long object_generator::hot_window_distribution(bool latest)
+{
+    const key_hot_window& w = m_hot_windows[m_hot_current->load(std::memory_order_acquire)];
+    unsigned long long n = m_key_max - m_key_min + 1;
+    unsigned long long size = w.size ? (w.size < n ? w.size : n) : (n >= 5 ? n / 5 : 1);
+    unsigned long long offset;
+
+    bool hot = size == n || m_random.get_random() < w.fraction * m_random.get_random_max();
+    if (hot)
+        offset = m_random.get_random() % size;
+    else
+        offset = size + m_random.get_random() % (n - size);
+
+    if (latest) {
+        // counting back from the newest key, itself included
+        unsigned long long newest = m_latest_key - m_key_min;
+        return m_key_min + (newest + n - offset) % n;
+    }
+    unsigned long long start = w.start > m_key_min ? w.start - m_key_min : 0;
+    return m_key_min + (start % n + offset) % n;
+}
+
 unsigned long long object_generator::get_key_index(int iter)
 {
-    assert(iter < OBJECT_GENERATOR_KEY_ITERATORS && iter >= OBJECT_GENERATOR_KEY_GAUSSIAN);
+    assert(iter < OBJECT_GENERATOR_KEY_ITERATORS && iter >= OBJECT_GENERATOR_KEY_LATEST);
 
     unsigned long long k;
     if (iter==OBJECT_GENERATOR_KEY_RANDOM) {
         k = random_range(m_key_min, m_key_max);
     } else if(iter==OBJECT_GENERATOR_KEY_GAUSSIAN) {
         k = normal_distribution(m_key_min, m_key_max, m_key_stddev, m_key_median);
+    } else if(iter==OBJECT_GENERATOR_KEY_ZIPF) {
+        k = m_key_min + m_key_zipf.sample(m_random);
+    } else if(iter==OBJECT_GENERATOR_KEY_HOTSPOT) {
+        k = hot_window_distribution(false);
+    } else if(iter==OBJECT_GENERATOR_KEY_LATEST) {
+        return hot_window_distribution(true);
     } else {
         if (m_next_key[iter] < m_key_min)
             m_next_key[iter] = m_key_min;
@@ -375,6 +800,7 @@ unsigned long long object_generator::get_key_index(int iter)
         if (m_next_key[iter] > m_key_max)
             m_next_key[iter] = m_key_min;
     }
+    m_latest_key = k;
     return k;
 }
 
@@ -384,11 +810,10 @@ const char* object_generator::get_key(int iter, unsigned int *len)
     m_key_index = get_key_index(iter);
     
     // format key
-    l = snprintf(m_key_buffer, sizeof(m_key_buffer)-1,
-        "%s%llu", m_key_prefix, m_key_index);
+    l = m_key.build(m_key_index);
     if (len != NULL) *len = l;
     
-    return m_key_buffer;
+    return m_key.get_key();
 }
 
 data_object* object_generator::get_object(int iter)
@@ -397,22 +822,7 @@ data_object* object_generator::get_object(int iter)
     (void) get_key(iter, NULL);
     
     // compute size
-    unsigned int new_size = 0;
-    if (m_data_size_type == data_size_fixed) {
-        new_size = m_data_size.size_fixed;
-    } else if (m_data_size_type == data_size_range) {
-        if (m_data_size_pattern && *m_data_size_pattern=='S') {
-            double a = (m_key_index-m_key_min)/static_cast<double>(m_key_max-m_key_min);
-            new_size = (m_data_size.size_range.size_max-m_data_size.size_range.size_min)*a + m_data_size.size_range.size_min;
-        } else {
-            new_size = random_range(m_data_size.size_range.size_min > 0 ? m_data_size.size_range.size_min : 1,
-                m_data_size.size_range.size_max);
-        }
-    } else if (m_data_size_type == data_size_weighted) {
-        new_size = m_data_size.size_list->get_next_size();
-    } else {
-        assert(0);
-    }
+    unsigned int new_size = get_value_size(m_key_index);
     
     // compute expiry
     int expiry = 0;
@@ -428,7 +838,7 @@ data_object* object_generator::get_object(int iter)
     }
 
     // set object
-    m_object.set_key(m_key_buffer, strlen(m_key_buffer));
+    m_object.set_key(m_key.get_key(), m_key.get_len());
     m_object.set_value(m_value_buffer, new_size);
     m_object.set_expiry(expiry);    
     
@@ -439,24 +849,41 @@ const char* object_generator::get_key_prefix() {
     return m_key_prefix;
 }
 
-const char* object_generator::get_value(unsigned long long key_index, unsigned int *len) {
-    // compute size
+// with --data-size-per-key the key index picks the random number, so a key
+// keeps its size across SETs
+unsigned long long object_generator::size_random(unsigned long long key_index)
+{
+    if (m_data_size_per_key)
+        return prng_seed_child(m_size_seed, key_index);
+    return m_random.get_random();
+}
+
+unsigned int object_generator::get_value_size(unsigned long long key_index)
+{
     unsigned int new_size = 0;
     if (m_data_size_type == data_size_fixed) {
         new_size = m_data_size.size_fixed;
     } else if (m_data_size_type == data_size_range) {
+        unsigned int size_min = m_data_size.size_range.size_min > 0 ? m_data_size.size_range.size_min : 1;
         if (m_data_size_pattern && *m_data_size_pattern=='S') {
             double a = (key_index-m_key_min)/static_cast<double>(m_key_max-m_key_min);
             new_size = (m_data_size.size_range.size_max-m_data_size.size_range.size_min)*a + m_data_size.size_range.size_min;
         } else {
-            new_size = random_range(m_data_size.size_range.size_min > 0 ? m_data_size.size_range.size_min : 1,
-                                    m_data_size.size_range.size_max);
+            new_size = size_random(key_index) % (m_data_size.size_range.size_max - size_min + 1) + size_min;
         }
     } else if (m_data_size_type == data_size_weighted) {
         new_size = m_data_size.size_list->get_next_size();
+    } else if (m_data_size_type == data_size_distribution) {
+        new_size = m_data_size.size_dist->sample(size_random(key_index));
     } else {
         assert(0);
     }
+    return new_size;
+}
+
+const char* object_generator::get_value(unsigned long long key_index, unsigned int *len) {
+    // compute size
+    unsigned int new_size = get_value_size(key_index);
 
     // modify object content in case of random data
     if (m_random_data) {
@@ -542,100 +969,31 @@ unsigned int data_object::get_expiry(void)
 
 ///////////////////////////////////////////////////////////////////////////
 
-imported_keylist::imported_keylist(const char *filename)
-    : m_filename(filename)    
-{
-}
-
-imported_keylist::~imported_keylist()
-{
-    while (!m_keys.empty()) {
-        free(m_keys.front());
-        m_keys.erase(m_keys.begin());
-    }
-}
-
-bool imported_keylist::read_keys(void)
-{
-    file_reader f(m_filename);
-
-    if (!f.open_file())
-        return false;
-    while (!f.is_eof()) {
-        memcache_item *i = f.read_item();
-
-        if (i != NULL) {
-            key* k = (key*) malloc(i->get_nkey() + sizeof(key) + 1);
-            assert(k != NULL);
-            k->key_len = i->get_nkey();
-            memcpy(k->key_data, i->get_key(), i->get_nkey());
-            delete i;
-
-            m_keys.push_back(k);
-        }
-    }
-
-    return true;
-}
-
-unsigned int imported_keylist::size(void)
-{
-    return m_keys.size();
-}
-
-const char* imported_keylist::get(unsigned int pos, unsigned int *len)
-{
-    if (pos >= m_keys.size())
-        return NULL;
-
-    key* k = m_keys[pos];
-    if (len != NULL) *len = k->key_len;
-
-    return k->key_data;
-}
-
-///////////////////////////////////////////////////////////////////////////
-
-import_object_generator::import_object_generator(const char *filename, imported_keylist *keys, bool no_expiry) :
-    m_keys(keys),
-    m_reader(filename),
-    m_cur_item(NULL),
-    m_reader_opened(false),
+import_object_generator::import_object_generator(imported_dataset* dataset, bool import_keys, bool no_expiry) :
+    m_dataset(dataset),
+    m_import_keys(import_keys),
+    m_file_order(true),
+    m_next_item(0),
     m_no_expiry(no_expiry)
 {
-    if (m_keys != NULL) {
-        m_key_max = m_keys->size();
+    if (m_import_keys) {
+        m_key_max = m_dataset->size();
         m_key_min = 1;
     }
 }
 
 import_object_generator::~import_object_generator()
 {
-    if (m_cur_item != NULL)
-        delete m_cur_item;
 }
 
 import_object_generator::import_object_generator(const import_object_generator& from) :
     object_generator(from),
-    m_keys(from.m_keys),
-    m_reader(from.m_reader),
-    m_cur_item(NULL),
+    m_dataset(from.m_dataset),
+    m_import_keys(from.m_import_keys),
+    m_file_order(from.m_file_order),
+    m_next_item(0),
     m_no_expiry(from.m_no_expiry)
 {
-    if (m_keys != NULL) {
-        m_key_max = m_keys->size();
-        m_key_min = 1;
-    }
-    if (from.m_reader_opened) {
-        bool r = m_reader.open_file();
-        assert(r == true);
-    }
-}
-
-bool import_object_generator::open_file(void)
-{
-    m_reader_opened = true;
-    return m_reader.open_file();
 }
 
 import_object_generator* import_object_generator::clone(void)
@@ -645,49 +1003,50 @@ import_object_generator* import_object_generator::clone(void)
 
 const char* import_object_generator::get_key(int iter, unsigned int *len)
 {
-    if (m_keys == NULL) {
+    if (!m_import_keys) {
         return object_generator::get_key(iter, len);
     } else {
         unsigned int k = get_key_index(iter) - 1;
-        return m_keys->get(k, len);
+        return m_dataset->get_key(k, len);
     }
 }
 
 data_object* import_object_generator::get_object(int iter)
-{    
-    memcache_item *i = m_reader.read_item();
-
-    if (i == NULL && m_reader.is_eof()) {
-        m_reader.open_file();
-        i = m_reader.read_item();
+{
+    // with imported keys an explicit key pattern picks the item, so any
+    // pattern replays the dataset; else every clone walks it in file order
+    unsigned int pos;
+    if (m_import_keys && !m_file_order) {
+        pos = get_key_index(iter) - 1;
+    } else {
+        pos = m_next_item;
+        if (++m_next_item >= m_dataset->size())
+            m_next_item = 0;
     }
 
-    assert(i != NULL);
-    if (m_cur_item != NULL) {
-        delete m_cur_item;
-    }
-    m_cur_item = i;
-    
-    m_object.set_value(m_cur_item->get_data(), m_cur_item->get_nbytes() - 2);
-    if (m_keys != NULL) {
-        m_object.set_key(m_cur_item->get_key(), m_cur_item->get_nkey());
+    unsigned int nbytes;
+    const char *data = m_dataset->get_data(pos, &nbytes);
+    m_object.set_value(data, nbytes - 2);
+    if (m_import_keys) {
+        unsigned int nkey;
+        const char *key = m_dataset->get_key(pos, &nkey);
+        m_object.set_key(key, nkey);
     } else {
         unsigned int tmplen;
         const char *tmpkey = object_generator::get_key(iter, &tmplen);
         m_object.set_key(tmpkey, tmplen);
     }
-    
+
     // compute expiry
     int expiry = 0;
     if (!m_no_expiry) {
         if (m_expiry_max > 0) {
             expiry = random_range(m_expiry_min, m_expiry_max);
         } else {
-            expiry = m_cur_item->get_exptime();
+            expiry = m_dataset->get_exptime(pos);
         }
         m_object.set_expiry(expiry);
     }
 
     return &m_object;
 }
-
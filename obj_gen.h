@@ -20,9 +20,10 @@
 #define _OBJ_GEN_H
 
 #include <vector>
+#include <atomic>
 #include "file_io.h"
+#include "prng.h"
 
-struct random_data;
 struct config_weight_list;
 
 class random_generator {
@@ -30,14 +31,9 @@ public:
     random_generator();
     unsigned long long get_random();
     unsigned long long get_random_max() const;
-    void set_seed(int seed);
+    void set_seed(unsigned long long seed);
 private:
-#ifdef HAVE_RANDOM_R
-    struct random_data m_data_blob;
-    char m_state_array[512];
-#elif (defined HAVE_DRAND48)
-    unsigned short m_data_blob[3];
-#endif
+    xoshiro256ss m_engine;
 };
 
 class gaussian_noise: public random_generator {
@@ -50,6 +46,59 @@ private:
 	double m_spare;
 };
 
+// Zipf distribution over ranks [1, n] by rejection-inversion (Hoermann and
+// Derflinger), constant setup and sampling time without any table, so it
+// suits key ranges of billions.  Ranks can be scrambled over the range so
+// the hot keys don't end up next to each other.
+class zipf_distribution {
+public:
+    zipf_distribution();
+    void set_params(unsigned long long n, double exponent, bool scramble);
+    void set_n(unsigned long long n) { set_params(n, m_exponent, m_scramble); }
+    bool is_set() const { return m_n > 0; }
+    unsigned long long sample(random_generator& random);
+private:
+    double h(double x) const;
+    double h_integral(double x) const;
+    double h_integral_inverse(double x) const;
+    unsigned long long scramble(unsigned long long rank) const;
+
+    unsigned long long m_n;
+    double m_exponent;
+    double m_h_integral_x1;
+    double m_h_integral_n;
+    double m_s;
+    bool m_scramble;
+    unsigned int m_half_bits;           // Feistel half width, 2^(2*bits) >= n
+};
+
+// Value sizes drawn from a parametric (GEV, generalized Pareto) or an
+// empirical (CDF file) distribution.  The distribution is cut into size
+// buckets, picked in O(1) through an alias table, uniform within a bucket.
+// Built once and shared read only by all the object generators.
+class size_distribution {
+public:
+    size_distribution();
+    bool parse(const char* spec, unsigned int size_min, unsigned int size_max);
+
+    unsigned int sample(unsigned long long u) const;
+    unsigned int largest() const { return m_largest; }
+private:
+    struct bucket {
+        unsigned int lo;
+        unsigned int hi;
+    };
+
+    bool parse_parametric(const char* spec, bool gev, unsigned int size_min, unsigned int size_max);
+    bool parse_cdf_file(const char* filename);
+    void build_alias_table(const std::vector<double>& weights);
+
+    std::vector<bucket> m_buckets;
+    std::vector<unsigned long long> m_threshold;    // of the bucket itself, out of 2^32
+    std::vector<unsigned int> m_alias;
+    unsigned int m_largest;
+};
+
 class data_object {
 protected:    
     const char *m_key;
@@ -70,15 +119,46 @@ public:
     unsigned int get_expiry(void);    
 };
 
+// Builds prefix + key index keys without going through a format string:
+// the prefix is copied once and only the digits are rewritten per key,
+// zero padded to width digits if set
+class key_builder {
+public:
+    key_builder();
+    void set_prefix(const char* prefix, unsigned int width);
+    unsigned int build(unsigned long long key_index);
+
+    const char* get_key() const { return m_buffer; }
+    unsigned int get_len() const { return m_len; }
+private:
+    char m_buffer[250];
+    unsigned int m_prefix_len;
+    unsigned int m_width;
+    unsigned int m_len;
+};
+
 #define OBJECT_GENERATOR_KEY_ITERATORS  2 /* number of iterators */
 #define OBJECT_GENERATOR_KEY_SET_ITER   1
 #define OBJECT_GENERATOR_KEY_GET_ITER   0
 #define OBJECT_GENERATOR_KEY_RANDOM    -1
 #define OBJECT_GENERATOR_KEY_GAUSSIAN  -2
+#define OBJECT_GENERATOR_KEY_ZIPF      -3
+#define OBJECT_GENERATOR_KEY_HOTSPOT   -4
+#define OBJECT_GENERATOR_KEY_LATEST    -5
+
+// Fraction of the keys drawn uniformly from a window of size keys, the rest
+// uniformly from the others.  The hotspot pattern places the window at
+// start, the latest pattern right behind the newest key drawn otherwise.
+// Windows wrap around the key range; a size of 0 is a fifth of it.
+struct key_hot_window {
+    unsigned long long start;
+    unsigned long long size;
+    double fraction;
+};
 
 class object_generator {
 public:
-    enum data_size_type { data_size_unknown, data_size_fixed, data_size_range, data_size_weighted };
+    enum data_size_type { data_size_unknown, data_size_fixed, data_size_range, data_size_weighted, data_size_distribution };
 protected:
     data_size_type m_data_size_type;
     union {
@@ -88,8 +168,11 @@ protected:
             unsigned int size_max;
         } size_range;
         config_weight_list* size_list;
+        const size_distribution* size_dist;
     } m_data_size;
     const char *m_data_size_pattern;
+    bool m_data_size_per_key;       // random sizes derive from the key index
+    unsigned long long m_size_seed; // and from this seed
     bool m_random_data;
     unsigned int m_expiry_min;
     unsigned int m_expiry_max;
@@ -98,12 +181,17 @@ protected:
     unsigned long long m_key_max;
     double m_key_stddev;
     double m_key_median;
+    zipf_distribution m_key_zipf;
+    const key_hot_window* m_hot_windows;            // shared, the master picks the current one
+    const std::atomic<unsigned int>* m_hot_current;
+    unsigned long long m_latest_key;
     data_object m_object;
 
     unsigned long long m_next_key[OBJECT_GENERATOR_KEY_ITERATORS];
 
     unsigned long long m_key_index;
-    char m_key_buffer[250];
+    unsigned int m_key_width;
+    key_builder m_key;
     char *m_value_buffer;
     int m_random_fd;
     gaussian_noise m_random;
@@ -113,6 +201,7 @@ protected:
     void alloc_value_buffer(void);
     void alloc_value_buffer(const char* copy_from);
     void random_init(void);
+    unsigned long long size_random(unsigned long long key_index);
 public:    
     object_generator();
     object_generator(const object_generator& copy);
@@ -121,56 +210,44 @@ public:
 
     unsigned long long random_range(unsigned long long r_min, unsigned long long r_max);
     unsigned long long normal_distribution(unsigned long long r_min, unsigned long long r_max, double r_stddev, double r_median);
+    unsigned long long hot_window_distribution(bool latest);
 
     void set_random_data(bool random_data);
     void set_data_size_fixed(unsigned int size);
     void set_data_size_range(unsigned int size_min, unsigned int size_max);
     void set_data_size_list(config_weight_list* data_size_list);
     void set_data_size_pattern(const char* pattern);
+    void set_data_size_distribution(const size_distribution* size_dist);
+    void set_data_size_per_key(bool per_key, unsigned long long seed);
     void set_expiry_range(unsigned int expiry_min, unsigned int expiry_max);
     void set_key_prefix(const char *key_prefix);    
+    void set_key_width(unsigned int key_width);
     void set_key_range(unsigned long long key_min, unsigned long long key_max);
     void set_key_distribution(double key_stddev, double key_median);
-    void set_random_seed(int seed);
+    void set_key_zipf(double exponent, bool scramble);
+    void set_key_hot_windows(const key_hot_window* windows, const std::atomic<unsigned int>* current);
+    void set_random_seed(unsigned long long seed);
 
     unsigned long long get_key_index(int iter);
     virtual const char* get_key(int iter, unsigned int *len);
     virtual data_object* get_object(int iter);
 
     const char * get_key_prefix();
+    const key_builder& get_key_builder() const { return m_key; }
+    unsigned int get_value_size(unsigned long long key_index);
     const char* get_value(unsigned long long key_index, unsigned int *len);
     unsigned int get_expiry();
 };
 
-class imported_keylist;
-class memcache_item;
-
-class imported_keylist {
-protected:
-    struct key {
-        unsigned int key_len;
-        char key_data[0];
-    };
-    const char *m_filename;
-    std::vector<key*> m_keys;
-public:
-    imported_keylist(const char *filename);
-    ~imported_keylist();
-
-    bool read_keys(void);
-    unsigned int size();
-    const char* get(unsigned int pos, unsigned int *len);
-};
-
 class import_object_generator : public object_generator {
 protected:
-    imported_keylist* m_keys;
-    file_reader m_reader;
-    memcache_item* m_cur_item;
-    bool m_reader_opened;
+    imported_dataset* m_dataset;
+    bool m_import_keys;
+    bool m_file_order;
+    unsigned int m_next_item;
     bool m_no_expiry;
 public:
-    import_object_generator(const char *filename, imported_keylist* keys, bool no_expiry);
+    import_object_generator(imported_dataset* dataset, bool import_keys, bool no_expiry);
     import_object_generator(const import_object_generator& from);
     virtual ~import_object_generator();
     virtual import_object_generator* clone(void);
@@ -178,7 +255,7 @@ public:
     virtual const char* get_key(int iter, unsigned int *len);
     virtual data_object* get_object(int iter);
 
-    bool open_file(void);
+    void set_file_order(bool file_order) { m_file_order = file_order; }
 };
 
 #endif /* _OBJ_GEN_H */
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2011-2017 Redis Labs Ltd.
+ *
+ * This file is part of memtier_benchmark.
+ *
+ * memtier_benchmark is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 2.
+ *
+ * memtier_benchmark is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with memtier_benchmark.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PRNG_H
+#define _PRNG_H
+
+#include <stdint.h>
+
+// SplitMix64 step, used to expand seeds and to derive child seeds
+static inline uint64_t splitmix64(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Seed of child index of a seed tree node.  Every random stream of a run is
+// a path from the --seed root, so streams are independent of each other and
+// the same across runs with the same seed.
+static inline uint64_t prng_seed_child(uint64_t seed, uint64_t index)
+{
+    uint64_t state = seed ^ splitmix64(&index);
+    return splitmix64(&state);
+}
+
+// xoshiro256** (Blackman and Vigna): 32 bytes of state, a few shifts and
+// multiplies per 64 bit number.  Usable as a UniformRandomBitGenerator.
+class xoshiro256ss {
+public:
+    typedef uint64_t result_type;
+
+    explicit xoshiro256ss(uint64_t seed = 0) { set_seed(seed); }
+
+    void set_seed(uint64_t seed) {
+        for (int i = 0; i < 4; i++)
+            m_s[i] = splitmix64(&seed);
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(m_s[1] * 5, 7) * 9;
+        uint64_t t = m_s[1] << 17;
+
+        m_s[2] ^= m_s[0];
+        m_s[3] ^= m_s[1];
+        m_s[1] ^= m_s[2];
+        m_s[0] ^= m_s[3];
+        m_s[2] ^= t;
+        m_s[3] = rotl(m_s[3], 45);
+
+        return result;
+    }
+
+    // uniform in [0, 1)
+    double next_double() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    result_type operator()() { return next(); }
+
+private:
+    static inline uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t m_s[4];
+};
+
+#endif /* _PRNG_H */
@@ -23,6 +23,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 #ifdef HAVE_ASSERT_H
 #include <assert.h>
 #endif
@@ -34,12 +37,15 @@
 /////////////////////////////////////////////////////////////////////////
 
 abstract_protocol::abstract_protocol() :
-    m_read_buf(NULL), m_write_buf(NULL), m_keep_value(false)
+    m_read_buf(NULL), m_write_buf(NULL), m_keep_value(false), m_opaque(0),
+    m_zero_copy(false), m_noreply(false), m_value_refs(0)
 {    
 }
 
 abstract_protocol::~abstract_protocol()
 {
+    // the write buffer must be freed before the protocol it calls back into
+    assert(m_value_refs == 0);
 }
 
 void abstract_protocol::set_buffers(struct evbuffer* read_buf, struct evbuffer* write_buf)
@@ -53,16 +59,56 @@ void abstract_protocol::set_keep_value(bool flag)
     m_keep_value = flag;
 }
 
+void abstract_protocol::set_opaque(unsigned int opaque)
+{
+    m_opaque = opaque;
+}
+
+void abstract_protocol::set_zero_copy(bool flag)
+{
+    m_zero_copy = flag;
+}
+
+void abstract_protocol::set_noreply(bool flag)
+{
+    m_noreply = flag;
+}
+
+void abstract_protocol::value_ref_cleanup(const void *data, size_t datalen, void *extra)
+{
+    abstract_protocol *protocol = (abstract_protocol *) extra;
+    assert(protocol->m_value_refs > 0);
+    protocol->m_value_refs--;
+}
+
+// In zero-copy mode the value is referenced by the write buffer rather than
+// copied into it. This is only safe because values come from the object
+// generator's value buffer, which is filled once during setup and outlives
+// every connection of the client.
+void abstract_protocol::add_value(const char *value, int value_len)
+{
+    if (m_zero_copy) {
+        m_value_refs++;
+        evbuffer_add_reference(m_write_buf, value, value_len, value_ref_cleanup, this);
+    } else {
+        evbuffer_add(m_write_buf, value, value_len);
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////
 
 protocol_response::protocol_response()
-    : m_status(NULL), m_value(NULL), m_mbulk_value(NULL), m_value_len(0), m_hits(0), m_error(false)
+    : m_status(NULL), m_status_buf(NULL), m_status_buf_size(0), m_value(NULL), m_mbulk_value(NULL), m_value_len(0), m_hits(0), m_opaque(0), m_cas(0), m_error(false)
 {
 }
 
 protocol_response::~protocol_response()
 {
     clear();
+    if (m_status_buf != NULL) {
+        free(m_status_buf);
+        m_status_buf = NULL;
+    }
 }
 
 void protocol_response::set_error(bool error)
@@ -77,11 +123,25 @@ bool protocol_response::is_error(void)
 
 void protocol_response::set_status(const char* status)
 {
-    if (m_status != NULL)
+    if (m_status != NULL && m_status != m_status_buf)
         free((void *)m_status);
     m_status = status;
 }
 
+// Copy a status line that is still in the read buffer into a buffer owned
+// by the response, which only grows, so a steady state costs no allocation.
+void protocol_response::set_status_line(const char* line, unsigned int line_len)
+{
+    if (line_len + 1 > m_status_buf_size) {
+        m_status_buf_size = line_len + 1;
+        m_status_buf = (char *) realloc(m_status_buf, m_status_buf_size);
+        assert(m_status_buf != NULL);
+    }
+    memcpy(m_status_buf, line, line_len);
+    m_status_buf[line_len] = '\0';
+    set_status(m_status_buf);
+}
+
 const char* protocol_response::get_status(void)
 {
     return m_status;
@@ -123,10 +183,31 @@ unsigned int protocol_response::get_hits(void)
     return m_hits;
 }
 
+void protocol_response::set_opaque(unsigned int opaque)
+{
+    m_opaque = opaque;
+}
+
+unsigned int protocol_response::get_opaque(void)
+{
+    return m_opaque;
+}
+
+void protocol_response::set_cas(unsigned long long cas)
+{
+    m_cas = cas;
+}
+
+unsigned long long protocol_response::get_cas(void)
+{
+    return m_cas;
+}
+
 void protocol_response::clear(void)
 {
     if (m_status != NULL) {
-        free((void *)m_status);
+        if (m_status != m_status_buf)
+            free((void *)m_status);
         m_status = NULL;
     }
     if (m_value != NULL) {
@@ -141,6 +222,8 @@ void protocol_response::clear(void)
     m_value_len = 0;
     m_total_len = 0;
     m_hits = 0;
+    m_opaque = 0;
+    m_cas = 0;
     m_error = 0;
 }
 
@@ -148,27 +231,6 @@ void protocol_response::set_mbulk_value(mbulk_element* element) {
     m_mbulk_value = element;
 }
 
-void protocol_response::add_mbulk_array(mbulk_level_array* array, mbulk_element* element, int count) {
-    add_mbulk_value(array, element);
-
-    // create new nested level
-    mbulk_level* new_level = new mbulk_level(count, element);
-    array->push_back(new_level);
-}
-
-void protocol_response::add_mbulk_value(mbulk_level_array* array, mbulk_element* element) {
-    mbulk_level* cur_level = array->back();
-
-    // insert new object into current nested mbulk
-    cur_level->mbulk->mbulk_array.push_back(element);
-
-    // update current mbulk
-    cur_level->mbulk_count--;
-
-    if (cur_level->mbulk_count == 0)
-        array->pop_back();
-}
-
 const mbulk_element* protocol_response::get_mbulk_value() {
     return m_mbulk_value;
 }
@@ -177,13 +239,22 @@ const mbulk_element* protocol_response::get_mbulk_value() {
 
 class redis_protocol : public abstract_protocol {
 protected:
-    enum response_state { rs_initial, rs_read_bulk, rs_read_mbulk };
+    enum response_state { rs_initial, rs_read_bulk };
     response_state m_response_state;
     unsigned int m_bulk_len;
-    size_t m_response_len;
-    mbulk_level_array current_mbulk_level;
+    size_t m_response_len;                      // bytes of the current response consumed so far
+    std::vector<unsigned int> m_agg_remaining;  // elements still expected by each open aggregate
+    std::vector<mbulk_element*> m_agg_elements; // open aggregates, only when they are kept
+    bool m_keep_aggregate;                      // build the current response's aggregates
+    unsigned int m_keep_mbulk;                  // CLUSTER SLOTS replies still to be kept
+
+    int peek_line(const char **line);
+    void add_element(mbulk_element* element);
+    bool complete_element(void);
+    int write_bulk(const char *data, unsigned int len);
 public:
-    redis_protocol() : m_response_state(rs_initial), m_bulk_len(0), m_response_len(0) { }
+    redis_protocol() : m_response_state(rs_initial), m_bulk_len(0), m_response_len(0),
+        m_keep_aggregate(false), m_keep_mbulk(0) { }
     virtual redis_protocol* clone(void) { return new redis_protocol(); }
     virtual int select_db(int db);
     virtual int authenticate(const char *credentials);
@@ -191,7 +262,21 @@ public:
     virtual int write_command_set(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned int offset);
     virtual int write_command_get(const char *key, int key_len, unsigned int offset);
     virtual int write_command_multi_get(const keylist *keylist);
+    virtual int write_command_delete(const char *key, int key_len);
+    virtual int write_command_incr(const char *key, int key_len, unsigned int delta, bool decr);
+    virtual int write_command_append(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_touch(const char *key, int key_len, int expiry);
+    virtual int write_command_gets(const char *key, int key_len);
+    virtual int write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas);
+    virtual int write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len);
+    virtual int write_command_hget(const char *key, int key_len, const char *field, int field_len);
+    virtual int write_command_lpush(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_lrange(const char *key, int key_len, int start, int stop);
+    virtual int write_command_ltrim(const char *key, int key_len, int start, int stop);
+    virtual int write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len);
+    virtual int write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max);
     virtual int write_command_wait(unsigned int num_slaves, unsigned int timeout);
+    virtual int write_command_fence(void);
     virtual int parse_response(void);
 };
 
@@ -238,6 +323,9 @@ int redis_protocol::write_command_cluster_slots()
                         "SLOTS\r\n",
                         28);
 
+    // its array is the only one the benchmark needs to look into
+    m_keep_mbulk++;
+
     return size;
 }
 
@@ -293,7 +381,7 @@ int redis_protocol::write_command_set(const char *key, int key_len, const char *
             "%s\r\n"
             "$%u\r\n", (unsigned int) strlen(expiry_str), expiry_str, value_len);
     }
-    evbuffer_add(m_write_buf, value, value_len);
+    add_value(value, value_len);
     evbuffer_add(m_write_buf, "\r\n", 2);
     size += value_len + 2;
 
@@ -306,43 +394,129 @@ int redis_protocol::write_command_multi_get(const keylist *keylist)
     assert(0);
 }
 
-int redis_protocol::write_command_get(const char *key, int key_len, unsigned int offset)
+int redis_protocol::write_command_delete(const char *key, int key_len)
 {
     assert(key != NULL);
     assert(key_len > 0);
     int size = 0;
-    
-    if (!offset) {
+
+    size = evbuffer_add_printf(m_write_buf,
+        "*2\r\n"
+        "$3\r\n"
+        "DEL\r\n"
+        "$%u\r\n", key_len);
+    evbuffer_add(m_write_buf, key, key_len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    size += key_len + 2;
+
+    return size;
+}
+
+int redis_protocol::write_command_incr(const char *key, int key_len, unsigned int delta, bool decr)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+    char delta_str[20];
+
+    if (delta == 1) {
         size = evbuffer_add_printf(m_write_buf,
             "*2\r\n"
-            "$3\r\n"
-            "GET\r\n"
+            "$4\r\n"
+            "%s\r\n", decr ? "DECR" : "INCR");
+        size += write_bulk(key, key_len);
+        return size;
+    }
+
+    snprintf(delta_str, sizeof(delta_str)-1, "%u", delta);
+    size = evbuffer_add_printf(m_write_buf,
+        "*3\r\n"
+        "$6\r\n"
+        "%s\r\n"
+        "$%u\r\n", decr ? "DECRBY" : "INCRBY", key_len);
+    evbuffer_add(m_write_buf, key, key_len);
+    size += key_len;
+    size += evbuffer_add_printf(m_write_buf,
+        "\r\n"
+        "$%u\r\n"
+        "%s\r\n", (unsigned int) strlen(delta_str), delta_str);
+
+    return size;
+}
+
+int redis_protocol::write_command_append(const char *key, int key_len, const char *value, int value_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    assert(value != NULL);
+    assert(value_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "*3\r\n"
+        "$6\r\n"
+        "APPEND\r\n"
+        "$%u\r\n", key_len);
+    evbuffer_add(m_write_buf, key, key_len);
+    size += key_len;
+    size += evbuffer_add_printf(m_write_buf,
+        "\r\n"
+        "$%u\r\n", value_len);
+    add_value(value, value_len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    size += value_len + 2;
+
+    return size;
+}
+
+// memcached's touch with expiry 0 makes the item permanent, which is PERSIST
+int redis_protocol::write_command_touch(const char *key, int key_len, int expiry)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    if (!expiry) {
+        size = evbuffer_add_printf(m_write_buf,
+            "*2\r\n"
+            "$7\r\n"
+            "PERSIST\r\n"
             "$%u\r\n", key_len);
         evbuffer_add(m_write_buf, key, key_len);
-        evbuffer_add(m_write_buf, "\r\n", 2);        
+        evbuffer_add(m_write_buf, "\r\n", 2);
         size += key_len + 2;
     } else {
-        char offset_str[30];
-        snprintf(offset_str, sizeof(offset_str)-1, "%u", offset);
+        char expiry_str[30];
+        snprintf(expiry_str, sizeof(expiry_str)-1, "%u", expiry);
 
         size = evbuffer_add_printf(m_write_buf,
-            "*4\r\n"
-            "$8\r\n"
-            "GETRANGE\r\n"
+            "*3\r\n"
+            "$6\r\n"
+            "EXPIRE\r\n"
             "$%u\r\n", key_len);
         evbuffer_add(m_write_buf, key, key_len);
         size += key_len;
         size += evbuffer_add_printf(m_write_buf,
             "\r\n"
             "$%u\r\n"
-            "%s\r\n"
-            "$2\r\n"
-            "-1\r\n", (unsigned int) strlen(offset_str), offset_str);        
+            "%s\r\n", (unsigned int) strlen(expiry_str), expiry_str);
     }
 
     return size;
 }
 
+// redis has no cas unique, a GETS is a plain GET
+int redis_protocol::write_command_gets(const char *key, int key_len)
+{
+    return write_command_get(key, key_len, 0);
+}
+
+int redis_protocol::write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas)
+{
+    fprintf(stderr, "error: CAS command not implemented for redis!\n");
+    assert(0);
+}
+
 /*
  * Utility function to get the number of digits in a number
  */
@@ -360,147 +534,447 @@ static int get_number_length(unsigned int num)
     return 10;
 }
 
-int redis_protocol::write_command_wait(unsigned int num_slaves, unsigned int timeout)
+// Append one RESP bulk string argument
+int redis_protocol::write_bulk(const char *data, unsigned int len)
+{
+    int size = evbuffer_add_printf(m_write_buf, "$%u\r\n", len);
+    evbuffer_add(m_write_buf, data, len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    return size + len + 2;
+}
+
+int redis_protocol::write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len)
 {
+    assert(key != NULL);
+    assert(key_len > 0);
     int size = 0;
+
     size = evbuffer_add_printf(m_write_buf,
-                               "*3\r\n"
-                               "$4\r\n"
-                               "WAIT\r\n"
-                               "$%u\r\n"
-                               "%u\r\n"
-                               "$%u\r\n"
-                               "%u\r\n",
-                               get_number_length(num_slaves), num_slaves,
-                               get_number_length(timeout), timeout);
+        "*4\r\n"
+        "$4\r\n"
+        "HSET\r\n");
+    size += write_bulk(key, key_len);
+    size += write_bulk(field, field_len);
+    size += write_bulk(value, value_len);
+
     return size;
 }
 
-int redis_protocol::parse_response(void)
+int redis_protocol::write_command_hget(const char *key, int key_len, const char *field, int field_len)
 {
-    char *line;
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
 
-    while (true) {
-        switch (m_response_state) {
-            case rs_initial:                
-                line = evbuffer_readln(m_read_buf, &m_response_len, EVBUFFER_EOL_CRLF_STRICT);
-                if (line == NULL)
-                    return 0;   // maybe we didn't get it yet?
-                m_response_len += 2;    // count CRLF
+    size = evbuffer_add_printf(m_write_buf,
+        "*3\r\n"
+        "$4\r\n"
+        "HGET\r\n");
+    size += write_bulk(key, key_len);
+    size += write_bulk(field, field_len);
 
-                // clear last response
-                m_last_response.clear();
+    return size;
+}
 
-                if (line[0] == '*') {
-                    int count = strtol(line + 1, NULL, 10);
-                    if (count == -1) {
-                        m_last_response.set_status(line);
-                        return 1;
-                    }
+int redis_protocol::write_command_lpush(const char *key, int key_len, const char *value, int value_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
 
-                    // start new mbulk response
-                    current_mbulk_level.clear();
+    size = evbuffer_add_printf(m_write_buf,
+        "*3\r\n"
+        "$5\r\n"
+        "LPUSH\r\n");
+    size += write_bulk(key, key_len);
+    size += write_bulk(value, value_len);
 
-                    mbulk_element* mbulk = new mbulk_element();
-                    m_last_response.set_mbulk_value(mbulk);
+    return size;
+}
 
-                    // update mbulk level
-                    mbulk_level* new_level = new mbulk_level(count, mbulk);
-                    current_mbulk_level.push_back(new_level);
+int redis_protocol::write_command_lrange(const char *key, int key_len, int start, int stop)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+    char start_str[20];
+    char stop_str[20];
 
-                    m_response_state = rs_read_mbulk;
-                    m_last_response.set_status(line);
-                } else if (line[0] == '$') {
-                    int len = strtol(line + 1, NULL, 10);
-                    if (len == -1) {
-                        m_last_response.set_status(line);
-                        return 1;
-                    }
+    snprintf(start_str, sizeof(start_str)-1, "%d", start);
+    snprintf(stop_str, sizeof(stop_str)-1, "%d", stop);
 
-                    m_bulk_len = (unsigned int) len;
-                    m_response_state = rs_read_bulk;
-                    m_last_response.set_status(line);
-                    continue;
-                } else if (line[0] == '+' || line[0] == '-' || line[0] == ':') {
-                    m_last_response.set_status(line);
-                    m_last_response.set_total_len(m_response_len);
-                    if (line[0] == '-')
-                        m_last_response.set_error(true);
-                    return 1;
-                } else {
-                    benchmark_debug_log("unsupported response: '%s'.\n", line);
-                    free(line);
-                    return -1;
-                }
+    size = evbuffer_add_printf(m_write_buf,
+        "*4\r\n"
+        "$6\r\n"
+        "LRANGE\r\n");
+    size += write_bulk(key, key_len);
+    size += evbuffer_add_printf(m_write_buf,
+        "$%u\r\n%s\r\n"
+        "$%u\r\n%s\r\n",
+        (unsigned int) strlen(start_str), start_str,
+        (unsigned int) strlen(stop_str), stop_str);
 
-                break;
-            case rs_read_mbulk:
-                line = evbuffer_readln(m_read_buf, &m_response_len, EVBUFFER_EOL_CRLF_STRICT);
-                if (line == NULL)
-                    return 0;
+    return size;
+}
 
-                if (line[0] == '*') {
-                    int count = strtol(line + 1, NULL, 10);
+int redis_protocol::write_command_ltrim(const char *key, int key_len, int start, int stop)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+    char start_str[20];
+    char stop_str[20];
 
-                    // add new mbulk array
-                    mbulk_element *mbulk = new mbulk_element();
-                    m_last_response.add_mbulk_array(&current_mbulk_level, mbulk, count);
+    snprintf(start_str, sizeof(start_str)-1, "%d", start);
+    snprintf(stop_str, sizeof(stop_str)-1, "%d", stop);
 
-                    m_response_state = rs_read_mbulk;
-                    m_last_response.set_status(line);
+    size = evbuffer_add_printf(m_write_buf,
+        "*4\r\n"
+        "$5\r\n"
+        "LTRIM\r\n");
+    size += write_bulk(key, key_len);
+    size += evbuffer_add_printf(m_write_buf,
+        "$%u\r\n%s\r\n"
+        "$%u\r\n%s\r\n",
+        (unsigned int) strlen(start_str), start_str,
+        (unsigned int) strlen(stop_str), stop_str);
 
-                } else if (line[0] == ':') {
-                    char *bulk_value = strdup(line + 1);
-                    assert(bulk_value != NULL);
+    return size;
+}
 
-                    // add new mbulk value
-                    mbulk_element* mbulk = new mbulk_element(bulk_value, strlen(bulk_value));
-                    m_last_response.add_mbulk_value(&current_mbulk_level, mbulk);
+int redis_protocol::write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
 
-                    // check if we got all mbulk
-                    if (current_mbulk_level.size() == 0) {
-                        m_response_state = rs_initial;
-                        return 1;
-                    }
+    size = evbuffer_add_printf(m_write_buf,
+        "*4\r\n"
+        "$4\r\n"
+        "ZADD\r\n");
+    size += write_bulk(key, key_len);
+    size += evbuffer_add_printf(m_write_buf,
+        "$%u\r\n%u\r\n", get_number_length(score), score);
+    size += write_bulk(member, member_len);
 
-                } else if (line[0] == '$') {
-                    int len = strtol(line + 1, NULL, 10);
-                    m_bulk_len = (unsigned int) len;
+    return size;
+}
 
-                    if (evbuffer_get_length(m_read_buf) >= m_bulk_len + 2) {
-                        char *bulk_value = (char *) malloc(m_bulk_len);
-                        assert(bulk_value != NULL);
+int redis_protocol::write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
 
-                        int ret = evbuffer_remove(m_read_buf, bulk_value, m_bulk_len);
-                        assert(ret != -1);
+    size = evbuffer_add_printf(m_write_buf,
+        "*4\r\n"
+        "$13\r\n"
+        "ZRANGEBYSCORE\r\n");
+    size += write_bulk(key, key_len);
+    size += evbuffer_add_printf(m_write_buf,
+        "$%u\r\n%u\r\n"
+        "$%u\r\n%u\r\n",
+        get_number_length(min), min,
+        get_number_length(max), max);
 
-                        // drain CRLF
-                        ret = evbuffer_drain(m_read_buf, 2);
-                        assert(ret != -1);
+    return size;
+}
 
-                        // create new mbulk array
-                        mbulk_element* obj = new mbulk_element(bulk_value, m_bulk_len);
-                        m_last_response.add_mbulk_value(&current_mbulk_level, obj);
+int redis_protocol::write_command_get(const char *key, int key_len, unsigned int offset)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+    
+    if (!offset) {
+        size = evbuffer_add_printf(m_write_buf,
+            "*2\r\n"
+            "$3\r\n"
+            "GET\r\n"
+            "$%u\r\n", key_len);
+        evbuffer_add(m_write_buf, key, key_len);
+        evbuffer_add(m_write_buf, "\r\n", 2);        
+        size += key_len + 2;
+    } else {
+        char offset_str[30];
+        snprintf(offset_str, sizeof(offset_str)-1, "%u", offset);
 
-                        if (current_mbulk_level.size() == 0) {
-                            m_response_state = rs_initial;
-                            return 1;
-                        }
-                    } else {
-                        return 0;
-                    }
-                }
-                break;
-            case rs_read_bulk:
-                if (evbuffer_get_length(m_read_buf) >= m_bulk_len + 2) {
-                    if (m_keep_value && m_bulk_len > 0) {
-                        char *bulk_value = (char *) malloc(m_bulk_len);
-                        assert(bulk_value != NULL);
-                            
-                        int ret = evbuffer_remove(m_read_buf, bulk_value, m_bulk_len);
-                        assert(ret != -1);
+        size = evbuffer_add_printf(m_write_buf,
+            "*4\r\n"
+            "$8\r\n"
+            "GETRANGE\r\n"
+            "$%u\r\n", key_len);
+        evbuffer_add(m_write_buf, key, key_len);
+        size += key_len;
+        size += evbuffer_add_printf(m_write_buf,
+            "\r\n"
+            "$%u\r\n"
+            "%s\r\n"
+            "$2\r\n"
+            "-1\r\n", (unsigned int) strlen(offset_str), offset_str);        
+    }
 
-                        // drain CRLF
+    return size;
+}
+
+int redis_protocol::write_command_wait(unsigned int num_slaves, unsigned int timeout)
+{
+    int size = 0;
+    size = evbuffer_add_printf(m_write_buf,
+                               "*3\r\n"
+                               "$4\r\n"
+                               "WAIT\r\n"
+                               "$%u\r\n"
+                               "%u\r\n"
+                               "$%u\r\n"
+                               "%u\r\n",
+                               get_number_length(num_slaves), num_slaves,
+                               get_number_length(timeout), timeout);
+    return size;
+}
+
+int redis_protocol::write_command_fence(void)
+{
+    fprintf(stderr, "error: noreply fence not implemented for redis!\n");
+    assert(0);
+}
+
+// Parse a RESP integer (optionally negative) spanning [p, end).
+static bool parse_resp_integer(const char *p, const char *end, long long *value)
+{
+    bool negative = false;
+    long long v = 0;
+
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    if (p == end)
+        return false;
+
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9')
+            return false;
+        v = v * 10 + (*p - '0');
+    }
+
+    *value = negative ? -v : v;
+    return true;
+}
+
+// Find the CRLF-terminated line at the head of the read buffer and return
+// its length (without CRLF), leaving it in place.  The first chunk is
+// scanned with memchr(); only a line that straddles two chunks is made
+// contiguous.  Returns -1 if the line is incomplete, -2 if it is malformed.
+int redis_protocol::peek_line(const char **line)
+{
+    struct evbuffer_iovec vec;
+    if (evbuffer_peek(m_read_buf, -1, NULL, &vec, 1) < 1)
+        return -1;
+
+    const char *start = (const char *) vec.iov_base;
+    const char *eol = (const char *) memchr(start, '\n', vec.iov_len);
+    if (eol == NULL) {
+        if (evbuffer_get_length(m_read_buf) == vec.iov_len)
+            return -1;
+
+        struct evbuffer_ptr ptr = evbuffer_search_eol(m_read_buf, NULL, NULL, EVBUFFER_EOL_LF);
+        if (ptr.pos == -1)
+            return -1;
+
+        start = (const char *) evbuffer_pullup(m_read_buf, ptr.pos + 1);
+        assert(start != NULL);
+        eol = start + ptr.pos;
+    }
+
+    if (eol == start || eol[-1] != '\r')
+        return -2;
+
+    *line = start;
+    return eol - start - 1;
+}
+
+void redis_protocol::add_element(mbulk_element* element)
+{
+    m_agg_elements.back()->mbulk_array.push_back(element);
+}
+
+// An element of the innermost aggregate is complete; close every aggregate
+// that completes with it.  Returns true when the whole response is done.
+bool redis_protocol::complete_element(void)
+{
+    while (!m_agg_remaining.empty()) {
+        if (--m_agg_remaining.back() > 0)
+            return false;
+
+        m_agg_remaining.pop_back();
+        if (m_keep_aggregate)
+            m_agg_elements.pop_back();
+    }
+
+    if (m_keep_aggregate && m_keep_mbulk > 0)
+        m_keep_mbulk--;
+
+    m_response_state = rs_initial;
+    m_last_response.set_total_len(m_response_len);
+    return true;
+}
+
+// Streaming RESP2/RESP3 parser.  Lines are parsed where they sit in the read
+// buffer and the state survives partial reads.  Only the status line of a
+// response is copied (into a reused buffer); values are allocated only when
+// they are kept: bulk values with set_keep_value(), aggregate elements when
+// values are kept or for CLUSTER SLOTS.
+int redis_protocol::parse_response(void)
+{
+    const char *line;
+    int line_len;
+    long long num;
+
+    while (true) {
+        switch (m_response_state) {
+            case rs_initial: {
+                line_len = peek_line(&line);
+                if (line_len == -1)
+                    return 0;   // maybe we didn't get it yet?
+                if (line_len == -2) {
+                    benchmark_debug_log("malformed response line.\n");
+                    return -1;
+                }
+
+                bool top_level = m_agg_remaining.empty();
+                if (top_level) {
+                    // clear last response
+                    m_last_response.clear();
+                    m_response_len = 0;
+                    m_keep_aggregate = m_keep_value || m_keep_mbulk > 0;
+                    m_last_response.set_status_line(line, line_len);
+                }
+                m_response_len += line_len + 2;    // count CRLF
+
+                const char type = line[0];
+                switch (type) {
+                    case '*':   // array
+                    case '~':   // set
+                    case '>':   // push
+                    case '%': { // map, count is in key/value pairs
+                        if (!parse_resp_integer(line + 1, line + line_len, &num)) {
+                            benchmark_debug_log("bad aggregate length.\n");
+                            return -1;
+                        }
+                        evbuffer_drain(m_read_buf, line_len + 2);
+
+                        if (num <= 0) {
+                            // a null or empty aggregate is complete already
+                            if (m_keep_aggregate) {
+                                mbulk_element* mbulk = new mbulk_element();
+                                if (top_level)
+                                    m_last_response.set_mbulk_value(mbulk);
+                                else
+                                    add_element(mbulk);
+                            }
+                            if (top_level) {
+                                m_last_response.set_total_len(m_response_len);
+                                return 1;
+                            }
+                            if (complete_element())
+                                return 1;
+                            continue;
+                        }
+
+                        // LRANGE and ZRANGEBYSCORE hit when they return anything
+                        if (top_level)
+                            m_last_response.incr_hits();
+
+                        if (m_keep_aggregate) {
+                            mbulk_element* mbulk = new mbulk_element();
+                            if (top_level)
+                                m_last_response.set_mbulk_value(mbulk);
+                            else
+                                add_element(mbulk);
+                            m_agg_elements.push_back(mbulk);
+                        }
+                        m_agg_remaining.push_back((unsigned int) (type == '%' ? num * 2 : num));
+                        continue;
+                    }
+                    case '$':   // bulk string
+                    case '!':   // bulk error
+                    case '=': { // verbatim string
+                        if (!parse_resp_integer(line + 1, line + line_len, &num) || num > UINT_MAX - 2) {
+                            benchmark_debug_log("bad bulk length.\n");
+                            return -1;
+                        }
+                        evbuffer_drain(m_read_buf, line_len + 2);
+                        if (top_level && type == '!')
+                            m_last_response.set_error(true);
+
+                        if (num < 0) {
+                            // null bulk
+                            if (!top_level && m_keep_aggregate)
+                                add_element(new mbulk_element());
+                            if (top_level) {
+                                m_last_response.set_total_len(m_response_len);
+                                return 1;
+                            }
+                            if (complete_element())
+                                return 1;
+                            continue;
+                        }
+
+                        m_bulk_len = (unsigned int) num;
+                        m_response_state = rs_read_bulk;
+                        continue;
+                    }
+                    case '+':   // simple string
+                    case '-':   // error
+                    case ':':   // integer
+                    case '_':   // null
+                    case '#':   // boolean
+                    case ',':   // double
+                    case '(': { // big number
+                        if (top_level) {
+                            if (type == '-')
+                                m_last_response.set_error(true);
+                            // DEL, EXPIRE and PERSIST answer 0 for a missing key
+                            if (type == ':' && !(line_len == 2 && line[1] == '0'))
+                                m_last_response.incr_hits();
+                            evbuffer_drain(m_read_buf, line_len + 2);
+                            m_last_response.set_total_len(m_response_len);
+                            return 1;
+                        }
+
+                        if (m_keep_aggregate) {
+                            char *value = (char *) malloc(line_len);
+                            assert(value != NULL);
+                            memcpy(value, line + 1, line_len - 1);
+                            value[line_len - 1] = '\0';
+                            add_element(new mbulk_element(value, line_len - 1));
+                        }
+                        evbuffer_drain(m_read_buf, line_len + 2);
+
+                        if (complete_element())
+                            return 1;
+                        continue;
+                    }
+                    default:
+                        benchmark_debug_log("unsupported response: '%.*s'.\n", line_len, line);
+                        return -1;
+                }
+            }
+            case rs_read_bulk:
+                if (evbuffer_get_length(m_read_buf) < m_bulk_len + 2)
+                    return 0;
+
+                m_response_len += m_bulk_len + 2;
+                if (m_agg_remaining.empty()) {
+                    if (m_keep_value && m_bulk_len > 0) {
+                        char *bulk_value = (char *) malloc(m_bulk_len);
+                        assert(bulk_value != NULL);
+
+                        int ret = evbuffer_remove(m_read_buf, bulk_value, m_bulk_len);
+                        assert(ret != -1);
+
+                        // drain CRLF
                         ret = evbuffer_drain(m_read_buf, 2);
                         assert(ret != -1);
 
@@ -511,13 +985,33 @@ int redis_protocol::parse_response(void)
                     }
 
                     m_response_state = rs_initial;
-                    m_last_response.set_total_len(m_response_len + m_bulk_len + 2);
+                    m_last_response.set_total_len(m_response_len);
                     if (m_bulk_len > 0)
                         m_last_response.incr_hits();
                     return 1;
+                }
+
+                if (m_keep_aggregate) {
+                    // NUL terminated, CLUSTER SLOTS parses some of them as numbers
+                    char *bulk_value = (char *) malloc(m_bulk_len + 1);
+                    assert(bulk_value != NULL);
+
+                    int ret = evbuffer_remove(m_read_buf, bulk_value, m_bulk_len);
+                    assert(ret != -1);
+                    bulk_value[m_bulk_len] = '\0';
+
+                    ret = evbuffer_drain(m_read_buf, 2);
+                    assert(ret != -1);
+
+                    add_element(new mbulk_element(bulk_value, m_bulk_len));
                 } else {
-                    return 0;
+                    int ret = evbuffer_drain(m_read_buf, m_bulk_len + 2);
+                    assert(ret != -1);
                 }
+
+                m_response_state = rs_initial;
+                if (complete_element())
+                    return 1;
                 break;
             default:
                 return -1;
@@ -544,7 +1038,21 @@ public:
     virtual int write_command_set(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned int offset);
     virtual int write_command_get(const char *key, int key_len, unsigned int offset);
     virtual int write_command_multi_get(const keylist *keylist);
+    virtual int write_command_delete(const char *key, int key_len);
+    virtual int write_command_incr(const char *key, int key_len, unsigned int delta, bool decr);
+    virtual int write_command_append(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_touch(const char *key, int key_len, int expiry);
+    virtual int write_command_gets(const char *key, int key_len);
+    virtual int write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas);
+    virtual int write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len);
+    virtual int write_command_hget(const char *key, int key_len, const char *field, int field_len);
+    virtual int write_command_lpush(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_lrange(const char *key, int key_len, int start, int stop);
+    virtual int write_command_ltrim(const char *key, int key_len, int start, int stop);
+    virtual int write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len);
+    virtual int write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max);
     virtual int write_command_wait(unsigned int num_slaves, unsigned int timeout);
+    virtual int write_command_fence(void);
     virtual int parse_response(void);
 };
 
@@ -573,7 +1081,7 @@ int memcache_text_protocol::write_command_set(const char *key, int key_len, cons
     
     size = evbuffer_add_printf(m_write_buf,
         "set %.*s 0 %u %u\r\n", key_len, key, expiry, value_len);
-    evbuffer_add(m_write_buf, value, value_len);
+    add_value(value, value_len);
     evbuffer_add(m_write_buf, "\r\n", 2);
     size += value_len + 2;
 
@@ -626,12 +1134,140 @@ int memcache_text_protocol::write_command_multi_get(const keylist *keylist)
     return size;
 }
 
+int memcache_text_protocol::write_command_delete(const char *key, int key_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "delete %.*s\r\n", key_len, key);
+    return size;
+}
+
+int memcache_text_protocol::write_command_incr(const char *key, int key_len, unsigned int delta, bool decr)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "%s %.*s %u\r\n", decr ? "decr" : "incr", key_len, key, delta);
+    return size;
+}
+
+int memcache_text_protocol::write_command_append(const char *key, int key_len, const char *value, int value_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    assert(value != NULL);
+    assert(value_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "append %.*s 0 0 %u\r\n", key_len, key, value_len);
+    add_value(value, value_len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    size += value_len + 2;
+
+    return size;
+}
+
+int memcache_text_protocol::write_command_touch(const char *key, int key_len, int expiry)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "touch %.*s %u\r\n", key_len, key, expiry);
+    return size;
+}
+
+int memcache_text_protocol::write_command_gets(const char *key, int key_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "gets %.*s\r\n", key_len, key);
+    return size;
+}
+
+int memcache_text_protocol::write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    assert(value != NULL);
+    assert(value_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "cas %.*s 0 %u %u %llu\r\n", key_len, key, expiry, value_len, cas);
+    add_value(value, value_len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    size += value_len + 2;
+
+    return size;
+}
+
+int memcache_text_protocol::write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len)
+{
+    fprintf(stderr, "error: HSET command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_text_protocol::write_command_hget(const char *key, int key_len, const char *field, int field_len)
+{
+    fprintf(stderr, "error: HGET command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_text_protocol::write_command_lpush(const char *key, int key_len, const char *value, int value_len)
+{
+    fprintf(stderr, "error: LPUSH command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_text_protocol::write_command_lrange(const char *key, int key_len, int start, int stop)
+{
+    fprintf(stderr, "error: LRANGE command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_text_protocol::write_command_ltrim(const char *key, int key_len, int start, int stop)
+{
+    fprintf(stderr, "error: LTRIM command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_text_protocol::write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len)
+{
+    fprintf(stderr, "error: ZADD command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_text_protocol::write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max)
+{
+    fprintf(stderr, "error: ZRANGEBYSCORE command not implemented for memcache!\n");
+    assert(0);
+}
+
 int memcache_text_protocol::write_command_wait(unsigned int num_slaves, unsigned int timeout)
 {
     fprintf(stderr, "error: WAIT command not implemented for memcache!\n");
     assert(0);
 }
 
+// text noreply errors carry nothing to match them by, so --noreply is
+// rejected for this protocol
+int memcache_text_protocol::write_command_fence(void)
+{
+    fprintf(stderr, "error: noreply fence not implemented for memcache_text!\n");
+    assert(0);
+}
+
 int memcache_text_protocol::parse_response(void)
 {
     char *line;
@@ -660,20 +1296,43 @@ int memcache_text_protocol::parse_response(void)
                     char prefix[50];
                     char key[256];
                     unsigned int flags;
-                    unsigned int cas;
+                    unsigned long long cas;
 
-                    int res = sscanf(line, "%s %s %u %u %u", prefix, key, &flags, &m_value_len, &cas);
+                    int res = sscanf(line, "%s %s %u %u %llu", prefix, key, &flags, &m_value_len, &cas);
                     if (res < 4|| res > 5) {
                         benchmark_debug_log("unexpected VALUE response: %s\n", line);
                         if (m_last_response.get_status() != line)
                             free(line);
                         return -1;
                     }
+                    if (res == 5)
+                        m_last_response.set_cas(cas);
 
                     m_response_state = rs_read_value;
                     continue;
+                } else if (memcmp(line, "STORED", 6) == 0 ||
+                           memcmp(line, "DELETED", 7) == 0 ||
+                           memcmp(line, "TOUCHED", 7) == 0 ||
+                           (line[0] >= '0' && line[0] <= '9')) {
+                    // the command took effect; incr/decr answer with the new value
+                    m_last_response.incr_hits();
+                    if (m_last_response.get_status() != line)
+                        free(line);
+                    m_response_state = rs_read_end;
+                    break;
                 } else if (memcmp(line, "END", 3) == 0 ||
-                           memcmp(line, "STORED", 6) == 0) {
+                           memcmp(line, "NOT_FOUND", 9) == 0 ||
+                           memcmp(line, "NOT_STORED", 10) == 0 ||
+                           memcmp(line, "EXISTS", 6) == 0) {
+                    if (m_last_response.get_status() != line)
+                        free(line);
+                    m_response_state = rs_read_end;
+                    break;
+                } else if (memcmp(line, "CLIENT_ERROR", 12) == 0 ||
+                           memcmp(line, "SERVER_ERROR", 12) == 0 ||
+                           memcmp(line, "ERROR", 5) == 0) {
+                    // e.g. incr on a non-numeric value; the connection is still usable
+                    m_last_response.set_error(true);
                     if (m_last_response.get_status() != line)
                         free(line);
                     m_response_state = rs_read_end;
@@ -731,10 +1390,13 @@ protected:
     response_state m_response_state;
     protocol_binary_response_no_extras m_response_hdr;
     size_t m_response_len;
+    bool m_quiet_batch;     // collecting GETKQ hits until the terminating NOOP
 
     const char* status_text(void);
+    int write_command_store(uint8_t opcode, const char *key, int key_len,
+                            const char *value, int value_len, int expiry, unsigned long long cas);
 public:
-    memcache_binary_protocol() : m_response_state(rs_initial), m_response_len(0) { }
+    memcache_binary_protocol() : m_response_state(rs_initial), m_response_len(0), m_quiet_batch(false) { }
     virtual memcache_binary_protocol* clone(void) { return new memcache_binary_protocol(); }
     virtual int select_db(int db);
     virtual int authenticate(const char *credentials);
@@ -742,7 +1404,21 @@ public:
     virtual int write_command_set(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned int offset);
     virtual int write_command_get(const char *key, int key_len, unsigned int offset);
     virtual int write_command_multi_get(const keylist *keylist);
+    virtual int write_command_delete(const char *key, int key_len);
+    virtual int write_command_incr(const char *key, int key_len, unsigned int delta, bool decr);
+    virtual int write_command_append(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_touch(const char *key, int key_len, int expiry);
+    virtual int write_command_gets(const char *key, int key_len);
+    virtual int write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas);
+    virtual int write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len);
+    virtual int write_command_hget(const char *key, int key_len, const char *field, int field_len);
+    virtual int write_command_lpush(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_lrange(const char *key, int key_len, int start, int stop);
+    virtual int write_command_ltrim(const char *key, int key_len, int start, int stop);
+    virtual int write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len);
+    virtual int write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max);
     virtual int write_command_wait(unsigned int num_slaves, unsigned int timeout);
+    virtual int write_command_fence(void);
     virtual int parse_response(void);
 };
 
@@ -775,6 +1451,7 @@ int memcache_binary_protocol::authenticate(const char *credentials)
     memset(&req, 0, sizeof(req));
     req.message.header.request.magic = PROTOCOL_BINARY_REQ;
     req.message.header.request.opcode = PROTOCOL_BINARY_CMD_SASL_AUTH;
+    req.message.header.request.opaque = htonl(m_opaque);
     req.message.header.request.keylen = htons(mechanism_len);
     req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
     req.message.header.request.bodylen = htonl(mechanism_len + user_len + passwd_len + 2);
@@ -793,7 +1470,30 @@ int memcache_binary_protocol::write_command_cluster_slots()
     assert(0);
 }
 
+/*
+ * 64-bit fields of the binary protocol are in network byte order
+ */
+static uint64_t hton64(uint64_t value)
+{
+    if (htonl(1) == 1)
+        return value;
+    return ((uint64_t) htonl(value & 0xffffffff) << 32) | htonl(value >> 32);
+}
+
+// a SET is a CAS without a cas unique
 int memcache_binary_protocol::write_command_set(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned int offset)
+{
+    return write_command_store(m_noreply ? PROTOCOL_BINARY_CMD_SETQ : PROTOCOL_BINARY_CMD_SET,
+                               key, key_len, value, value_len, expiry, 0);
+}
+
+int memcache_binary_protocol::write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas)
+{
+    return write_command_store(PROTOCOL_BINARY_CMD_SET, key, key_len, value, value_len, expiry, cas);
+}
+
+int memcache_binary_protocol::write_command_store(uint8_t opcode, const char *key, int key_len,
+                                                  const char *value, int value_len, int expiry, unsigned long long cas)
 {
     assert(key != NULL);
     assert(key_len > 0);
@@ -804,16 +1504,18 @@ int memcache_binary_protocol::write_command_set(const char *key, int key_len, co
 
     memset(&req, 0, sizeof(req));
     req.message.header.request.magic = PROTOCOL_BINARY_REQ;
-    req.message.header.request.opcode = PROTOCOL_BINARY_CMD_SET;
+    req.message.header.request.opcode = opcode;
+    req.message.header.request.opaque = htonl(m_opaque);
     req.message.header.request.keylen = htons(key_len);
     req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
     req.message.header.request.bodylen = htonl(sizeof(req.message.body) + value_len + key_len);
     req.message.header.request.extlen = sizeof(req.message.body);
+    req.message.header.request.cas = hton64(cas);
     req.message.body.expiration = htonl(expiry);
 
     evbuffer_add(m_write_buf, &req, sizeof(req));
     evbuffer_add(m_write_buf, key, key_len);
-    evbuffer_add(m_write_buf, value, value_len);
+    add_value(value, value_len);
 
     return sizeof(req) + key_len + value_len;
 }
@@ -828,6 +1530,7 @@ int memcache_binary_protocol::write_command_get(const char *key, int key_len, un
     memset(&req, 0, sizeof(req));
     req.message.header.request.magic = PROTOCOL_BINARY_REQ;
     req.message.header.request.opcode = PROTOCOL_BINARY_CMD_GET;
+    req.message.header.request.opaque = htonl(m_opaque);
     req.message.header.request.keylen = htons(key_len);
     req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
     req.message.header.request.bodylen = htonl(key_len);
@@ -839,10 +1542,53 @@ int memcache_binary_protocol::write_command_get(const char *key, int key_len, un
     return sizeof(req) + key_len;
 }
 
+/*
+ * Multi-get is sent as a batch of quiet GETKQ requests terminated by a NOOP.
+ * The server only answers GETKQ on a hit, so the NOOP response marks the end
+ * of the batch and the whole batch is reported as a single response.  All
+ * packets of the batch carry the same opaque.
+ */
 int memcache_binary_protocol::write_command_multi_get(const keylist *keylist)
 {
-    fprintf(stderr, "error: multi get not implemented for binary memcache yet!\n");
-    assert(0);
+    assert(keylist != NULL);
+    assert(keylist->get_keys_count() > 0);
+
+    protocol_binary_request_getk req;
+    int size = 0;
+
+    for (unsigned int i = 0; i < keylist->get_keys_count(); i++) {
+        const char *key;
+        unsigned int key_len;
+
+        key = keylist->get_key(i, &key_len);
+        assert(key != NULL);
+
+        memset(&req, 0, sizeof(req));
+        req.message.header.request.magic = PROTOCOL_BINARY_REQ;
+        req.message.header.request.opcode = PROTOCOL_BINARY_CMD_GETKQ;
+        req.message.header.request.opaque = htonl(m_opaque);
+        req.message.header.request.keylen = htons(key_len);
+        req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+        req.message.header.request.bodylen = htonl(key_len);
+        req.message.header.request.extlen = 0;
+
+        evbuffer_add(m_write_buf, &req, sizeof(req));
+        evbuffer_add(m_write_buf, key, key_len);
+        size += sizeof(req) + key_len;
+    }
+
+    protocol_binary_request_noop noop;
+
+    memset(&noop, 0, sizeof(noop));
+    noop.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    noop.message.header.request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+    noop.message.header.request.opaque = htonl(m_opaque);
+    noop.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+
+    evbuffer_add(m_write_buf, &noop, sizeof(noop));
+    size += sizeof(noop);
+
+    return size;
 }
 
 const char* memcache_binary_protocol::status_text(void)
@@ -884,22 +1630,190 @@ const char* memcache_binary_protocol::status_text(void)
     }
 }
 
-int memcache_binary_protocol::write_command_wait(unsigned int num_slaves, unsigned int timeout)
+int memcache_binary_protocol::write_command_delete(const char *key, int key_len)
 {
-    fprintf(stderr, "error: WAIT command not implemented for memcache!\n");
-    assert(0);
-}
+    assert(key != NULL);
+    assert(key_len > 0);
 
-int memcache_binary_protocol::parse_response(void)
-{
-    while (true) {
-        int ret;
-        int status;
-        
-        switch (m_response_state) {
-            case rs_initial:
-                if (evbuffer_get_length(m_read_buf) < sizeof(m_response_hdr))
-                    return 0;               // no header yet?
+    protocol_binary_request_delete req;
+
+    memset(&req, 0, sizeof(req));
+    req.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    req.message.header.request.opcode = PROTOCOL_BINARY_CMD_DELETE;
+    req.message.header.request.opaque = htonl(m_opaque);
+    req.message.header.request.keylen = htons(key_len);
+    req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.message.header.request.bodylen = htonl(key_len);
+
+    evbuffer_add(m_write_buf, &req, sizeof(req));
+    evbuffer_add(m_write_buf, key, key_len);
+
+    return sizeof(req) + key_len;
+}
+
+/*
+ * The extras of INCREMENT/DECREMENT are packed (20 bytes), unlike the padded
+ * protocol_binary_request_incr body, so they are written by hand.  An
+ * expiration other than 0xffffffff creates a missing counter at the initial
+ * value, the way redis INCRBY does.
+ */
+int memcache_binary_protocol::write_command_incr(const char *key, int key_len, unsigned int delta, bool decr)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+
+    protocol_binary_request_no_extras req;
+    char extras[20];
+    uint64_t delta_n = hton64(delta);
+    uint64_t initial_n = 0;
+    uint32_t expiration_n = 0;
+
+    memcpy(extras, &delta_n, sizeof(delta_n));
+    memcpy(extras + 8, &initial_n, sizeof(initial_n));
+    memcpy(extras + 16, &expiration_n, sizeof(expiration_n));
+
+    memset(&req, 0, sizeof(req));
+    req.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    req.message.header.request.opcode = decr ? PROTOCOL_BINARY_CMD_DECREMENT : PROTOCOL_BINARY_CMD_INCREMENT;
+    req.message.header.request.opaque = htonl(m_opaque);
+    req.message.header.request.keylen = htons(key_len);
+    req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.message.header.request.extlen = sizeof(extras);
+    req.message.header.request.bodylen = htonl(sizeof(extras) + key_len);
+
+    evbuffer_add(m_write_buf, &req, sizeof(req));
+    evbuffer_add(m_write_buf, extras, sizeof(extras));
+    evbuffer_add(m_write_buf, key, key_len);
+
+    return sizeof(req) + sizeof(extras) + key_len;
+}
+
+int memcache_binary_protocol::write_command_append(const char *key, int key_len, const char *value, int value_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    assert(value != NULL);
+    assert(value_len > 0);
+
+    protocol_binary_request_append req;
+
+    memset(&req, 0, sizeof(req));
+    req.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    req.message.header.request.opcode = PROTOCOL_BINARY_CMD_APPEND;
+    req.message.header.request.opaque = htonl(m_opaque);
+    req.message.header.request.keylen = htons(key_len);
+    req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.message.header.request.bodylen = htonl(key_len + value_len);
+
+    evbuffer_add(m_write_buf, &req, sizeof(req));
+    evbuffer_add(m_write_buf, key, key_len);
+    add_value(value, value_len);
+
+    return sizeof(req) + key_len + value_len;
+}
+
+int memcache_binary_protocol::write_command_touch(const char *key, int key_len, int expiry)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+
+    protocol_binary_request_touch req;
+
+    memset(&req, 0, sizeof(req));
+    req.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    req.message.header.request.opcode = PROTOCOL_BINARY_CMD_TOUCH;
+    req.message.header.request.opaque = htonl(m_opaque);
+    req.message.header.request.keylen = htons(key_len);
+    req.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.message.header.request.extlen = sizeof(req.message.body);
+    req.message.header.request.bodylen = htonl(sizeof(req.message.body) + key_len);
+    req.message.body.expiration = htonl(expiry);
+
+    // sizeof(req) includes the union's alignment padding
+    evbuffer_add(m_write_buf, &req, sizeof(req.bytes));
+    evbuffer_add(m_write_buf, key, key_len);
+
+    return sizeof(req.bytes) + key_len;
+}
+
+// every GET response carries the cas unique in its header
+int memcache_binary_protocol::write_command_gets(const char *key, int key_len)
+{
+    return write_command_get(key, key_len, 0);
+}
+
+int memcache_binary_protocol::write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len)
+{
+    fprintf(stderr, "error: HSET command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_hget(const char *key, int key_len, const char *field, int field_len)
+{
+    fprintf(stderr, "error: HGET command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_lpush(const char *key, int key_len, const char *value, int value_len)
+{
+    fprintf(stderr, "error: LPUSH command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_lrange(const char *key, int key_len, int start, int stop)
+{
+    fprintf(stderr, "error: LRANGE command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_ltrim(const char *key, int key_len, int start, int stop)
+{
+    fprintf(stderr, "error: LTRIM command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len)
+{
+    fprintf(stderr, "error: ZADD command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max)
+{
+    fprintf(stderr, "error: ZRANGEBYSCORE command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_wait(unsigned int num_slaves, unsigned int timeout)
+{
+    fprintf(stderr, "error: WAIT command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_binary_protocol::write_command_fence(void)
+{
+    protocol_binary_request_noop noop;
+
+    memset(&noop, 0, sizeof(noop));
+    noop.message.header.request.magic = PROTOCOL_BINARY_REQ;
+    noop.message.header.request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+    noop.message.header.request.opaque = htonl(m_opaque);
+    noop.message.header.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+
+    evbuffer_add(m_write_buf, &noop, sizeof(noop));
+    return sizeof(noop);
+}
+
+int memcache_binary_protocol::parse_response(void)
+{
+    while (true) {
+        int ret;
+        int status;
+        
+        switch (m_response_state) {
+            case rs_initial:
+                if (evbuffer_get_length(m_read_buf) < sizeof(m_response_hdr))
+                    return 0;               // no header yet?
 
                 ret = evbuffer_remove(m_read_buf, (void *)&m_response_hdr, sizeof(m_response_hdr));
                 assert(ret == sizeof(m_response_hdr));
@@ -909,10 +1823,22 @@ int memcache_binary_protocol::parse_response(void)
                     return -1;
                 }
 
-                m_response_len = sizeof(m_response_hdr);
-                m_last_response.clear();
-                if (status_text()) {
-                    m_last_response.set_status(strdup(status_text()));
+                // responses to a quiet batch accumulate into one response
+                if (!m_quiet_batch) {
+                    m_response_len = 0;
+                    m_last_response.clear();
+                    if (status_text()) {
+                        m_last_response.set_status(strdup(status_text()));
+                    }
+                }
+                m_response_len += sizeof(m_response_hdr);
+                m_last_response.set_opaque(ntohl(m_response_hdr.message.header.response.opaque));
+                m_last_response.set_cas(hton64(m_response_hdr.message.header.response.cas));
+
+                if (m_response_hdr.message.header.response.opcode == PROTOCOL_BINARY_CMD_GETKQ) {
+                    m_quiet_batch = true;
+                } else if (m_response_hdr.message.header.response.opcode == PROTOCOL_BINARY_CMD_NOOP) {
+                    m_quiet_batch = false;
                 }
 
                 status = ntohs(m_response_hdr.message.header.response.status);
@@ -933,7 +1859,16 @@ int memcache_binary_protocol::parse_response(void)
                     continue;
                 }
 
-                return 1;                
+                if (m_quiet_batch)
+                    continue;
+
+                // DELETE, TOUCH, APPEND and stores answer with a bare header
+                if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS &&
+                    m_response_hdr.message.header.response.opcode != PROTOCOL_BINARY_CMD_NOOP)
+                    m_last_response.incr_hits();
+
+                m_last_response.set_total_len(m_response_len);
+                return 1;
                 break;
             case rs_read_body:
                 if (evbuffer_get_length(m_read_buf) >= m_response_hdr.message.header.response.bodylen) {
@@ -962,6 +1897,10 @@ int memcache_binary_protocol::parse_response(void)
                     m_response_len += m_response_hdr.message.header.response.bodylen;
                     m_response_state = rs_initial;
 
+                    if (m_quiet_batch)
+                        continue;
+
+                    m_last_response.set_total_len(m_response_len);
                     return 1;
                 } else {
                     return 0;
@@ -978,6 +1917,389 @@ int memcache_binary_protocol::parse_response(void)
 
 /////////////////////////////////////////////////////////////////////////
 
+/*
+ * memcached meta commands (mg/ms/md/ma).  Every request carries an opaque
+ * token (O flag) which the server echoes back, so a response can be matched
+ * to the request that produced it.  Multi-get is sent as quiet mg requests
+ * sharing one opaque that also ask for the key (k flag); the server stays
+ * silent on their misses.  The last key is asked for without q and k, so
+ * its reply always comes and closes the batch under the batch's opaque.
+ * mn carries no opaque and is not used.
+ */
+class memcache_meta_protocol : public abstract_protocol {
+protected:
+    enum response_state { rs_initial, rs_read_line, rs_read_value };
+    response_state m_response_state;
+    unsigned int m_value_len;
+    size_t m_response_len;
+    bool m_quiet_batch;     // collecting quiet mg hits until the batch's last reply
+    std::string m_fence_key;    // key of the last quiet SET, looked up by a fence
+
+    bool parse_flags(const char *line);
+public:
+    memcache_meta_protocol() : m_response_state(rs_initial), m_value_len(0), m_response_len(0), m_quiet_batch(false) { }
+    virtual memcache_meta_protocol* clone(void) { return new memcache_meta_protocol(); }
+    virtual int select_db(int db);
+    virtual int authenticate(const char *credentials);
+    virtual int write_command_cluster_slots();
+    virtual int write_command_set(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned int offset);
+    virtual int write_command_get(const char *key, int key_len, unsigned int offset);
+    virtual int write_command_multi_get(const keylist *keylist);
+    virtual int write_command_delete(const char *key, int key_len);
+    virtual int write_command_incr(const char *key, int key_len, unsigned int delta, bool decr);
+    virtual int write_command_append(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_touch(const char *key, int key_len, int expiry);
+    virtual int write_command_gets(const char *key, int key_len);
+    virtual int write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas);
+    virtual int write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len);
+    virtual int write_command_hget(const char *key, int key_len, const char *field, int field_len);
+    virtual int write_command_lpush(const char *key, int key_len, const char *value, int value_len);
+    virtual int write_command_lrange(const char *key, int key_len, int start, int stop);
+    virtual int write_command_ltrim(const char *key, int key_len, int start, int stop);
+    virtual int write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len);
+    virtual int write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max);
+    virtual int write_command_wait(unsigned int num_slaves, unsigned int timeout);
+    virtual int write_command_fence(void);
+    virtual int parse_response(void);
+    virtual bool fence_on_last_set(void) { return true; }
+};
+
+int memcache_meta_protocol::select_db(int db)
+{
+    assert(0);
+}
+
+int memcache_meta_protocol::authenticate(const char *credentials)
+{
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_cluster_slots()
+{
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_set(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned int offset)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    assert(value != NULL);
+    assert(value_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "ms %.*s %u T%u%s O%u\r\n", key_len, key, value_len, expiry, m_noreply ? " q" : "", m_opaque);
+    add_value(value, value_len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    size += value_len + 2;
+
+    if (m_noreply)
+        m_fence_key.assign(key, key_len);
+
+    return size;
+}
+
+int memcache_meta_protocol::write_command_get(const char *key, int key_len, unsigned int offset)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "mg %.*s v O%u\r\n", key_len, key, m_opaque);
+    return size;
+}
+
+int memcache_meta_protocol::write_command_multi_get(const keylist *keylist)
+{
+    assert(keylist != NULL);
+    assert(keylist->get_keys_count() > 0);
+
+    int size = 0;
+
+    unsigned int last = keylist->get_keys_count() - 1;
+    for (unsigned int i = 0; i <= last; i++) {
+        const char *key;
+        unsigned int key_len;
+
+        key = keylist->get_key(i, &key_len);
+        assert(key != NULL);
+
+        size += evbuffer_add_printf(m_write_buf,
+            "mg %.*s v%s O%u\r\n", key_len, key, i < last ? " k q" : "", m_opaque);
+    }
+
+    return size;
+}
+
+int memcache_meta_protocol::write_command_delete(const char *key, int key_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "md %.*s O%u\r\n", key_len, key, m_opaque);
+    return size;
+}
+
+// N0 creates a missing counter (J0 = initial value 0), the way redis INCRBY does
+int memcache_meta_protocol::write_command_incr(const char *key, int key_len, unsigned int delta, bool decr)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "ma %.*s N0 J0 D%u%s O%u\r\n", key_len, key, delta, decr ? " MD" : "", m_opaque);
+    return size;
+}
+
+int memcache_meta_protocol::write_command_append(const char *key, int key_len, const char *value, int value_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    assert(value != NULL);
+    assert(value_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "ms %.*s %u MA O%u\r\n", key_len, key, value_len, m_opaque);
+    add_value(value, value_len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    size += value_len + 2;
+
+    return size;
+}
+
+int memcache_meta_protocol::write_command_touch(const char *key, int key_len, int expiry)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "mg %.*s T%u O%u\r\n", key_len, key, expiry, m_opaque);
+    return size;
+}
+
+int memcache_meta_protocol::write_command_gets(const char *key, int key_len)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "mg %.*s v c O%u\r\n", key_len, key, m_opaque);
+    return size;
+}
+
+int memcache_meta_protocol::write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas)
+{
+    assert(key != NULL);
+    assert(key_len > 0);
+    assert(value != NULL);
+    assert(value_len > 0);
+    int size = 0;
+
+    size = evbuffer_add_printf(m_write_buf,
+        "ms %.*s %u T%u C%llu O%u\r\n", key_len, key, value_len, expiry, cas, m_opaque);
+    add_value(value, value_len);
+    evbuffer_add(m_write_buf, "\r\n", 2);
+    size += value_len + 2;
+
+    return size;
+}
+
+int memcache_meta_protocol::write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len)
+{
+    fprintf(stderr, "error: HSET command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_hget(const char *key, int key_len, const char *field, int field_len)
+{
+    fprintf(stderr, "error: HGET command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_lpush(const char *key, int key_len, const char *value, int value_len)
+{
+    fprintf(stderr, "error: LPUSH command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_lrange(const char *key, int key_len, int start, int stop)
+{
+    fprintf(stderr, "error: LRANGE command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_ltrim(const char *key, int key_len, int start, int stop)
+{
+    fprintf(stderr, "error: LTRIM command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len)
+{
+    fprintf(stderr, "error: ZADD command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max)
+{
+    fprintf(stderr, "error: ZRANGEBYSCORE command not implemented for memcache!\n");
+    assert(0);
+}
+
+int memcache_meta_protocol::write_command_wait(unsigned int num_slaves, unsigned int timeout)
+{
+    fprintf(stderr, "error: WAIT command not implemented for memcache!\n");
+    assert(0);
+}
+
+// Batches are normally closed by their last SET.  A batch cut short by a
+// request of another kind, or by the end of the run, is closed by looking
+// up its last key: unlike mn, the reply carries the opaque.
+int memcache_meta_protocol::write_command_fence(void)
+{
+    assert(!m_fence_key.empty());
+
+    return evbuffer_add_printf(m_write_buf,
+        "mg %s O%u\r\n", m_fence_key.c_str(), m_opaque);
+}
+
+/*
+ * Scan the return flags of a meta response line, recording the opaque and
+ * cas unique.  Returns true if the key was returned (k flag), which marks a quiet
+ * multi-get member.
+ */
+bool memcache_meta_protocol::parse_flags(const char *line)
+{
+    bool has_key = false;
+    const char *p = strchr(line, ' ');
+
+    while (p != NULL) {
+        p++;
+        if (*p == 'O') {
+            m_last_response.set_opaque(strtoul(p + 1, NULL, 10));
+        } else if (*p == 'c') {
+            m_last_response.set_cas(strtoull(p + 1, NULL, 10));
+        } else if (*p == 'k') {
+            has_key = true;
+        }
+        p = strchr(p, ' ');
+    }
+
+    return has_key;
+}
+
+int memcache_meta_protocol::parse_response(void)
+{
+    char *line;
+    size_t tmplen;
+
+    while (true) {
+        switch (m_response_state) {
+            case rs_initial:
+                // responses to a quiet batch accumulate into one response
+                if (!m_quiet_batch) {
+                    m_last_response.clear();
+                    m_response_len = 0;
+                }
+                m_response_state = rs_read_line;
+                break;
+
+            case rs_read_line:
+                line = evbuffer_readln(m_read_buf, &tmplen, EVBUFFER_EOL_CRLF_STRICT);
+                if (!line)
+                    return 0;
+
+                m_response_len += tmplen + 2;   // For CRLF
+                if (m_last_response.get_status() == NULL) {
+                    m_last_response.set_status(line);
+                }
+
+                // only the quiet members of a multi-get return their key
+                m_quiet_batch = parse_flags(line);
+
+                if (memcmp(line, "VA ", 3) == 0) {
+                    m_value_len = strtoul(line + 3, NULL, 10);
+                    if (m_last_response.get_status() != line)
+                        free(line);
+                    m_response_state = rs_read_value;
+                    continue;
+                } else if (memcmp(line, "HD", 2) == 0 ||
+                           memcmp(line, "EN", 2) == 0 ||
+                           memcmp(line, "NF", 2) == 0 ||
+                           memcmp(line, "NS", 2) == 0 ||
+                           memcmp(line, "EX", 2) == 0) {
+                    // no value follows; HD means the command took effect
+                    if (memcmp(line, "HD", 2) == 0)
+                        m_last_response.incr_hits();
+                } else if (memcmp(line, "CLIENT_ERROR", 12) == 0 ||
+                           memcmp(line, "SERVER_ERROR", 12) == 0 ||
+                           memcmp(line, "ERROR", 5) == 0) {
+                    m_last_response.set_error(true);
+                } else {
+                    m_last_response.set_error(true);
+                    benchmark_debug_log("unknown response: %s\n", line);
+                    return -1;
+                }
+
+                if (m_last_response.get_status() != line)
+                    free(line);
+
+                m_response_state = rs_initial;
+                if (m_quiet_batch)
+                    break;
+
+                m_last_response.set_total_len((unsigned int) m_response_len);
+                return 1;
+
+            case rs_read_value:
+                if (evbuffer_get_length(m_read_buf) >= m_value_len + 2) {
+                    if (m_keep_value) {
+                        char *value = (char *) malloc(m_value_len);
+                        assert(value != NULL);
+
+                        int ret = evbuffer_remove(m_read_buf, value, m_value_len);
+                        assert((unsigned int) ret == m_value_len);
+
+                        m_last_response.set_value(value, m_value_len);
+                    } else {
+                        int ret = evbuffer_drain(m_read_buf, m_value_len);
+                        assert((unsigned int) ret == 0);
+                    }
+
+                    int ret = evbuffer_drain(m_read_buf, 2);
+                    assert((unsigned int) ret == 0);
+
+                    m_last_response.incr_hits();
+                    m_response_len += m_value_len + 2;
+                    m_response_state = rs_initial;
+                    if (m_quiet_batch)
+                        break;
+
+                    m_last_response.set_total_len((unsigned int) m_response_len);
+                    return 1;
+                } else {
+                    return 0;
+                }
+                break;
+
+            default:
+                benchmark_debug_log("unknown response state %d.\n", m_response_state);
+                return -1;
+        }
+    }
+
+    return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
 class abstract_protocol *protocol_factory(const char *proto_name)
 {
     assert(proto_name != NULL);
@@ -988,6 +2310,8 @@ class abstract_protocol *protocol_factory(const char *proto_name)
         return new memcache_text_protocol();
     } else if (strcmp(proto_name, "memcache_binary") == 0) {
         return new memcache_binary_protocol();
+    } else if (strcmp(proto_name, "memcache_meta") == 0) {
+        return new memcache_meta_protocol();
     } else {
         benchmark_error_log("Error: unknown protocol '%s'.\n", proto_name);
         return NULL;
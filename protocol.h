@@ -44,23 +44,18 @@ struct mbulk_element {
     std::vector<mbulk_element*> mbulk_array;
 };
 
-struct mbulk_level {
-    mbulk_level (int count, mbulk_element* mbulk_el) : mbulk_count(count), mbulk(mbulk_el) {;}
-
-    unsigned int mbulk_count;
-    mbulk_element* mbulk;
-};
-
-typedef std::vector<mbulk_level*> mbulk_level_array;
-
 class protocol_response {
 protected:
     const char *m_status;
+    char *m_status_buf;         // reused copy of the status line, see set_status_line()
+    unsigned int m_status_buf_size;
     const char *m_value;
     mbulk_element *m_mbulk_value;
     unsigned int m_value_len;
     unsigned int m_total_len;
     unsigned int m_hits;
+    unsigned int m_opaque;
+    unsigned long long m_cas;   // cas unique returned by a GETS
     bool m_error;
 
 public:
@@ -68,6 +63,7 @@ public:
     virtual ~protocol_response();
 
     void set_status(const char *status);
+    void set_status_line(const char *line, unsigned int line_len);
     const char *get_status(void);
 
     void set_error(bool error);
@@ -82,11 +78,15 @@ public:
     void incr_hits(void);
     unsigned int get_hits(void);
 
+    void set_opaque(unsigned int opaque);
+    unsigned int get_opaque(void);
+
+    void set_cas(unsigned long long cas);
+    unsigned long long get_cas(void);
+
     void clear();
 
     void set_mbulk_value(mbulk_element* element);
-    void add_mbulk_array(mbulk_level_array* mbulk_level, mbulk_element* element, int count);
-    void add_mbulk_value(mbulk_level_array* mbulk_level, mbulk_element* element);
     const mbulk_element* get_mbulk_value();
 };
 
@@ -122,13 +122,23 @@ protected:
     struct evbuffer* m_write_buf;
 
     bool m_keep_value;
+    unsigned int m_opaque;      // tag for the next command, echoed back by binary/meta
+    bool m_zero_copy;           // reference SET values instead of copying them
+    bool m_noreply;             // SETs ask for no response (noreply, SETQ, ms q)
+    unsigned int m_value_refs;  // value references still held by the write buffer
     struct protocol_response m_last_response;
+
+    void add_value(const char *value, int value_len);
+    static void value_ref_cleanup(const void *data, size_t datalen, void *extra);
 public:
     abstract_protocol();
     virtual ~abstract_protocol();
     virtual abstract_protocol* clone(void) = 0;
     void set_buffers(struct evbuffer* read_buf, struct evbuffer* write_buf);    
     void set_keep_value(bool flag);
+    void set_opaque(unsigned int opaque);
+    void set_zero_copy(bool flag);
+    void set_noreply(bool flag);
 
     virtual int select_db(int db) = 0;
     virtual int authenticate(const char *credentials) = 0;
@@ -136,9 +146,27 @@ public:
     virtual int write_command_set(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned int offset) = 0;
     virtual int write_command_get(const char *key, int key_len, unsigned int offset) = 0;
     virtual int write_command_multi_get(const keylist *keylist) = 0;
+    virtual int write_command_delete(const char *key, int key_len) = 0;
+    virtual int write_command_incr(const char *key, int key_len, unsigned int delta, bool decr) = 0;
+    virtual int write_command_append(const char *key, int key_len, const char *value, int value_len) = 0;
+    virtual int write_command_touch(const char *key, int key_len, int expiry) = 0;
+    virtual int write_command_gets(const char *key, int key_len) = 0;
+    virtual int write_command_cas(const char *key, int key_len, const char *value, int value_len, int expiry, unsigned long long cas) = 0;
+    virtual int write_command_hset(const char *key, int key_len, const char *field, int field_len, const char *value, int value_len) = 0;
+    virtual int write_command_hget(const char *key, int key_len, const char *field, int field_len) = 0;
+    virtual int write_command_lpush(const char *key, int key_len, const char *value, int value_len) = 0;
+    virtual int write_command_lrange(const char *key, int key_len, int start, int stop) = 0;
+    virtual int write_command_ltrim(const char *key, int key_len, int start, int stop) = 0;
+    virtual int write_command_zadd(const char *key, int key_len, unsigned int score, const char *member, int member_len) = 0;
+    virtual int write_command_zrangebyscore(const char *key, int key_len, unsigned int min, unsigned int max) = 0;
     virtual int write_command_wait(unsigned int num_slaves, unsigned int timeout) = 0;
+    virtual int write_command_fence(void) = 0;
     virtual int parse_response() = 0;
 
+    // true if a --noreply batch is closed by sending its last SET with a
+    // reply, rather than by write_command_fence()
+    virtual bool fence_on_last_set(void) { return false; }
+
     struct protocol_response* get_response(void) { return &m_last_response; }
 };
 
@@ -36,6 +36,11 @@
 #ifdef HAVE_NETINET_TCP_H
 #include <netinet/tcp.h>
 #endif
+#include <netinet/in.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+#include <arpa/inet.h>
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
 #endif
@@ -61,9 +66,28 @@ void cluster_client_event_handler(evutil_socket_t sfd, short evtype, void *opaqu
     sc->handle_event(evtype);
 }
 
-request::request(request_type type, unsigned int size, struct timeval* sent_time, unsigned int keys)
-        : m_type(type), m_size(size), m_keys(keys)
+void udp_event_handler(evutil_socket_t sfd, short evtype, void *opaque)
+{
+    shard_connection *sc = (shard_connection *) opaque;
+
+    assert(sc != NULL);
+    assert(sc->m_udp_sockfd == sfd);
+
+    sc->handle_udp_event(evtype);
+}
+
+request::request(void)
+        : m_type(rt_unknown), m_size(0), m_keys(0), m_seq(0)
+{
+    memset(&m_sent_time, 0, sizeof(m_sent_time));
+}
+
+void request::init(request_type type, unsigned int size, struct timeval* sent_time, unsigned int keys)
 {
+    m_type = type;
+    m_size = size;
+    m_keys = keys;
+
     if (sent_time != NULL)
         m_sent_time = *sent_time;
     else {
@@ -71,25 +95,39 @@ request::request(request_type type, unsigned int size, struct timeval* sent_time
     }
 }
 
-verify_request::verify_request(request_type type,
-                               unsigned int size,
-                               struct timeval* sent_time,
-                               unsigned int keys,
-                               const char *key,
-                               unsigned int key_len,
-                               const char *value,
-                               unsigned int value_len) :
-        request(type, size, sent_time, keys),
-        m_key(NULL), m_key_len(0),
-        m_value(NULL), m_value_len(0)
+verify_request::verify_request(void) :
+        request(),
+        m_key(NULL), m_key_len(0), m_key_size(0),
+        m_value(NULL), m_value_len(0), m_value_size(0)
 {
+}
+
+// Copy the key and value into the slot's buffers, growing them only when
+// too small; returns the number of allocations made
+unsigned int verify_request::set_key_value(const char *key, unsigned int key_len,
+                                           const char *value, unsigned int value_len)
+{
+    unsigned int allocs = 0;
+
+    if (key_len > m_key_size) {
+        m_key = (char *)realloc(m_key, key_len);
+        assert(m_key != NULL);
+        m_key_size = key_len;
+        allocs++;
+    }
     m_key_len = key_len;
-    m_key = (char *)malloc(key_len);
     memcpy(m_key, key, m_key_len);
 
+    if (value_len > m_value_size) {
+        m_value = (char *)realloc(m_value, value_len);
+        assert(m_value != NULL);
+        m_value_size = value_len;
+        allocs++;
+    }
     m_value_len = value_len;
-    m_value = (char *)malloc(value_len);
     memcpy(m_value, value, m_value_len);
+
+    return allocs;
 }
 
 verify_request::~verify_request(void)
@@ -106,8 +144,19 @@ verify_request::~verify_request(void)
 
 shard_connection::shard_connection(unsigned int id, connections_manager* conns_man, benchmark_config* config,
                                    struct event_base* event_base, abstract_protocol* abs_protocol) :
-        m_sockfd(-1), m_unix_sockaddr(NULL), m_event(NULL), m_pending_resp(0), m_connected(false),
-        m_authentication(auth_done), m_db_selection(select_done), m_cluster_slots(slots_done) {
+        m_sockfd(-1), m_unix_sockaddr(NULL), m_event(NULL),
+        m_inflight(NULL), m_inflight_mask(0), m_next_seq(1), m_oldest_seq(1), m_request_allocs(0),
+        m_pending_resp(0), m_connected(false), m_responses(0), m_response_latency(0),
+        m_migration(-1), m_migrate_pending(false), m_migrate_connecting(false),
+        m_migrations_seen(0),
+        m_quiet_sets(0), m_quiet_bytes(0),
+        m_zerocopy_enabled(false), m_zerocopy_hold(NULL), m_zerocopy_sends(NULL),
+        m_zerocopy_next_seq(0), m_zerocopy_held(0), m_zerocopy_drained(0),
+        m_authentication(auth_done), m_db_selection(select_done), m_cluster_slots(slots_done),
+        m_udp_sockfd(-1), m_udp_event(NULL), m_udp_protocol(NULL), m_udp_read_buf(NULL), m_udp_write_buf(NULL),
+        m_udp_slots(NULL), m_udp_slots_mask(0), m_udp_next_id(0), m_udp_pending(0),
+        m_udp_batch_count(0), m_udp_batch_bytes(0), m_udp_batch_hdrs(NULL), m_udp_batch_lens(NULL),
+        m_udp_msgs(NULL), m_udp_iovs(NULL), m_udp_recv_bufs(NULL) {
     m_id = id;
     m_conns_manager = conns_man;
     m_config = config;
@@ -131,9 +180,54 @@ shard_connection::shard_connection(unsigned int id, connections_manager* conns_m
     m_protocol = abs_protocol->clone();
     assert(m_protocol != NULL);
     m_protocol->set_buffers(m_read_buf, m_write_buf);
+    m_protocol->set_opaque(m_next_seq);
+    m_protocol->set_zero_copy(m_config->zero_copy);
+    m_protocol->set_noreply(m_config->noreply);
+
+    if (m_config->zero_copy_threshold) {
+        m_zerocopy_hold = evbuffer_new();
+        assert(m_zerocopy_hold != NULL);
+        m_zerocopy_sends = new std::deque<zerocopy_send>();
+    }
 
-    m_pipeline = new std::queue<request *>;
-    assert(m_pipeline != NULL);
+    // twice the pipeline depth plus room for the connection setup commands,
+    // so one slow response doesn't hold back the sequence numbers behind it
+    unsigned int slots = 1;
+    while (slots < (m_config->pipeline + 3) * 2)
+        slots <<= 1;
+    m_inflight = new verify_request[slots];
+    assert(m_inflight != NULL);
+    m_inflight_mask = slots - 1;
+    m_request_allocs++;
+
+    if (m_config->udp) {
+        m_udp_read_buf = evbuffer_new();
+        assert(m_udp_read_buf != NULL);
+
+        m_udp_write_buf = evbuffer_new();
+        assert(m_udp_write_buf != NULL);
+
+        m_udp_protocol = abs_protocol->clone();
+        assert(m_udp_protocol != NULL);
+        m_udp_protocol->set_buffers(m_udp_read_buf, m_udp_write_buf);
+
+        // twice the pipeline depth, so a single late reply doesn't stall new ids
+        unsigned int slots = 1;
+        while (slots < m_config->pipeline * 2)
+            slots <<= 1;
+        m_udp_slots = new udp_slot[slots];
+        assert(m_udp_slots != NULL);
+        m_udp_slots_mask = slots - 1;
+        m_request_allocs++;
+
+        m_udp_batch_hdrs = (udp_frame_header *) calloc(UDP_BATCH_SIZE, sizeof(udp_frame_header));
+        m_udp_batch_lens = (unsigned int *) calloc(UDP_BATCH_SIZE, sizeof(unsigned int));
+        m_udp_msgs = (struct mmsghdr *) calloc(UDP_BATCH_SIZE, sizeof(struct mmsghdr));
+        m_udp_iovs = (struct iovec *) calloc(UDP_BATCH_SIZE * 2, sizeof(struct iovec));
+        m_udp_recv_bufs = (char *) malloc(UDP_BATCH_SIZE * UDP_DATAGRAM_SIZE);
+        assert(m_udp_batch_hdrs != NULL && m_udp_batch_lens != NULL &&
+               m_udp_msgs != NULL && m_udp_iovs != NULL && m_udp_recv_bufs != NULL);
+    }
 }
 
 shard_connection::~shard_connection() {
@@ -167,6 +261,16 @@ shard_connection::~shard_connection() {
         m_write_buf = NULL;
     }
 
+    if (m_zerocopy_hold != NULL) {
+        evbuffer_free(m_zerocopy_hold);
+        m_zerocopy_hold = NULL;
+    }
+
+    if (m_zerocopy_sends != NULL) {
+        delete m_zerocopy_sends;
+        m_zerocopy_sends = NULL;
+    }
+
     if (m_event != NULL) {
         event_free(m_event);
         m_event = NULL;
@@ -177,15 +281,68 @@ shard_connection::~shard_connection() {
         m_protocol = NULL;
     }
 
-    if (m_pipeline != NULL) {
-        delete m_pipeline;
-        m_pipeline = NULL;
+    if (m_inflight != NULL) {
+        delete [] m_inflight;
+        m_inflight = NULL;
     }
 
     if (intervalGenerator != NULL) {
         delete intervalGenerator;
         intervalGenerator = NULL;
     }
+
+    if (m_udp_sockfd != -1) {
+        close(m_udp_sockfd);
+        m_udp_sockfd = -1;
+    }
+
+    if (m_udp_event != NULL) {
+        event_free(m_udp_event);
+        m_udp_event = NULL;
+    }
+
+    if (m_udp_protocol != NULL) {
+        delete m_udp_protocol;
+        m_udp_protocol = NULL;
+    }
+
+    if (m_udp_read_buf != NULL) {
+        evbuffer_free(m_udp_read_buf);
+        m_udp_read_buf = NULL;
+    }
+
+    if (m_udp_write_buf != NULL) {
+        evbuffer_free(m_udp_write_buf);
+        m_udp_write_buf = NULL;
+    }
+
+    if (m_udp_slots != NULL) {
+        for (unsigned int i = 0; i <= m_udp_slots_mask; i++) {
+            for (unsigned int j = 0; j < m_udp_slots[i].m_frags.size(); j++) {
+                if (m_udp_slots[i].m_frags[j] != NULL)
+                    evbuffer_free(m_udp_slots[i].m_frags[j]);
+            }
+        }
+        delete [] m_udp_slots;
+        m_udp_slots = NULL;
+    }
+
+    free(m_udp_batch_hdrs);
+    free(m_udp_batch_lens);
+    free(m_udp_msgs);
+    free(m_udp_iovs);
+    free(m_udp_recv_bufs);
+}
+
+// Drop any partial reply held by a slot; fragment buffers are kept for reuse
+static void udp_slot_clear(udp_slot* slot) {
+    for (unsigned int i = 0; i < slot->m_total; i++) {
+        if (slot->m_frags[i] != NULL)
+            evbuffer_drain(slot->m_frags[i], evbuffer_get_length(slot->m_frags[i]));
+        slot->m_have[i] = false;
+    }
+    slot->m_received = 0;
+    slot->m_total = 0;
 }
 
 void shard_connection::setup_event() {
@@ -238,6 +395,17 @@ int shard_connection::setup_socket(struct connect_info* addr) {
 
         error = setsockopt(m_sockfd, IPPROTO_TCP, TCP_NODELAY, (void *) &flags, sizeof(flags));
         assert(error == 0);
+
+        // older kernels don't know SO_ZEROCOPY, plain writes are used then
+        m_zerocopy_enabled = false;
+#ifdef SO_ZEROCOPY
+        if (m_config->zero_copy_threshold) {
+            if (setsockopt(m_sockfd, SOL_SOCKET, SO_ZEROCOPY, (void *) &flags, sizeof(flags)) == 0)
+                m_zerocopy_enabled = true;
+            else
+                benchmark_debug_log("connect: SO_ZEROCOPY not supported: %s\n", strerror(errno));
+        }
+#endif
     }
 
     // set non-blocking behavior
@@ -253,6 +421,74 @@ int shard_connection::setup_socket(struct connect_info* addr) {
     return 0;
 }
 
+int shard_connection::setup_udp_socket(struct connect_info* addr) {
+    struct timeval timeout;
+    int ret;
+
+    close_udp_socket();
+
+    m_udp_sockfd = socket(addr->ci_family, SOCK_DGRAM, 0);
+    if (m_udp_sockfd < 0) {
+        return -errno;
+    }
+
+    // a connected UDP socket lets us use plain sendmmsg/recvmmsg without addresses
+    if (::connect(m_udp_sockfd, addr->ci_addr, addr->ci_addrlen) == -1) {
+        benchmark_error_log("connect: UDP connect failed, error = %s\n", strerror(errno));
+        close_udp_socket();
+        return -1;
+    }
+
+    int flags;
+    if ((flags = fcntl(m_udp_sockfd, F_GETFL, 0)) < 0 ||
+        fcntl(m_udp_sockfd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        benchmark_error_log("connect: failed to set non-blocking flag.\n");
+        close_udp_socket();
+        return -1;
+    }
+
+    // persistent read event; the timeout doubles as the loss detection tick
+    if (!m_udp_event) {
+        m_udp_event = event_new(m_event_base, m_udp_sockfd, EV_READ | EV_PERSIST,
+                                udp_event_handler, (void *)this);
+        assert(m_udp_event != NULL);
+    } else {
+        ret = event_assign(m_udp_event, m_event_base, m_udp_sockfd, EV_READ | EV_PERSIST,
+                           udp_event_handler, (void *)this);
+        assert(ret == 0);
+    }
+
+    timeout.tv_sec = m_config->udp_timeout / 1000;
+    timeout.tv_usec = (m_config->udp_timeout % 1000) * 1000;
+    ret = event_add(m_udp_event, &timeout);
+    assert(ret == 0);
+
+    return 0;
+}
+
+void shard_connection::close_udp_socket() {
+    if (m_udp_event != NULL) {
+        int ret = event_del(m_udp_event);
+        assert(ret == 0);
+    }
+
+    if (m_udp_sockfd != -1) {
+        close(m_udp_sockfd);
+        m_udp_sockfd = -1;
+    }
+
+    // whatever was in flight is abandoned, not counted as lost
+    for (unsigned int i = 0; m_udp_slots != NULL && i <= m_udp_slots_mask; i++) {
+        m_udp_slots[i].m_req.m_type = rt_unknown;
+        udp_slot_clear(&m_udp_slots[i]);
+    }
+    m_udp_pending = 0;
+    m_udp_batch_count = 0;
+    m_udp_batch_bytes = 0;
+    if (m_udp_write_buf != NULL)
+        evbuffer_drain(m_udp_write_buf, evbuffer_get_length(m_udp_write_buf));
+}
+
 int shard_connection::connect(struct connect_info* addr) {
     // set required setup commands
     m_authentication = m_config->authenticate ? auth_none : auth_done;
@@ -268,6 +504,10 @@ int shard_connection::connect(struct connect_info* addr) {
     // set up event
     setup_event();
 
+    if (m_config->udp && setup_udp_socket(addr) != 0) {
+        return -1;
+    }
+
     // call connect
     if (::connect(m_sockfd,
                   m_unix_sockaddr ? (struct sockaddr *) m_unix_sockaddr : addr->ci_addr,
@@ -290,9 +530,25 @@ void shard_connection::disconnect() {
     evbuffer_drain(m_read_buf, evbuffer_get_length(m_read_buf));
     evbuffer_drain(m_write_buf, evbuffer_get_length(m_write_buf));
 
+    // unsent quiet SETs went with the write buffer
+    m_quiet_sets = 0;
+    m_quiet_bytes = 0;
+
+    // completions of a closed socket can't be reaped anymore; the kernel
+    // keeps its own reference to the pages until they are transmitted
+    if (m_zerocopy_hold != NULL) {
+        evbuffer_drain(m_zerocopy_hold, evbuffer_get_length(m_zerocopy_hold));
+        m_zerocopy_sends->clear();
+    }
+    m_zerocopy_next_seq = 0;
+    m_zerocopy_held = 0;
+    m_zerocopy_drained = 0;
+
     int ret = event_del(m_event);
     assert(ret == 0);
 
+    close_udp_socket();
+
     m_connected = false;
 
     // by default no need to send any setup request
@@ -306,18 +562,73 @@ void shard_connection::set_address_port(const char* address, const char* port) {
     m_port = strdup(port);
 }
 
-request* shard_connection::pop_req() {
-    request* req = m_pipeline->front();
-    m_pipeline->pop();
+// sequence numbers run from 1 up to QUIET_OPAQUE - 1
+static unsigned int seq_after(unsigned int seq)
+{
+    return seq + 1 < QUIET_OPAQUE ? seq + 1 : 1;
+}
+
+// Take the request a response belongs to: by opaque when the response
+// carries one, otherwise the oldest request in flight.  The slot stays
+// owned by the request until release_req().
+request* shard_connection::pop_req(unsigned int opaque) {
+    request* req;
+
+    if (opaque != 0) {
+        req = &m_inflight[opaque & m_inflight_mask];
+        if (req->m_type == rt_unknown || req->m_seq != opaque)
+            return NULL;
+    } else {
+        // an unsolicited reply, e.g. an error the server sent on its own
+        if (m_pending_resp == 0)
+            return NULL;
+        while ((req = &m_inflight[m_oldest_seq & m_inflight_mask])->m_type == rt_unknown ||
+               req->m_seq != m_oldest_seq) {
+            m_oldest_seq = seq_after(m_oldest_seq);
+        }
+    }
 
     m_pending_resp--;
     assert(m_pending_resp >= 0);
     return req;
 }
 
-void shard_connection::push_req(request* req) {
-    m_pipeline->push(req);
+void shard_connection::release_req(request* req) {
+    req->m_type = rt_unknown;
+
+    // skip over requests already answered out of order
+    while (m_oldest_seq != m_next_seq &&
+           (m_inflight[m_oldest_seq & m_inflight_mask].m_type == rt_unknown ||
+            m_inflight[m_oldest_seq & m_inflight_mask].m_seq != m_oldest_seq)) {
+        m_oldest_seq = seq_after(m_oldest_seq);
+    }
+}
+
+verify_request* shard_connection::push_req(request_type type, unsigned int size,
+                                           struct timeval* sent_time, unsigned int keys) {
+    verify_request* req = &m_inflight[m_next_seq & m_inflight_mask];
+
+    assert(req->m_type == rt_unknown);
+    req->init(type, size, sent_time, keys);
+    req->m_seq = m_next_seq;
     m_pending_resp++;
+
+    // 0 is reserved for responses without an opaque
+    m_next_seq = seq_after(m_next_seq);
+    m_protocol->set_opaque(m_next_seq);
+
+    return req;
+}
+
+bool shard_connection::inflight_slot_available() {
+    return m_inflight[m_next_seq & m_inflight_mask].m_type == rt_unknown;
+}
+
+bool shard_connection::request_slot_available() {
+    return m_connected && !m_migrate_pending && is_conn_setup_done() &&
+           m_pending_resp + m_udp_pending < m_config->pipeline &&
+           inflight_slot_available() &&
+           udp_slot_available();
 }
 
 bool shard_connection::is_conn_setup_done() {
@@ -330,21 +641,21 @@ void shard_connection::send_conn_setup_commands(struct timeval timestamp) {
     if (m_authentication == auth_none) {
         benchmark_debug_log("sending authentication command.\n");
         m_protocol->authenticate(m_config->authenticate);
-        push_req(new request(rt_auth, 0, &timestamp, 0));
+        push_req(rt_auth, 0, &timestamp, 0);
         m_authentication = auth_sent;
     }
 
     if (m_db_selection == select_none) {
         benchmark_debug_log("sending db selection command.\n");
         m_protocol->select_db(m_config->select_db);
-        push_req(new request(rt_select_db, 0, &timestamp, 0));
+        push_req(rt_select_db, 0, &timestamp, 0);
         m_db_selection = select_sent;
     }
 
     if (m_cluster_slots == slots_none) {
         benchmark_debug_log("sending cluster slots command.\n");
         m_protocol->write_command_cluster_slots();
-        push_req(new request(rt_cluster_slots, 0, &timestamp, 0));
+        push_req(rt_cluster_slots, 0, &timestamp, 0);
         m_cluster_slots = slots_sent;
     }
 }
@@ -361,7 +672,17 @@ void shard_connection::process_response(void)
         bool error = false;
         protocol_response *r = m_protocol->get_response();
 
-        request* req = pop_req();
+        // quiet SETs only get a response when they failed
+        if (r->get_opaque() == QUIET_OPAQUE) {
+            benchmark_error_log("error response to noreply SET: %s\n", r->get_status());
+            continue;
+        }
+
+        request* req = pop_req(r->get_opaque());
+        if (req == NULL) {
+            benchmark_error_log("error: response with unknown opaque %u.\n", r->get_opaque());
+            continue;
+        }
 
         if (req->m_type == rt_auth) {
             if (r->is_error()) {
@@ -390,6 +711,12 @@ void shard_connection::process_response(void)
                 m_cluster_slots = slots_done;
                 benchmark_debug_log("cluster slot command successful\n");
             }
+        } else if (req->m_type == rt_ltrim) {
+            // list trims only keep the --command-mix lists bounded, they
+            // are neither requests of the test nor measured
+            if (r->is_error()) {
+                benchmark_error_log("error response: %s\n", r->get_status());
+            }
         } else {
             benchmark_debug_log("handled response (first line): %s, %d hits, %d misses\n",
                                 r->get_status(),
@@ -401,10 +728,26 @@ void shard_connection::process_response(void)
             }
 
             m_conns_manager->handle_response(now, req, r);
-            m_conns_manager->inc_reqs_processed();
+            // a fence completes every quiet SET it answers for
+            unsigned int processed = req->m_type == rt_fence ? req->m_keys : 1;
+            unsigned long long latency =
+                (now.tv_sec - req->m_sent_time.tv_sec) * 1000000ULL + now.tv_usec - req->m_sent_time.tv_usec;
+            m_responses += processed;
+            m_response_latency += processed * latency;
+            if (m_migration >= 0 && !m_migrate_pending) {
+                if ((now.tv_sec - m_migrate_time.tv_sec) * 1000000LL +
+                    now.tv_usec - m_migrate_time.tv_usec < MIGRATION_WINDOW_USEC) {
+                    migrations[m_migration].window_responses += processed;
+                    migrations[m_migration].window_latency += processed * latency;
+                } else {
+                    m_migration = -1;
+                }
+            }
+            while (processed-- > 0)
+                m_conns_manager->inc_reqs_processed();
             responses_handled = true;
         }
-        delete req;
+        release_req(req);
         if (error) {
             return;
         }
@@ -416,7 +759,7 @@ void shard_connection::process_response(void)
 
     if (m_config->reconnect_interval > 0 && responses_handled) {
         if ((m_conns_manager->get_reqs_processed() % m_config->reconnect_interval) == 0) {
-            assert(m_pipeline->size() == 0);
+            assert(m_pending_resp == 0);
             benchmark_debug_log("reconnecting, m_reqs_processed = %u\n", m_conns_manager->get_reqs_processed());
 
             // client manage connection & disconnection of shard
@@ -442,26 +785,51 @@ void shard_connection::fill_pipeline(void)
     struct timeval now;
     uint64_t currentTime = Cycles::rdtsc();
 
+    // a connection picked for migration sends nothing more until it moved
+    if (m_migrate_pending)
+        return;
+
     gettimeofday(&now, NULL);
 
     // don't exceed requests
-    if (m_conns_manager->hold_pipeline(m_id))
+    if (m_conns_manager->hold_pipeline(m_id)) {
+        // the last quiet SETs may still be waiting for their fence
+        if (m_quiet_sets > 0 && inflight_slot_available()) {
+            send_fence_command(&now);
+            if (write_buffer() < 0 && errno != EWOULDBLOCK) {
+                benchmark_error_log("write error: %s\n", strerror(errno));
+                disconnect();
+            }
+        }
         return;
+    }
     if (!is_conn_setup_done()) {
         send_conn_setup_commands(now);
     }
 
     // Clipping based on pipeline size
     while (!m_conns_manager->finished() &&
-           m_pipeline->size() < m_config->pipeline &&
+           m_pending_resp + m_udp_pending < m_config->pipeline &&
+           inflight_slot_available() &&
+           udp_slot_available() &&
            nextCycleTime < currentTime) {
 
+        // stop at the request count, and when the client has nothing for
+        // this connection; quiet SETs and requests sent on other connections
+        // of the client don't fill this pipeline
+        if (m_conns_manager->hold_pipeline(m_id))
+            break;
+
         // Check the current time to decide whether or not to send out request
         m_conns_manager->create_request(now, m_id);
 
-        // Send out here!
-        if (check_sockfd_writable() > 0) {
-            if (evbuffer_write(m_write_buf, m_sockfd) < 0) {
+        if (m_quiet_sets > 0 && inflight_slot_available() &&
+            (m_quiet_sets >= m_config->noreply_fence || m_conns_manager->hold_pipeline(m_id)))
+            send_fence_command(&now);
+
+        // Send out here! (a UDP GET leaves nothing for the TCP socket)
+        if (evbuffer_get_length(m_write_buf) > 0 && check_sockfd_writable() > 0) {
+            if (write_buffer() < 0) {
                 if (errno != EWOULDBLOCK) {
                     benchmark_error_log("write error: %s\n", strerror(errno));
                     disconnect();
@@ -489,6 +857,217 @@ void shard_connection::fill_pipeline(void)
         gettimeofday(&now, NULL);
     }
 
+    flush_udp_batch();
+}
+
+// Takes part in the migrations the master started since the connection last
+// looked: every connection on the source thread draws a ticket, and those
+// whose ticket crosses the next whole multiple of 1/fraction are picked, so
+// the fraction is spread evenly over them.  A picked connection moves once
+// its responses are in and no other move owns the server's dispatch: it
+// goes down here, and the move completes in handle_event() once the new
+// handshake is done.  Returns true when it went down for the move.
+bool shard_connection::check_migration(void)
+{
+    unsigned int started = migrationsStarted.load(std::memory_order_acquire);
+
+    while (!m_migrate_pending && m_migrations_seen < started) {
+        migration& m = migrations[m_migrations_seen];
+        if (serverTid == m.from_tid) {
+            unsigned int ticket = m.tickets.fetch_add(1);
+            if ((unsigned int) ((ticket + 1) * m.fraction) > (unsigned int) (ticket * m.fraction)) {
+                m_migration = m_migrations_seen;
+                m_migrate_pending = true;
+                gettimeofday(&m_migrate_time, NULL);
+            }
+        }
+        m_migrations_seen++;
+    }
+
+    if (!m_migrate_pending || m_migrate_connecting || m_pending_resp + m_udp_pending > 0)
+        return false;
+
+    // another move owns the dispatch, try again on the next write event
+    m_migrate_connecting = true;
+    if (m_conns_manager->migrate_conn(m_id, migrations[m_migration].to_tid) > 0) {
+        m_migrate_connecting = false;
+        return false;
+    }
+
+    return true;
+}
+
+void shard_connection::migration_placed(bool reconnecting)
+{
+    if (!reconnecting) {
+        finish_migration(false);
+        return;
+    }
+
+    // the handshake gets as long as a placement connect
+    struct timeval timeout = { CONNECT_TIMEOUT_SEC, 0 };
+    int ret = event_add(m_event, &timeout);
+    assert(ret == 0);
+}
+
+// Accounts the move once the new handshake completed, or failed, and hands
+// the dispatch on; a failed move leaves the connection down, as the thread
+// it reached is unknown.
+void shard_connection::finish_migration(bool moved)
+{
+    migration& m = migrations[m_migration];
+
+    m_migrate_pending = false;
+    m_migrate_connecting = false;
+    m_conns_manager->end_migration(m_id, m.to_tid, moved);
+
+    if (!moved) {
+        benchmark_error_log("migrate: connection %u left down.\n", m_id);
+        m.failed++;
+        disconnect();
+        return;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t cost = (now.tv_sec - m_migrate_time.tv_sec) * 1000000ULL + now.tv_usec - m_migrate_time.tv_usec;
+    m.moved++;
+    m.total_cost += cost;
+    uint64_t max_cost = m.max_cost.load();
+    while (cost > max_cost && !m.max_cost.compare_exchange_weak(max_cost, cost))
+        ;
+
+    m_migrate_time = now;
+}
+
+// Write out m_write_buf.  Large writes go out with MSG_ZEROCOPY when it is
+// enabled; the kernel then reads the pages after sendmsg() returned, so
+// everything sent while completions are outstanding is moved to
+// m_zerocopy_hold rather than freed.  Each zero-copy send records where its
+// bytes end in the hold.  Returns like evbuffer_write().
+int shard_connection::write_buffer(void)
+{
+#ifdef MSG_ZEROCOPY
+    if (m_zerocopy_enabled) {
+        reap_zerocopy_completions();
+
+        size_t len = evbuffer_get_length(m_write_buf);
+        if (len >= m_config->zero_copy_threshold || !m_zerocopy_sends->empty()) {
+            struct evbuffer_iovec vecs[ZEROCOPY_MAX_IOVS];
+            struct iovec iovs[ZEROCOPY_MAX_IOVS];
+            int n = evbuffer_peek(m_write_buf, -1, NULL, vecs, ZEROCOPY_MAX_IOVS);
+            if (n > ZEROCOPY_MAX_IOVS)
+                n = ZEROCOPY_MAX_IOVS;
+            for (int i = 0; i < n; i++) {
+                iovs[i].iov_base = vecs[i].iov_base;
+                iovs[i].iov_len = vecs[i].iov_len;
+            }
+
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iovs;
+            msg.msg_iovlen = n;
+
+            // below the threshold the send is a plain copy, but its bytes
+            // must still stay behind the ones the kernel may be reading
+            int send_flags = len >= m_config->zero_copy_threshold ? MSG_ZEROCOPY : 0;
+            ssize_t sent = sendmsg(m_sockfd, &msg, send_flags);
+            if (sent < 0 && errno == ENOBUFS && send_flags) {
+                // out of optmem for pinned pages, fall back to copying
+                send_flags = 0;
+                sent = sendmsg(m_sockfd, &msg, 0);
+            }
+            if (sent < 0)
+                return -1;
+
+            // a send ending inside a chain still pins its sent prefix, so
+            // the whole chain is held and its unsent tail goes back as a
+            // copy; left in m_write_buf the chain could be realigned over
+            // the pinned bytes by the next evbuffer_add
+            size_t held = sent;
+            size_t chain_end = 0;
+            int i = 0;
+            while (i < n && chain_end + iovs[i].iov_len <= (size_t) sent)
+                chain_end += iovs[i++].iov_len;
+            if (send_flags && i < n && chain_end < (size_t) sent)
+                held = chain_end + iovs[i].iov_len;
+
+            evbuffer_remove_buffer(m_write_buf, m_zerocopy_hold, held);
+            m_zerocopy_held += held;
+            if (held > (size_t) sent) {
+                size_t head = sent - chain_end;
+                evbuffer_prepend(m_write_buf, (char *) iovs[i].iov_base + head, iovs[i].iov_len - head);
+            }
+
+            if (send_flags) {
+                zerocopy_send zs = { m_zerocopy_next_seq++, false, m_zerocopy_held };
+                m_zerocopy_sends->push_back(zs);
+            } else if (m_zerocopy_sends->empty()) {
+                evbuffer_drain(m_zerocopy_hold, evbuffer_get_length(m_zerocopy_hold));
+                m_zerocopy_drained = m_zerocopy_held;
+            }
+
+            return sent;
+        }
+    }
+#endif
+    return evbuffer_write(m_write_buf, m_sockfd);
+}
+
+// Completions arrive on the socket error queue as ranges of sendmsg() calls.
+// The hold is drained up to the newest send that has no older one pending.
+void shard_connection::reap_zerocopy_completions(void)
+{
+#ifdef MSG_ZEROCOPY
+    if (m_zerocopy_sends == NULL || m_zerocopy_sends->empty())
+        return;
+
+    char control[128];
+    while (true) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(m_sockfd, &msg, MSG_ERRQUEUE) < 0)
+            break;
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                continue;
+
+            struct sock_extended_err *serr = (struct sock_extended_err *) CMSG_DATA(cm);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+
+            // sends complete almost always in order, but a range may also
+            // cover sends behind one that is still pending
+            uint32_t lo = serr->ee_info;
+            uint32_t span = serr->ee_data - lo;
+            for (std::deque<zerocopy_send>::iterator it = m_zerocopy_sends->begin();
+                 it != m_zerocopy_sends->end(); ++it) {
+                if (it->seq - lo <= span)
+                    it->done = true;
+            }
+        }
+    }
+
+    uint64_t drain_to = m_zerocopy_drained;
+    while (!m_zerocopy_sends->empty() && m_zerocopy_sends->front().done) {
+        drain_to = m_zerocopy_sends->front().hold_end;
+        m_zerocopy_sends->pop_front();
+    }
+
+    // copies sent behind the last zero-copy send need no completion
+    if (m_zerocopy_sends->empty())
+        drain_to = m_zerocopy_held;
+
+    if (drain_to > m_zerocopy_drained) {
+        evbuffer_drain(m_zerocopy_hold, drain_to - m_zerocopy_drained);
+        m_zerocopy_drained = drain_to;
+    }
+#endif
 }
 
 void shard_connection::handle_event(short evtype)
@@ -496,21 +1075,35 @@ void shard_connection::handle_event(short evtype)
     // connect() returning to us?  normally we expect EV_WRITE, but for UNIX domain
     // sockets we workaround since connect() returned immediately, but we don't want
     // to do any I/O from the client::connect() call...
+    // only the reconnect of a migration waits with a timeout
+    if (!m_connected && evtype == EV_TIMEOUT) {
+        benchmark_error_log("connect: connection timed out.\n");
+        if (m_migrate_connecting)
+            finish_migration(false);
+        return;
+    }
+
     if (!m_connected && (evtype == EV_WRITE || m_unix_sockaddr != NULL)) {
         int error = -1;
         socklen_t errsz = sizeof(error);
 
         if (getsockopt(m_sockfd, SOL_SOCKET, SO_ERROR, (void *) &error, &errsz) == -1) {
             benchmark_error_log("connect: error getting connect response (getsockopt): %s\n", strerror(errno));
+            if (m_migrate_connecting)
+                finish_migration(false);
             return;
         }
 
         if (error != 0) {
             benchmark_error_log("connect: connection failed: %s\n", strerror(error));
+            if (m_migrate_connecting)
+                finish_migration(false);
             return;
         }
 
         m_connected = true;
+        if (m_migrate_connecting)
+            finish_migration(true);
         if (!m_conns_manager->get_reqs_processed()) {
             process_first_request();
         } else {
@@ -521,9 +1114,12 @@ void shard_connection::handle_event(short evtype)
 
     assert(m_connected == true);
 
+    // the error queue raises POLLERR until its completions are read
+    reap_zerocopy_completions();
+
     // Send if something remained in the buffer
     if ((evtype & EV_WRITE) == EV_WRITE && evbuffer_get_length(m_write_buf) > 0) {
-        if (evbuffer_write(m_write_buf, m_sockfd) < 0) {
+        if (write_buffer() < 0) {
             if (errno != EWOULDBLOCK) {
                 benchmark_error_log("write error: %s\n", strerror(errno));
                 disconnect();
@@ -564,8 +1160,11 @@ void shard_connection::handle_event(short evtype)
         }
     }
 
-    // Send out request when writable
+    // Send out request when writable, unless the connection just went down
+    // to move; the event of its new socket is already pending then
     if ((evtype & EV_WRITE) == EV_WRITE) {
+        if (check_migration())
+            return;
         fill_pipeline();
     }
 
@@ -592,6 +1191,245 @@ void shard_connection::handle_event(short evtype)
     }
 }
 
+bool shard_connection::udp_slot_available() {
+    if (m_udp_sockfd == -1)
+        return true;
+
+    return m_udp_slots[m_udp_next_id & m_udp_slots_mask].m_req.m_type == rt_unknown;
+}
+
+// Queue a request already written to m_udp_write_buf; it goes out on the next flush
+void shard_connection::push_udp_req(unsigned int size, struct timeval* sent_time, unsigned int keys) {
+    size_t len = evbuffer_get_length(m_udp_write_buf) - m_udp_batch_bytes;
+    unsigned short id = m_udp_next_id++;
+
+    udp_slot* slot = &m_udp_slots[id & m_udp_slots_mask];
+    assert(slot->m_req.m_type == rt_unknown);
+    slot->m_req.init(rt_udp_get, size, sent_time, keys);
+    slot->m_request_id = id;
+    udp_slot_clear(slot);
+
+    udp_frame_header* hdr = &m_udp_batch_hdrs[m_udp_batch_count];
+    hdr->m_request_id = htons(id);
+    hdr->m_seq = 0;
+    hdr->m_total = htons(1);
+    hdr->m_reserved = 0;
+
+    m_udp_batch_lens[m_udp_batch_count] = len;
+    m_udp_batch_bytes += len;
+    m_udp_batch_count++;
+    m_udp_pending++;
+
+    if (m_udp_batch_count == UDP_BATCH_SIZE)
+        flush_udp_batch();
+}
+
+void shard_connection::flush_udp_batch() {
+    if (m_udp_batch_count == 0)
+        return;
+
+    char* payload = (char *) evbuffer_pullup(m_udp_write_buf, m_udp_batch_bytes);
+    assert(payload != NULL);
+
+    for (unsigned int i = 0; i < m_udp_batch_count; i++) {
+        m_udp_iovs[i * 2].iov_base = &m_udp_batch_hdrs[i];
+        m_udp_iovs[i * 2].iov_len = sizeof(udp_frame_header);
+        m_udp_iovs[i * 2 + 1].iov_base = payload;
+        m_udp_iovs[i * 2 + 1].iov_len = m_udp_batch_lens[i];
+        payload += m_udp_batch_lens[i];
+
+        memset(&m_udp_msgs[i], 0, sizeof(struct mmsghdr));
+        m_udp_msgs[i].msg_hdr.msg_iov = &m_udp_iovs[i * 2];
+        m_udp_msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    unsigned int sent = 0;
+    while (sent < m_udp_batch_count) {
+        int n = sendmmsg(m_udp_sockfd, m_udp_msgs + sent, m_udp_batch_count - sent, 0);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+                benchmark_error_log("UDP write error: %s\n", strerror(errno));
+            break;
+        }
+        sent += n;
+    }
+
+    // requests the kernel refused never reached the network: release their
+    // slots now and count them apart from losses on the wire
+    if (sent < m_udp_batch_count) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        for (unsigned int i = sent; i < m_udp_batch_count; i++) {
+            unsigned short id = ntohs(m_udp_batch_hdrs[i].m_request_id);
+            udp_slot* slot = &m_udp_slots[id & m_udp_slots_mask];
+
+            m_conns_manager->handle_udp_send_failure(now, &slot->m_req);
+            m_conns_manager->inc_reqs_processed();
+
+            slot->m_req.m_type = rt_unknown;
+            m_udp_pending--;
+        }
+    }
+
+    evbuffer_drain(m_udp_write_buf, m_udp_batch_bytes);
+    m_udp_batch_count = 0;
+    m_udp_batch_bytes = 0;
+}
+
+void shard_connection::process_udp_datagram(const char* data, size_t len, struct timeval now) {
+    udp_frame_header hdr;
+
+    if (len < sizeof(hdr)) {
+        benchmark_debug_log("short UDP datagram (%u bytes) ignored.\n", len);
+        return;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+
+    unsigned short id = ntohs(hdr.m_request_id);
+    unsigned short seq = ntohs(hdr.m_seq);
+    unsigned short total = ntohs(hdr.m_total);
+
+    // replies may come back in any order; the request id finds the slot.
+    // a reply to a request that already timed out finds an empty or reused slot.
+    udp_slot* slot = &m_udp_slots[id & m_udp_slots_mask];
+    if (slot->m_req.m_type == rt_unknown || slot->m_request_id != id)
+        return;
+
+    if (total == 0 || total > UDP_MAX_DATAGRAMS || seq >= total)
+        return;
+
+    // fragments of a multi-datagram reply may arrive in any order; each is
+    // kept by its sequence number until all of them are in
+    if (slot->m_total == 0) {
+        slot->m_total = total;
+        if (slot->m_frags.size() < total) {
+            slot->m_frags.resize(total, NULL);
+            slot->m_have.resize(total, false);
+        }
+    } else if (slot->m_total != total || slot->m_have[seq]) {
+        return;
+    }
+
+    if (slot->m_frags[seq] == NULL) {
+        slot->m_frags[seq] = evbuffer_new();
+        assert(slot->m_frags[seq] != NULL);
+    }
+    evbuffer_add(slot->m_frags[seq], data + sizeof(hdr), len - sizeof(hdr));
+    slot->m_have[seq] = true;
+    if (++slot->m_received < total)
+        return;
+
+    request* req = &slot->m_req;
+    m_udp_pending--;
+
+    for (unsigned int i = 0; i < total; i++)
+        evbuffer_add_buffer(m_udp_read_buf, slot->m_frags[i]);
+    udp_slot_clear(slot);
+    int ret = m_udp_protocol->parse_response();
+    if (ret > 0) {
+        protocol_response *r = m_udp_protocol->get_response();
+
+        benchmark_debug_log("handled UDP response (first line): %s, %d hits, %d misses\n",
+                            r->get_status(),
+                            r->get_hits(),
+                            req->m_keys - r->get_hits());
+
+        if (r->is_error()) {
+            benchmark_error_log("error response: %s\n", r->get_status());
+        }
+
+        m_conns_manager->handle_response(now, req, r);
+    } else {
+        benchmark_error_log("error: UDP response parsing failed.\n");
+
+        // start the next datagram with a clean parser
+        delete m_udp_protocol;
+        m_udp_protocol = m_protocol->clone();
+        assert(m_udp_protocol != NULL);
+        m_udp_protocol->set_buffers(m_udp_read_buf, m_udp_write_buf);
+
+        m_conns_manager->handle_udp_loss(now, req);
+    }
+    evbuffer_drain(m_udp_read_buf, evbuffer_get_length(m_udp_read_buf));
+
+    m_conns_manager->inc_reqs_processed();
+    req->m_type = rt_unknown;
+}
+
+void shard_connection::expire_udp_requests(struct timeval now) {
+    long long int timeout_usec = (long long int) m_config->udp_timeout * 1000;
+
+    for (unsigned int i = 0; i <= m_udp_slots_mask; i++) {
+        udp_slot* slot = &m_udp_slots[i];
+        if (slot->m_req.m_type == rt_unknown)
+            continue;
+
+        struct timeval* sent = &slot->m_req.m_sent_time;
+        long long int age = (long long int) (now.tv_sec - sent->tv_sec) * 1000000 +
+                            (now.tv_usec - sent->tv_usec);
+        if (age < timeout_usec)
+            continue;
+
+        benchmark_debug_log("UDP request %u timed out.\n", slot->m_request_id);
+        m_conns_manager->handle_udp_loss(now, &slot->m_req);
+        m_conns_manager->inc_reqs_processed();
+
+        slot->m_req.m_type = rt_unknown;
+        udp_slot_clear(slot);
+        m_udp_pending--;
+    }
+}
+
+void shard_connection::handle_udp_event(short evtype)
+{
+    struct timeval now;
+
+    if ((evtype & EV_READ) == EV_READ) {
+        int n;
+
+        for (unsigned int i = 0; i < UDP_BATCH_SIZE; i++) {
+            m_udp_iovs[i].iov_base = m_udp_recv_bufs + i * UDP_DATAGRAM_SIZE;
+            m_udp_iovs[i].iov_len = UDP_DATAGRAM_SIZE;
+
+            memset(&m_udp_msgs[i], 0, sizeof(struct mmsghdr));
+            m_udp_msgs[i].msg_hdr.msg_iov = &m_udp_iovs[i];
+            m_udp_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        do {
+            n = recvmmsg(m_udp_sockfd, m_udp_msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+            if (n < 0) {
+                // ECONNREFUSED is an ICMP error from an earlier send; the requests will expire
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED)
+                    benchmark_error_log("UDP read error: %s\n", strerror(errno));
+                break;
+            }
+
+            gettimeofday(&now, NULL);
+            for (int i = 0; i < n; i++) {
+                process_udp_datagram(m_udp_recv_bufs + i * UDP_DATAGRAM_SIZE,
+                                     m_udp_msgs[i].msg_len, now);
+            }
+        } while (n == UDP_BATCH_SIZE);
+    }
+
+    gettimeofday(&now, NULL);
+    expire_udp_requests(now);
+
+    if (m_conns_manager->finished()) {
+        int ret = event_del(m_udp_event);
+        assert(ret == 0);
+
+        m_conns_manager->set_end_time();
+        return;
+    }
+
+    if (m_connected) {
+        fill_pipeline();
+    }
+}
+
 void shard_connection::send_wait_command(struct timeval* sent_time,
                                          unsigned int num_slaves, unsigned int timeout) {
     int cmd_size = 0;
@@ -599,7 +1437,7 @@ void shard_connection::send_wait_command(struct timeval* sent_time,
     benchmark_debug_log("WAIT num_slaves=%u timeout=%u\n", num_slaves, timeout);
 
     cmd_size = m_protocol->write_command_wait(num_slaves, timeout);
-    push_req(new request(rt_wait, cmd_size, sent_time, 0));
+    push_req(rt_wait, cmd_size, sent_time, 0);
 }
 
 void shard_connection::send_set_command(struct timeval* sent_time, const char *key, int key_len,
@@ -609,10 +1447,53 @@ void shard_connection::send_set_command(struct timeval* sent_time, const char *k
     benchmark_debug_log("SET key=[%.*s] value_len=%u expiry=%u\n",
                         key_len, key, value_len, expiry);
 
+    if (m_config->noreply) {
+        if (!m_quiet_sets)
+            m_quiet_start = *sent_time;
+
+        // the last SET of a full batch, or of the run, may be its own fence
+        if (m_protocol->fence_on_last_set() &&
+            (m_quiet_sets + 1 >= m_config->noreply_fence ||
+             (m_config->requests && m_conns_manager->get_reqs_generated() + 1 >= m_config->requests))) {
+            m_protocol->set_noreply(false);
+            cmd_size = m_protocol->write_command_set(key, key_len, value, value_len,
+                                                     expiry, offset);
+            m_protocol->set_noreply(true);
+
+            push_req(rt_fence, m_quiet_bytes + cmd_size, &m_quiet_start, m_quiet_sets + 1);
+            m_quiet_sets = 0;
+            m_quiet_bytes = 0;
+            return;
+        }
+
+        m_protocol->set_opaque(QUIET_OPAQUE);
+        cmd_size = m_protocol->write_command_set(key, key_len, value, value_len,
+                                                 expiry, offset);
+        m_protocol->set_opaque(m_next_seq);
+
+        m_quiet_sets++;
+        m_quiet_bytes += cmd_size;
+        return;
+    }
+
     cmd_size = m_protocol->write_command_set(key, key_len, value, value_len,
                                              expiry, offset);
 
-    push_req(new request(rt_set, cmd_size, sent_time, 1));
+    push_req(rt_set, cmd_size, sent_time, 1);
+}
+
+// The fence is answered once the server went through every quiet SET before
+// it, so its latency, taken from the first of them, is that of the batch.
+void shard_connection::send_fence_command(struct timeval* sent_time) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("FENCE after %u quiet SETs\n", m_quiet_sets);
+
+    cmd_size = m_protocol->write_command_fence();
+
+    push_req(rt_fence, m_quiet_bytes + cmd_size, &m_quiet_start, m_quiet_sets);
+    m_quiet_sets = 0;
+    m_quiet_bytes = 0;
 }
 
 void shard_connection::send_get_command(struct timeval* sent_time,
@@ -620,9 +1501,15 @@ void shard_connection::send_get_command(struct timeval* sent_time,
     int cmd_size = 0;
 
     benchmark_debug_log("GET key=[%.*s]\n", key_len, key);
+    if (m_udp_sockfd != -1) {
+        cmd_size = m_udp_protocol->write_command_get(key, key_len, offset);
+        push_udp_req(cmd_size, sent_time, 1);
+        return;
+    }
+
     cmd_size = m_protocol->write_command_get(key, key_len, offset);
 
-    push_req(new request(rt_get, cmd_size, sent_time, 1));
+    push_req(rt_get, cmd_size, sent_time, 1);
 
 }
 
@@ -637,9 +1524,15 @@ void shard_connection::send_mget_command(struct timeval* sent_time, const keylis
     benchmark_debug_log("MGET %d keys [%.*s] .. [%.*s]\n",
                         key_list->get_keys_count(), first_key_len, first_key, last_key_len, last_key);
 
+    if (m_udp_sockfd != -1) {
+        cmd_size = m_udp_protocol->write_command_multi_get(key_list);
+        push_udp_req(cmd_size, sent_time, key_list->get_keys_count());
+        return;
+    }
+
     cmd_size = m_protocol->write_command_multi_get(key_list);
 
-    push_req(new request(rt_get, cmd_size, sent_time, key_list->get_keys_count()));
+    push_req(rt_get, cmd_size, sent_time, key_list->get_keys_count());
 }
 
 void shard_connection::send_verify_get_command(struct timeval* sent_time, const char *key, int key_len,
@@ -651,7 +1544,159 @@ void shard_connection::send_verify_get_command(struct timeval* sent_time, const
 
     cmd_size = m_protocol->write_command_get(key, key_len, offset);
 
-    push_req(new verify_request(rt_get, cmd_size, sent_time, 1, key, key_len, value, value_len));
+    verify_request* req = push_req(rt_get, cmd_size, sent_time, 1);
+    m_request_allocs += req->set_key_value(key, key_len, value, value_len);
+}
+
+void shard_connection::send_delete_command(struct timeval* sent_time, const char *key, int key_len) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("DELETE key=[%.*s]\n", key_len, key);
+
+    cmd_size = m_protocol->write_command_delete(key, key_len);
+
+    push_req(rt_delete, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_incr_command(struct timeval* sent_time, const char *key, int key_len,
+                                         unsigned int delta, bool decr) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("%s key=[%.*s] delta=%u\n", decr ? "DECR" : "INCR", key_len, key, delta);
+
+    cmd_size = m_protocol->write_command_incr(key, key_len, delta, decr);
+
+    push_req(decr ? rt_decr : rt_incr, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_append_command(struct timeval* sent_time, const char *key, int key_len,
+                                           const char *value, int value_len) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("APPEND key=[%.*s] value_len=%u\n", key_len, key, value_len);
+
+    cmd_size = m_protocol->write_command_append(key, key_len, value, value_len);
+
+    push_req(rt_append, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_touch_command(struct timeval* sent_time, const char *key, int key_len, int expiry) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("TOUCH key=[%.*s] expiry=%u\n", key_len, key, expiry);
+
+    cmd_size = m_protocol->write_command_touch(key, key_len, expiry);
+
+    push_req(rt_touch, cmd_size, sent_time, 1);
+}
+
+// the key is kept in the slot so the cas unique of the reply can be tied to it
+void shard_connection::send_gets_command(struct timeval* sent_time, const char *key, int key_len) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("GETS key=[%.*s]\n", key_len, key);
+
+    cmd_size = m_protocol->write_command_gets(key, key_len);
+
+    verify_request* req = push_req(rt_gets, cmd_size, sent_time, 1);
+    m_request_allocs += req->set_key_value(key, key_len, NULL, 0);
+}
+
+void shard_connection::send_cas_command(struct timeval* sent_time, const char *key, int key_len,
+                                        const char *value, int value_len, int expiry, unsigned long long cas) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("CAS key=[%.*s] value_len=%u expiry=%u cas=%llu\n",
+                        key_len, key, value_len, expiry, cas);
+
+    cmd_size = m_protocol->write_command_cas(key, key_len, value, value_len, expiry, cas);
+
+    push_req(rt_cas, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_hset_command(struct timeval* sent_time, const char *key, int key_len,
+                                         const char *field, int field_len, const char *value, int value_len) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("HSET key=[%.*s] field=[%.*s] value_len=%u\n",
+                        key_len, key, field_len, field, value_len);
+
+    cmd_size = m_protocol->write_command_hset(key, key_len, field, field_len, value, value_len);
+
+    push_req(rt_hset, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_hget_command(struct timeval* sent_time, const char *key, int key_len,
+                                         const char *field, int field_len) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("HGET key=[%.*s] field=[%.*s]\n", key_len, key, field_len, field);
+
+    cmd_size = m_protocol->write_command_hget(key, key_len, field, field_len);
+
+    push_req(rt_hget, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_lpush_command(struct timeval* sent_time, const char *key, int key_len,
+                                          const char *value, int value_len) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("LPUSH key=[%.*s] value_len=%u\n", key_len, key, value_len);
+
+    cmd_size = m_protocol->write_command_lpush(key, key_len, value, value_len);
+
+    push_req(rt_lpush, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_lrange_command(struct timeval* sent_time, const char *key, int key_len,
+                                           int start, int stop) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("LRANGE key=[%.*s] start=%d stop=%d\n", key_len, key, start, stop);
+
+    cmd_size = m_protocol->write_command_lrange(key, key_len, start, stop);
+
+    push_req(rt_lrange, cmd_size, sent_time, 1);
+}
+
+// rides along with an LPUSH past the pipeline depth, as long as a request
+// slot is free; false if none is
+bool shard_connection::send_ltrim_command(struct timeval* sent_time, const char *key, int key_len,
+                                          int start, int stop) {
+    int cmd_size = 0;
+
+    if (!inflight_slot_available())
+        return false;
+
+    benchmark_debug_log("LTRIM key=[%.*s] start=%d stop=%d\n", key_len, key, start, stop);
+
+    cmd_size = m_protocol->write_command_ltrim(key, key_len, start, stop);
+
+    push_req(rt_ltrim, cmd_size, sent_time, 1);
+    return true;
+}
+
+void shard_connection::send_zadd_command(struct timeval* sent_time, const char *key, int key_len,
+                                         unsigned int score, const char *member, int member_len) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("ZADD key=[%.*s] score=%u member=[%.*s]\n",
+                        key_len, key, score, member_len, member);
+
+    cmd_size = m_protocol->write_command_zadd(key, key_len, score, member, member_len);
+
+    push_req(rt_zadd, cmd_size, sent_time, 1);
+}
+
+void shard_connection::send_zrangebyscore_command(struct timeval* sent_time, const char *key, int key_len,
+                                                  unsigned int min, unsigned int max) {
+    int cmd_size = 0;
+
+    benchmark_debug_log("ZRANGEBYSCORE key=[%.*s] min=%u max=%u\n", key_len, key, min, max);
+
+    cmd_size = m_protocol->write_command_zrangebyscore(key, key_len, min, max);
+
+    push_req(rt_zrangebyscore, cmd_size, sent_time, 1);
 }
 
 // Check m_sockfd writable or not
@@ -663,62 +1708,28 @@ int shard_connection::check_sockfd_writable() {
     return ::poll(&pfd_write, 1, timeout);
 }
 
-// Check m_sockfd readable or not
-int shard_connection::check_sockfd_readable() {
-    // Don't use select()! buffer overflow!
-    struct pollfd pfd_read;
-    int timeout = 5000;
-    pfd_read.fd = m_sockfd;
-    pfd_read.events = POLLIN;
-    return ::poll(&pfd_read, 1, timeout);
-}
-
-// Make sure m_sockfd has been dispatched by sending and waiting for a request
-void shard_connection::gurantee_sockfd_dispatch() {
-    // Send out a fake get command
-    int cmd_size = 0;
+// Wait for the connection handshake to complete.  The server accepts
+// connections in the order their handshakes complete, so this is all the
+// thread placement of client::prepare() relies on.
+int shard_connection::wait_established() {
     int ret;
 
-    // Make sure socket is writable
     do {
         ret = check_sockfd_writable();
     } while ((ret == -1) && (errno == EINTR));
 
-    cmd_size = m_protocol->write_command_get("test", 4, 0);
-    if (cmd_size < 0) {
-        fprintf(stderr, "cmd_size less than zero! \n");
-        exit(1);
-    }
-    if (evbuffer_get_length(m_write_buf) > 0) {
-        if (evbuffer_write(m_write_buf, m_sockfd) < 0) {
-            if (errno != EWOULDBLOCK) {
-                fprintf(stderr, "write error: %s\n", strerror(errno));
-                disconnect();
-                exit(1);
-            }
-        }
+    if (ret <= 0) {
+        benchmark_error_log("connect timed out.\n");
+        return -1;
     }
 
-    // Make sure socket is readable
-    do {
-        ret = check_sockfd_readable();
-    } while ((ret == -1) && (errno == EINTR));
-
-    ret = 1;
-    while (ret > 0) {
-        ret = evbuffer_read(m_read_buf, m_sockfd, -1);
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(m_sockfd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+        benchmark_error_log("connect failed, error = %s\n", strerror(error ? error : errno));
+        return -1;
     }
 
-    if (evbuffer_get_length(m_read_buf) > 0) {
-        ret = m_protocol->parse_response();
-        if (ret == -1) {
-            fprintf(stderr, "error: parsing!\n");
-        }
-    } else {
-        fprintf(stderr, "fail to get response! \n");
-        disconnect();
-        exit(1);
-    }
-    return;
+    return 0;
 }
 
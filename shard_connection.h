@@ -20,7 +20,8 @@
 #define MEMTIER_BENCHMARK_SHARD_CONNECTION_H
 
 #include <poll.h>
-#include <queue>
+#include <vector>
+#include <deque>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -40,36 +41,76 @@ enum authentication_state { auth_none, auth_sent, auth_done };
 enum select_db_state { select_none, select_sent, select_done };
 enum cluster_slots_state { slots_none, slots_sent, slots_done };
 
-enum request_type { rt_unknown, rt_set, rt_get, rt_wait, rt_auth, rt_select_db, rt_cluster_slots };
+enum request_type { rt_unknown, rt_set, rt_get, rt_wait, rt_auth, rt_select_db, rt_cluster_slots, rt_udp_get,
+                   rt_delete, rt_incr, rt_decr, rt_append, rt_touch, rt_cas, rt_gets, rt_fence,
+                   rt_hset, rt_hget, rt_lpush, rt_lrange, rt_ltrim, rt_zadd, rt_zrangebyscore };
 struct request {
-    request_type m_type;
+    request_type m_type;        // rt_unknown while the slot holding it is free
     struct timeval m_sent_time;
     unsigned int m_size;
     unsigned int m_keys;
+    unsigned int m_seq;         // in-flight sequence number, sent as opaque where supported
 
-    request(request_type type, unsigned int size, struct timeval* sent_time, unsigned int keys);
+    request(void);
+    void init(request_type type, unsigned int size, struct timeval* sent_time, unsigned int keys);
     virtual ~request(void) {}
 };
 
 struct verify_request : public request {
     char *m_key;
     unsigned int m_key_len;
+    unsigned int m_key_size;    // allocated, kept across requests using this slot
     char *m_value;
     unsigned int m_value_len;
+    unsigned int m_value_size;
 
-    verify_request(request_type type,
-                   unsigned int size,
-                   struct timeval* sent_time,
-                   unsigned int keys,
-                   const char *key,
-                   unsigned int key_len,
-                   const char *value,
-                   unsigned int value_len);
+    verify_request(void);
+    unsigned int set_key_value(const char *key, unsigned int key_len,
+                               const char *value, unsigned int value_len);
     virtual ~verify_request(void);
 };
 
+// memcached UDP frame header, all fields in network byte order
+struct udp_frame_header {
+    uint16_t m_request_id;
+    uint16_t m_seq;
+    uint16_t m_total;
+    uint16_t m_reserved;
+};
+
+#define UDP_BATCH_SIZE      16      // datagrams per sendmmsg/recvmmsg call
+#define UDP_DATAGRAM_SIZE   2048    // receive buffer per datagram
+#define UDP_MAX_DATAGRAMS   1024    // largest reply (in datagrams) we reassemble
+
+#define CONNECT_TIMEOUT_SEC 5       // handshakes of placement and migration connects
+
+#define ZEROCOPY_MAX_IOVS   64      // evbuffer chains per MSG_ZEROCOPY sendmsg
+
+#define QUIET_OPAQUE        0x80000000  // opaque of --noreply SETs, above every sequence number
+
+// a MSG_ZEROCOPY sendmsg() still waiting for its completion; hold_end is
+// where its bytes end in m_zerocopy_hold, counted from the first held byte
+struct zerocopy_send {
+    uint32_t seq;
+    bool done;
+    uint64_t hold_end;
+};
+
+// UDP request in flight, found by (request id & mask)
+struct udp_slot {
+    request m_req;
+    unsigned short m_request_id;
+    unsigned short m_received;      // distinct response datagrams received so far
+    unsigned short m_total;         // datagrams in the reply, 0 until the first arrives
+    std::vector<struct evbuffer*> m_frags;  // reply payload by sequence number
+    std::vector<bool> m_have;
+
+    udp_slot() : m_request_id(0), m_received(0), m_total(0) {}
+};
+
 class shard_connection {
     friend void cluster_client_event_handler(evutil_socket_t sfd, short evtype, void *opaque);
+    friend void udp_event_handler(evutil_socket_t sfd, short evtype, void *opaque);
 
 public:
     shard_connection(unsigned int id, connections_manager* conn_man, benchmark_config* config,
@@ -89,6 +130,28 @@ public:
     void send_mget_command(struct timeval* sent_time, const keylist* key_list);
     void send_verify_get_command(struct timeval* sent_time, const char *key, int key_len,
                                  const char *value, int value_len, int expiry, unsigned int offset);
+    void send_delete_command(struct timeval* sent_time, const char *key, int key_len);
+    void send_incr_command(struct timeval* sent_time, const char *key, int key_len,
+                           unsigned int delta, bool decr);
+    void send_append_command(struct timeval* sent_time, const char *key, int key_len,
+                             const char *value, int value_len);
+    void send_touch_command(struct timeval* sent_time, const char *key, int key_len, int expiry);
+    void send_gets_command(struct timeval* sent_time, const char *key, int key_len);
+    void send_cas_command(struct timeval* sent_time, const char *key, int key_len,
+                          const char *value, int value_len, int expiry, unsigned long long cas);
+    void send_fence_command(struct timeval* sent_time);
+    void send_hset_command(struct timeval* sent_time, const char *key, int key_len,
+                           const char *field, int field_len, const char *value, int value_len);
+    void send_hget_command(struct timeval* sent_time, const char *key, int key_len,
+                           const char *field, int field_len);
+    void send_lpush_command(struct timeval* sent_time, const char *key, int key_len,
+                            const char *value, int value_len);
+    void send_lrange_command(struct timeval* sent_time, const char *key, int key_len, int start, int stop);
+    bool send_ltrim_command(struct timeval* sent_time, const char *key, int key_len, int start, int stop);
+    void send_zadd_command(struct timeval* sent_time, const char *key, int key_len,
+                           unsigned int score, const char *member, int member_len);
+    void send_zrangebyscore_command(struct timeval* sent_time, const char *key, int key_len,
+                                    unsigned int min, unsigned int max);
 
     void set_authentication() {
         m_authentication = auth_none;
@@ -110,6 +173,18 @@ public:
         return m_protocol;
     }
 
+    unsigned long int get_request_allocs() {
+        return m_request_allocs;
+    }
+
+    unsigned long int get_responses() {
+        return m_responses;
+    }
+
+    unsigned long long int get_response_latency() {
+        return m_response_latency;
+    }
+
     const char* get_address() {
         return m_address;
     }
@@ -119,8 +194,15 @@ public:
     }
 
     int check_sockfd_writable();
-    int check_sockfd_readable();
-    void gurantee_sockfd_dispatch();
+    int wait_established();
+
+    // room for a request another connection of the client dispatches here
+    bool request_slot_available();
+    unsigned int get_outstanding() { return m_pending_resp + m_udp_pending; }
+
+    // the fillers of its migration went through and its reconnect started,
+    // or else the move failed
+    void migration_placed(bool reconnecting);
 
     int serverTid;                      // server thread id it connected to
     Generator* intervalGenerator;       // used to generate the intervals
@@ -131,18 +213,33 @@ public:
 private:
     void setup_event();
     int setup_socket(struct connect_info* addr);
+    int setup_udp_socket(struct connect_info* addr);
+    void close_udp_socket();
 
     bool is_conn_setup_done();
     void send_conn_setup_commands(struct timeval timestamp);
 
-    request* pop_req();
-    void push_req(request* req);
+    request* pop_req(unsigned int opaque);
+    verify_request* push_req(request_type type, unsigned int size, struct timeval* sent_time, unsigned int keys);
+    void release_req(request* req);
+    bool inflight_slot_available();
 
     void process_response(void);
     void process_first_request();
     void fill_pipeline(void);
+    bool check_migration(void);
+    void finish_migration(bool moved);
 
     void handle_event(short evtype);
+    int write_buffer(void);
+    void reap_zerocopy_completions(void);
+
+    bool udp_slot_available();
+    void push_udp_req(unsigned int size, struct timeval* sent_time, unsigned int keys);
+    void flush_udp_batch();
+    void process_udp_datagram(const char* data, size_t len, struct timeval now);
+    void expire_udp_requests(struct timeval now);
+    void handle_udp_event(short evtype);
 
     unsigned int m_id;
     connections_manager* m_conns_manager;
@@ -160,15 +257,66 @@ private:
     struct event* m_event;
 
     abstract_protocol* m_protocol;
-    std::queue<request *>* m_pipeline;
+
+    // preallocated request slots, indexed by (sequence number & mask).
+    // Responses carrying an opaque are matched directly, the others in
+    // sending order.  Every slot can hold a verify request.
+    verify_request* m_inflight;
+    unsigned int m_inflight_mask;
+    unsigned int m_next_seq;            // sequence number of the next request, never 0
+    unsigned int m_oldest_seq;          // no request older than this is in flight
+    unsigned long int m_request_allocs; // allocations made for request tracking
 
     int m_pending_resp;
     bool m_connected;
 
+    // responses handled here and their total latency, for the per server summary
+    unsigned long int m_responses;
+    unsigned long long int m_response_latency;
+
+    // the migration moving this connection (-1 if none), whether it still
+    // waits for its responses, and when it was picked or else when it moved
+    int m_migration;
+    bool m_migrate_pending;
+    bool m_migrate_connecting;          // its placement and new handshake are under way
+    unsigned int m_migrations_seen;     // started migrations it looked at
+    struct timeval m_migrate_time;
+
+    // --noreply SETs sent since the last fence; the fence answers for them
+    unsigned int m_quiet_sets;
+    unsigned int m_quiet_bytes;
+    struct timeval m_quiet_start;       // when the first of them was sent
+
+    // MSG_ZEROCOPY writes (--zero-copy-threshold); bytes handed to the kernel
+    // stay in m_zerocopy_hold until the sends reading them have completed
+    bool m_zerocopy_enabled;
+    struct evbuffer* m_zerocopy_hold;
+    std::deque<zerocopy_send>* m_zerocopy_sends;    // oldest first
+    uint32_t m_zerocopy_next_seq;       // the kernel numbers sends from 0
+    uint64_t m_zerocopy_held;           // bytes ever moved to the hold
+    uint64_t m_zerocopy_drained;        // and drained from it
+
     enum authentication_state m_authentication;
     enum select_db_state m_db_selection;
     enum cluster_slots_state m_cluster_slots;
 
+    // UDP transport for GETs (--udp); the TCP socket still carries the rest
+    int m_udp_sockfd;
+    struct event* m_udp_event;
+    abstract_protocol* m_udp_protocol;
+    struct evbuffer* m_udp_read_buf;
+    struct evbuffer* m_udp_write_buf;
+    udp_slot* m_udp_slots;
+    unsigned int m_udp_slots_mask;
+    unsigned short m_udp_next_id;
+    unsigned int m_udp_pending;         // requests in flight
+    unsigned int m_udp_batch_count;     // datagrams queued for sendmmsg
+    size_t m_udp_batch_bytes;           // payload bytes queued in m_udp_write_buf
+    udp_frame_header* m_udp_batch_hdrs;
+    unsigned int* m_udp_batch_lens;
+    struct mmsghdr* m_udp_msgs;
+    struct iovec* m_udp_iovs;
+    char* m_udp_recv_bufs;
 };
 
 #endif //MEMTIER_BENCHMARK_SHARD_CONNECTION_H